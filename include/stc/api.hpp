@@ -2,6 +2,7 @@
 #define _STC_API_HPP_
 
 #include <array>
+#include <cmath>
 #include <exception>
 #include <functional>
 #include <sstream>
@@ -72,20 +73,33 @@ auto st_wrapper_exec(TWrapper &wrapper, std::function<void(TWrapper &)> fun, Ext
 
 template <typename TWrapper> void impl_st_set_renderer(TWrapper &w)
 {
-	// New renderer name
-	std::string host(w.template get_param<std::string>(0, "Renderer"));
+	// New renderer name, possibly a comma-separated list of renderers
+	std::stringstream spec(w.template get_param<std::string>(0, "Renderer"));
+	std::string host, hosts;
 
-	// Add tcp:// if needed
-	if (host.compare("local") != 0)
-		if (std::strncmp(host.c_str(), "tcp", 3) != 0)
-			host = std::string("tcp://") + host;
-
-	// Add port number if needed
-	if (std::strncmp(host.c_str(), "tcp", 3) == 0 && host.find(":", host.find(":") + 1) == std::string::npos)
-		host += ":13710";
+	while (std::getline(spec, host, ','))
+	{
+		// Add tcp:// if no transport is given (shm:// and ipc:// are used as-is)
+		if (host.compare("local") != 0)
+			if (host.find("://") == std::string::npos)
+				host = std::string("tcp://") + host;
+
+		// Split renderer options (eg. ?codec=lz4) from the address
+		auto query(host.find('?'));
+		std::string options(query == std::string::npos ? "" : host.substr(query));
+		host = host.substr(0, query);
+
+		// Add port number if needed
+		if (std::strncmp(host.c_str(), "tcp", 3) == 0 && host.find(":", host.find(":") + 1) == std::string::npos)
+			host += ":13710";
+
+		if (!hosts.empty())
+			hosts += ",";
+		hosts += host + options;
+	}
 
 	// Set new renderer
-	host_mgr.set_current(host);
+	host_mgr.set_current(hosts);
 }
 
 template <typename TWrapper> void impl_st_compile(TWrapper &w)
@@ -127,6 +141,30 @@ template <typename TWrapper> void impl_st_reset(TWrapper &w)
 	host_mgr.current().reset(w.template get_param<std::string>(0, "ctxt"));
 }
 
+template <typename TWrapper> void impl_st_prefetch(TWrapper &w)
+{
+	std::vector<std::string> ids;
+	for (auto id : w.template get_params<std::string>(0, "ctxt"))
+		ids.push_back(id);
+
+	// Start loading all the contexts at once
+	host_mgr.current().prefetch(ids);
+}
+
+template <typename TWrapper> void impl_st_set_render_ahead(TWrapper &w)
+{
+	auto id(w.template get_param<std::string>(0, "ctxt"));
+	auto enable(w.template get_param<boost::optional<bool>>(1, "Enable").get_value_or(true));
+
+	host_mgr.current().render_ahead(id, enable);
+}
+
+bool impl_st_parse_input(std::string &inputSpecName, std::string &buffer, int &channel);
+
+GLint impl_st_parse_filter(const std::string &filterName, const std::string &inputSpecName);
+
+GLenum impl_st_parse_format(const std::string &formatName);
+
 template <typename TWrapper> void impl_st_render(TWrapper &w)
 {
 	auto id(w.template get_param<std::string>(0, "ctxt"));
@@ -144,31 +182,25 @@ template <typename TWrapper> void impl_st_render(TWrapper &w)
 	if (height == -1) height = 360;
 
 	auto formatName(w.template get_param<boost::optional<std::string>>(4, "Format").get_value_or("RGBA"));
-	std::transform(formatName.begin(), formatName.end(),
-		formatName.begin(), ::tolower);
-	GLenum format;
-
-	if (formatName.compare("rgba") == 0)
-		format = GL_RGBA;
-	else if (formatName.compare("rgb") == 0)
-		format = GL_RGB;
-	else if (formatName.compare("luminance") == 0)
-		format = GL_LUMINANCE;
-	else
-		throw std::runtime_error("Invalid Format parameter");
+	GLenum format(impl_st_parse_format(formatName));
 
-	auto mouse(w.template get_param<boost::optional<std::shared_ptr<omw::basic_array<float>>>>(5, "Mouse")
-		.get_value_or(omw::vector_array<float>::make(4, 0.f)));
+	// The default mouse is not allocated, this runs once per frame
+	auto mouse(w.template get_param<boost::optional<std::shared_ptr<omw::basic_array<float>>>>(5, "Mouse"));
 
-	std::array<float, 4> mouse_array;
-	memcpy(mouse_array.data(), mouse->data(), sizeof(float) * (4 < mouse->size() ? 4 : mouse->size()));
+	std::array<float, 4> mouse_array{ 0.f, 0.f, 0.f, 0.f };
+	if (mouse)
+		memcpy(mouse_array.data(), (*mouse)->data(), sizeof(float) * (4 < (*mouse)->size() ? 4 : (*mouse)->size()));
 
 	auto doFrameTiming(w.template get_param<boost::optional<bool>>(6, "FrameTiming").get_value_or(false));
 
 	auto image(host_mgr.current().render(id, frameCount, width, height, mouse_array, format));
-	auto image_result(omw::ref_matrix<float>::make(*image.data, image.dims));
 
 	w.matrices_as_images(true);
+
+	// The result refers to the frame storage of the host, which is reused by
+	// the next render once the result is written
+	auto image_result(omw::ref_matrix<float>::make(*image.data, image.dims));
+
 	if (doFrameTiming)
 	{
 		w.write_result(image.frame_timing / 1e9, image_result);
@@ -179,7 +211,119 @@ template <typename TWrapper> void impl_st_render(TWrapper &w)
 	}
 }
 
-bool impl_st_parse_input(std::string &inputSpecName, std::string &buffer, int &channel);
+template <typename TWrapper> void impl_st_render_sound(TWrapper &w)
+{
+	auto id(w.template get_param<std::string>(0, "ctxt"));
+
+	auto start(w.template get_param<boost::optional<int>>(1, "Start").get_value_or(0));
+	auto rate(w.template get_param<boost::optional<int>>(3, "SampleRate").get_value_or(44100));
+
+	// Octave: -1 is default
+	if (start == -1) start = 0;
+	if (rate == -1) rate = 44100;
+
+	// One second of sound by default
+	auto count(w.template get_param<boost::optional<int>>(2, "Samples").get_value_or(rate));
+	if (count == -1) count = rate;
+
+	if (start < 0 || count < 0 || rate <= 0)
+		throw std::runtime_error("Invalid sound range");
+
+	auto sound(host_mgr.current().render_sound(id, start, count, rate));
+	w.write_result(omw::ref_matrix<float>::make(*sound.data, sound.dims));
+}
+
+template <typename TWrapper> void impl_st_export(TWrapper &w)
+{
+	auto id(w.template get_param<std::string>(0, "ctxt"));
+	auto frames(w.template get_param<std::shared_ptr<omw::basic_array<float>>>(1, "Frames"));
+	auto size(w.template get_param<std::shared_ptr<omw::basic_array<float>>>(2, "Size"));
+	auto path(w.template get_param<std::string>(3, "Path"));
+	auto formatName(w.template get_param<boost::optional<std::string>>(4, "Format").get_value_or(""));
+
+	// N exports frames 0 to N-1, [first last] exports an inclusive range
+	int first, last;
+	if (frames->size() == 1)
+	{
+		first = 0;
+		last = static_cast<int>(frames->data()[0]) - 1;
+	}
+	else if (frames->size() == 2)
+	{
+		first = static_cast<int>(frames->data()[0]);
+		last = static_cast<int>(frames->data()[1]);
+	}
+	else
+		throw std::runtime_error("Invalid Frames parameter, expected N or [first last]");
+
+	if (last < first)
+		throw std::runtime_error("Invalid Frames parameter, the range is empty");
+
+	// [width height], or a single value for square frames
+	int width, height;
+	if (size->size() == 1)
+		width = height = static_cast<int>(size->data()[0]);
+	else if (size->size() == 2)
+	{
+		width = static_cast<int>(size->data()[0]);
+		height = static_cast<int>(size->data()[1]);
+	}
+	else
+		throw std::runtime_error("Invalid Size parameter, expected [width height]");
+
+	if (width <= 0 || height <= 0)
+		throw std::runtime_error("Invalid Size parameter");
+
+	auto format(core::parse_export_format(formatName, path));
+
+	auto summary(host_mgr.current().export_frames(id, first, last - first + 1, width, height, path, format));
+	w.write_result(static_cast<double>(summary.frames), static_cast<double>(summary.bytes), summary.seconds);
+}
+
+
+/**
+ * Converts an input matrix to an image, flipping it vertically.
+ *
+ * @param imageValue    Matrix of the input
+ * @param inputSpecName Name of the input, for error messages
+ */
+template <typename TMatrix>
+std::shared_ptr<core::image> impl_st_make_image(const TMatrix &imageValue, const std::string &inputSpecName)
+{
+	// Get depth for tests
+	int d = imageValue->depth();
+
+	// Check dimensions
+	if (d <= 1 || d > 3)
+	{
+		std::stringstream ss;
+		ss << "Invalid number of dimensions for " << inputSpecName
+		   << ". Must be 2 or 3";
+		throw std::runtime_error(ss.str());
+	}
+
+	// Move image data in core::image structure
+	auto imgptr(std::make_shared<core::image>());
+	auto &img(*imgptr);
+	img.dims[0] = imageValue->dims()[0];
+	img.dims[1] = imageValue->dims()[1];
+	if (d == 3)
+		img.dims[2] = imageValue->dims()[2];
+	else
+		img.dims[2] = 1;
+	img.alloc();
+
+	// Copy data, vflip
+	size_t stride_size = sizeof(float) * img.dims[1] * img.dims[2];
+	for (auto i = 0u; i < img.dims[0]; ++i)
+	{
+		memcpy(&img.data->data()[i * stride_size / sizeof(float)],
+			   &imageValue->data()[(img.dims[0] - i - 1) * stride_size / sizeof(float)],
+			   stride_size);
+	}
+
+	return imgptr;
+}
 
 template <typename TWrapper> void impl_st_set_input(TWrapper &w)
 {
@@ -207,41 +351,10 @@ template <typename TWrapper> void impl_st_set_input(TWrapper &w)
 		}
 		else
 		{
-			// Get depth for tests
 			auto imageValue(boost::get<std::shared_ptr<omw::basic_matrix<float>>>(inputValue));
-			int d = imageValue->depth();
-
-			// Check dimensions
-			if (d <= 1 || d > 3)
-			{
-				std::stringstream ss;
-				ss << "Invalid number of dimensions for " << std::get<0>(inputSpec)
-				   << ". Must be 2 or 3";
-				throw std::runtime_error(ss.str());
-			}
-
-			// Move image data in core::image structure
-			auto imgptr(std::make_shared<core::image>());
-			auto &img(*imgptr);
-			img.dims[0] = imageValue->dims()[0];
-			img.dims[1] = imageValue->dims()[1];
-			if (d == 3)
-				img.dims[2] = imageValue->dims()[2];
-			else
-				img.dims[2] = 1;
-			img.data = std::make_shared<std::vector<float>>(img.dims[0] * img.dims[1] * img.dims[2]);
-
-			// Copy data, vflip
-			size_t stride_size = sizeof(float) * img.dims[1] * img.dims[2];
-			for (auto i = 0u; i < img.dims[0]; ++i)
-			{
-				memcpy(&img.data->data()[i * stride_size / sizeof(float)],
-					   &imageValue->data()[(img.dims[0] - i - 1) * stride_size / sizeof(float)],
-					   stride_size);
-			}
 
 			// Set context input
-			context->set_input(bufferName, channelName, imgptr);
+			context->set_input(bufferName, channelName, impl_st_make_image(imageValue, std::get<0>(inputSpec)));
 		}
 	}
 }
@@ -282,29 +395,125 @@ template <typename TWrapper> void impl_st_set_input_filter(TWrapper &w)
 		impl_st_parse_input(std::get<0>(inputSpec), bufferName, channelName);
 
 		// Parse format
-		auto filterMethod(std::get<1>(inputSpec));
-		std::transform(filterMethod.begin(), filterMethod.end(),
-			filterMethod.begin(), ::tolower);
-		GLint minFilter;
-
-		if (filterMethod.compare("linear") == 0)
-			minFilter = GL_LINEAR;
-		else if (filterMethod.compare("nearest") == 0)
-			minFilter = GL_NEAREST;
-		else if (filterMethod.compare("mipmap") == 0)
-			minFilter = GL_LINEAR_MIPMAP_LINEAR;
-		else
-		{
-			std::stringstream ss;
-			ss << "Invalid filter type '" << filterMethod << "' for " << std::get<0>(inputSpec);
-			throw std::runtime_error(ss.str());
-		}
+		GLint minFilter(impl_st_parse_filter(std::get<1>(inputSpec), std::get<0>(inputSpec)));
 
 		// Set context input filter
 		context->set_input_filter(bufferName, channelName, minFilter);
 	}
 }
 
+template <typename TWrapper> void impl_st_batch(TWrapper &w)
+{
+	// Parse context id
+	auto id(w.template get_param<std::string>(0, "ctxt"));
+
+	std::vector<core::batch_op> ops;
+
+	// Build the operation list
+	for (auto opSpec : w.template get_params<std::string, boost::variant<std::string, std::shared_ptr<omw::basic_matrix<float>>>>(1, "Operation"))
+	{
+		auto opName(std::get<0>(opSpec));
+		auto &opValue(std::get<1>(opSpec));
+
+		if (opName.compare("render") == 0 || opName.compare(0, 7, "render:") == 0)
+		{
+			// "render" or "render:Format", RGBA by default
+			GLenum format(impl_st_parse_format(opName.size() > 7 ? opName.substr(7) : "rgba"));
+
+			// [frame, width, height, mouse...], frame -1 for the next frame
+			std::array<float, 7> renderSpec{ -1.f, 640.f, 360.f, 0.f, 0.f, 0.f, 0.f };
+			if (auto renderValue = boost::get<std::shared_ptr<omw::basic_matrix<float>>>(&opValue))
+			{
+				if ((*renderValue)->size() > renderSpec.size())
+					throw std::runtime_error("Invalid render operation, expected [frame width height mouse]");
+
+				memcpy(renderSpec.data(), (*renderValue)->data(), sizeof(float) * (*renderValue)->size());
+			}
+
+			if (renderSpec[0] < -1.f || renderSpec[0] != std::floor(renderSpec[0]))
+				throw std::runtime_error("Invalid frame number for render operation");
+
+			if (renderSpec[1] < 1.f || renderSpec[2] < 1.f || renderSpec[1] != std::floor(renderSpec[1]) ||
+				renderSpec[2] != std::floor(renderSpec[2]))
+				throw std::runtime_error("Invalid size for render operation");
+
+			boost::optional<int> frame;
+			if (renderSpec[0] >= 0)
+				frame = static_cast<int>(renderSpec[0]);
+
+			std::array<float, 4> mouse{ renderSpec[3], renderSpec[4], renderSpec[5], renderSpec[6] };
+
+			ops.emplace_back(core::batch_op::make_render(id, frame, static_cast<size_t>(renderSpec[1]),
+														 static_cast<size_t>(renderSpec[2]), mouse, format));
+		}
+		else if (opName.compare("reset") == 0)
+		{
+			ops.emplace_back(core::batch_op::make_reset(id));
+		}
+		else
+		{
+			// Input operations: "image.0", "filter:image.0" or "reset:image.0"
+			auto colon(opName.find(':'));
+			std::string method(colon == std::string::npos ? "" : opName.substr(0, colon));
+			std::string inputName(opName.substr(colon == std::string::npos ? 0 : colon + 1));
+
+			std::string bufferName;
+			int channelName(0);
+			impl_st_parse_input(inputName, bufferName, channelName);
+
+			if (method.empty())
+			{
+				if (std::string *inputBufferName = boost::get<std::string>(&opValue))
+				{
+					std::transform(inputBufferName->begin(), inputBufferName->end(),
+						inputBufferName->begin(), ::tolower);
+					ops.emplace_back(core::batch_op::make_set_input(id, bufferName, channelName, *inputBufferName));
+				}
+				else
+				{
+					auto imageValue(boost::get<std::shared_ptr<omw::basic_matrix<float>>>(opValue));
+					ops.emplace_back(core::batch_op::make_set_input(id, bufferName, channelName,
+																	impl_st_make_image(imageValue, inputName)));
+				}
+			}
+			else if (method.compare("filter") == 0)
+			{
+				auto filterName(boost::get<std::string>(&opValue));
+				if (!filterName)
+				{
+					std::stringstream ss;
+					ss << "Missing filter type for " << inputName;
+					throw std::runtime_error(ss.str());
+				}
+
+				ops.emplace_back(core::batch_op::make_set_input_filter(id, bufferName, channelName,
+																	   impl_st_parse_filter(*filterName, inputName)));
+			}
+			else if (method.compare("reset") == 0)
+			{
+				ops.emplace_back(core::batch_op::make_reset_input(id, bufferName, channelName));
+			}
+			else
+			{
+				std::stringstream ss;
+				ss << "Invalid batch operation '" << opName << "'";
+				throw std::runtime_error(ss.str());
+			}
+		}
+	}
+
+	// Execute all operations at once
+	auto images(host_mgr.current().execute_batch(ops));
+
+	// Return the frames of all the render operations, in order
+	std::vector<std::shared_ptr<omw::basic_matrix<float>>> image_results;
+	for (auto &image : images)
+		image_results.emplace_back(omw::ref_matrix<float>::make(*image.data, image.dims));
+
+	w.matrices_as_images(true);
+	w.write_result(image_results);
+}
+
 }
 
 #endif /* _STC_API_HPP_ */
@@ -0,0 +1,54 @@
+#ifndef _STC_BROKER_BROKER_HPP_
+#define _STC_BROKER_BROKER_HPP_
+
+#include <string>
+#include <vector>
+
+namespace stc
+{
+namespace broker
+{
+
+/**
+ * Options of a broker
+ */
+struct broker_options
+{
+	/// Endpoints clients connect to, separated by commas
+	std::string bind_address;
+	/// Endpoints of the shadertoy_server backends
+	std::vector<std::string> backends;
+	/// Time between two health checks of a backend, in milliseconds
+	int ping_interval;
+	/// Time after which a request without reply is failed, in milliseconds
+	int timeout;
+	/// Time after which an export without reply is failed, in milliseconds,
+	/// or 0 to wait until it completes
+	int export_timeout;
+};
+
+class broker_impl;
+
+/**
+ * Load balancer which speaks the shadertoy_server protocol to clients and
+ * forwards their requests to a fleet of servers.
+ */
+class broker
+{
+	broker_impl * const impl_;
+
+public:
+	/**
+	 * @brief Creates a broker
+	 *
+	 * @param options Broker options
+	 */
+	broker(const broker_options &options);
+	~broker();
+
+	void run();
+};
+}
+}
+
+#endif /* _STC_BROKER_BROKER_HPP_ */
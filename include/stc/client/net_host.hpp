@@ -1,6 +1,9 @@
 #ifndef _STC_CLIENT_NET_HOST_HPP_
 #define _STC_CLIENT_NET_HOST_HPP_
 
+#include <functional>
+#include <future>
+
 #include "stc/core/basic_context.hpp"
 #include "stc/core/basic_host.hpp"
 
@@ -20,16 +23,42 @@ public:
 
 	void set_input(const std::string &buffer, size_t channel, const boost::variant<std::string, std::shared_ptr<core::image>> &data) override;
 
+	/**
+	 * Sets the value of an input without waiting for the server to apply it.
+	 *
+	 * @param buffer   Name of the buffer to change the inputs
+	 * @param channel  Channel id (0 to 3) of the input to change
+	 * @param data     Image data (or buffer name) to feed to the channel
+	 * @return         Future which completes (or throws) when the server replied
+	 */
+	std::future<void> set_input_async(const std::string &buffer, size_t channel,
+									  const boost::variant<std::string, std::shared_ptr<core::image>> &data);
+
 	void set_input_filter(const std::string &buffer, size_t channel, GLint minFilter) override;
 
 	void reset_input(const std::string &buffer, size_t channel) override;
 };
 
+/**
+ * Host which forwards all requests to a shadertoy_server instance.
+ *
+ * Requests are tagged with an id and sent over a DEALER socket by a
+ * background I/O thread, so many requests can be in flight at once. The
+ * synchronous methods wait on the result of their asynchronous counterpart.
+ * The futures returned by the asynchronous methods must not outlive the host.
+ */
 class net_host : public core::basic_host
 {
 	net_host_impl * const impl_;
 
 public:
+	/**
+	 * Callback invoked for each frame received from a subscription. It is
+	 * called on the I/O thread of the host, so it should return quickly and
+	 * must not call the host.
+	 */
+	typedef std::function<void(uint64_t sequence, const core::image &frame)> frame_callback;
+
 	net_host(const std::string &target);
 
 	~net_host();
@@ -39,11 +68,87 @@ public:
 	core::image render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
 					   const std::array<float, 4> &mouse, GLenum format) override;
 
+	/**
+	 * Renders a frame without waiting for the previous requests to complete.
+	 *
+	 * @see core::basic_host::render
+	 */
+	std::future<core::image> render_async(const std::string &id, boost::optional<int> frame, size_t width,
+										  size_t height, const std::array<float, 4> &mouse, GLenum format);
+
+	core::image render_sound(const std::string &id, uint64_t start, uint32_t count, float rate) override;
+
+	/**
+	 * Exports frames on the server. The path is relative to the export
+	 * directory of the server, and the frames are not sent back.
+	 */
+	core::export_summary export_frames(const std::string &id, int first, uint32_t count, size_t width,
+									   size_t height, const std::string &path, core::export_format format) override;
+
 	void reset(const std::string &id) override;
 
 	std::string create_local(const std::vector<std::pair<std::string, std::string>> &bufferSources) override;
 
+	/**
+	 * Creates a local context without waiting for the previous requests to
+	 * complete.
+	 *
+	 * @see core::basic_host::create_local
+	 */
+	std::future<std::string> create_local_async(const std::vector<std::pair<std::string, std::string>> &bufferSources);
+
 	std::shared_ptr<core::basic_context> get_context(const std::string &id) override;
+
+	/**
+	 * Asks the server to start loading contexts. Errors, including servers
+	 * which do not support prefetching, are only logged.
+	 */
+	void prefetch(const std::vector<std::string> &ids) override;
+
+	/**
+	 * Sends the render request of the next frame as soon as a frame is
+	 * returned, so the server renders it while the caller processes the
+	 * current one. A discarded frame requested without a number still counts
+	 * as rendered on the server.
+	 */
+	void render_ahead(const std::string &id, bool enable) override;
+
+	/**
+	 * Executes a batch with one request per run of consecutive operations on
+	 * the same context. Servers which only speak the string protocol get one
+	 * request per operation.
+	 *
+	 * @see core::basic_host::execute_batch
+	 */
+	std::vector<core::image> execute_batch(const std::vector<core::batch_op> &ops) override;
+
+	/**
+	 * @brief Asks the server to render a context continuously and push the
+	 * frames to this host. Frames are dropped, not queued, when the callback
+	 * does not keep up, so gaps in the sequence numbers must be expected.
+	 * This host renews the lease of the stream in the background: the server
+	 * stops the stream once the host is gone.
+	 *
+	 * @param id       Context to render
+	 * @param width    Width of the frames
+	 * @param height   Height of the frames
+	 * @param mouse    Value of the iMouse uniform
+	 * @param format   Format of the frames (GL_RGBA, GL_RGB or GL_LUMINANCE)
+	 * @param rate     Target frame rate, 0 to render as fast as possible
+	 * @param frames   Number of frames to render, 0 until unsubscribe is called
+	 * @param callback Callback invoked for each received frame
+	 * @return         Id of the stream, to be given to unsubscribe
+	 */
+	std::string subscribe(const std::string &id, size_t width, size_t height, const std::array<float, 4> &mouse,
+						  GLenum format, float rate, uint32_t frames, const frame_callback &callback);
+
+	/**
+	 * @brief Stops a stream started by subscribe. No callback for this stream
+	 * is invoked once this method returns.
+	 *
+	 * @param stream Id of the stream returned by subscribe
+	 */
+	void unsubscribe(const std::string &stream);
 };
 }
 }
@@ -10,6 +10,8 @@
 
 #include <epoxy/gl.h>
 
+#include "batch.hpp"
+#include "export.hpp"
 #include "image.hpp"
 
 namespace stc
@@ -51,6 +53,34 @@ class basic_host
 	virtual image render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
 						 const std::array<float, 4> &mouse, GLenum format) = 0;
 
+	/**
+	 * Renders samples of the sound pass of a shadertoy.
+	 *
+	 * @param  id    Name of the shadertoy context to render.
+	 * @param  start First sample to render.
+	 * @param  count Number of samples to render.
+	 * @param  rate  Sample rate, in Hz.
+	 * @return       Image of count rows, holding the left and right channels.
+	 */
+	virtual image render_sound(const std::string &id, uint64_t start, uint32_t count, float rate) = 0;
+
+	/**
+	 * Renders a range of frames of a shadertoy, and writes them to a file as
+	 * they are rendered. The frames are not returned, so exporting long
+	 * sequences does not need to hold them in memory.
+	 *
+	 * @param  id     Name of the shadertoy context to render.
+	 * @param  first  Number of the first frame to render.
+	 * @param  count  Number of frames to render.
+	 * @param  width  Rendering width.
+	 * @param  height Rendering height.
+	 * @param  path   Path of the export, see export_frame_path.
+	 * @param  format Format of the export.
+	 * @return        Summary of the export.
+	 */
+	virtual export_summary export_frames(const std::string &id, int first, uint32_t count, size_t width,
+										 size_t height, const std::string &path, export_format format) = 0;
+
 	/**
 	 * Resets the context associated with this Shadertoy Id.
 	 *
@@ -75,6 +105,44 @@ class basic_host
 	 * @return    Pointer to the context.
 	 */
 	virtual std::shared_ptr<basic_context> get_context(const std::string &id) = 0;
+
+	/**
+	 * Starts loading remote contexts in the background, so later calls on
+	 * them do not wait for their download. Errors are reported by these later
+	 * calls. The default implementation does nothing, contexts are then
+	 * loaded on first use.
+	 *
+	 * @param ids Shadertoy identifiers
+	 */
+	virtual void prefetch(const std::vector<std::string> &ids);
+
+	/**
+	 * Enables or disables rendering ahead on a context. Once a frame of this
+	 * context is returned, the next one is rendered in the background with
+	 * the same parameters, and a render call asking for it returns it without
+	 * waiting. Any other call on the host discards it. The default
+	 * implementation does nothing, frames are then rendered on demand.
+	 * Hosts which cannot undo a discarded frame render contexts with
+	 * buffers on demand.
+	 *
+	 * @param id     Shadertoy identifier
+	 * @param enable true to render ahead, false to render on demand
+	 */
+	virtual void render_ahead(const std::string &id, bool enable);
+
+	/**
+	 * Executes a list of operations in order, stopping at the first error.
+	 * The default implementation calls the methods of the host and its
+	 * contexts, hosts which can execute several operations at once override
+	 * it.
+	 *
+	 * Errors are raised as a batch_error, which holds the frames rendered
+	 * before the failed operation.
+	 *
+	 * @param  ops Operations to execute
+	 * @return     Frames rendered by the render operations, in order
+	 */
+	virtual std::vector<image> execute_batch(const std::vector<batch_op> &ops);
 };
 }
 }
@@ -0,0 +1,110 @@
+#ifndef _STC_CORE_BATCH_HPP_
+#define _STC_CORE_BATCH_HPP_
+
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/optional.hpp>
+#include <boost/variant.hpp>
+
+#include <epoxy/gl.h>
+
+#include "stc/core/image.hpp"
+
+namespace stc
+{
+namespace core
+{
+
+/// Operations which can be part of a batch
+enum class batch_kind : uint8_t
+{
+	set_input = 0,
+	set_input_filter = 1,
+	reset_input = 2,
+	render = 3,
+	reset = 4
+};
+
+/**
+ * Single operation of a batch. Only the fields relevant to its kind are used.
+ */
+struct batch_op
+{
+	batch_kind kind;
+
+	/// Context the operation applies to
+	std::string id;
+
+	/// Input the operation applies to, for input operations
+	std::string buffer;
+	size_t channel;
+
+	/// Value of the input, for set_input
+	boost::variant<std::string, std::shared_ptr<image>> input;
+
+	/// Filtering method of the input, for set_input_filter
+	GLint min_filter;
+
+	/// Rendering parameters, for render
+	boost::optional<int> frame;
+	size_t width;
+	size_t height;
+	std::array<float, 4> mouse;
+	GLenum format;
+
+	batch_op();
+
+	static batch_op make_set_input(const std::string &id, const std::string &buffer, size_t channel,
+								   const boost::variant<std::string, std::shared_ptr<image>> &input);
+
+	static batch_op make_set_input_filter(const std::string &id, const std::string &buffer, size_t channel,
+										  GLint min_filter);
+
+	static batch_op make_reset_input(const std::string &id, const std::string &buffer, size_t channel);
+
+	static batch_op make_render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
+								const std::array<float, 4> &mouse, GLenum format);
+
+	static batch_op make_reset(const std::string &id);
+};
+
+/**
+ * Error raised when an operation of a batch fails. It holds the frames of the
+ * render operations which completed before it.
+ */
+class batch_error : public std::runtime_error
+{
+	/// Index of the failed operation in the batch
+	size_t index_;
+	/// Error message of the failed operation
+	std::string message_;
+	/// Frames rendered before the failed operation
+	std::vector<image> results_;
+
+	public:
+	/**
+	 * @brief Creates a new batch error
+	 *
+	 * @param index   Index of the failed operation in the batch
+	 * @param message Error message of the failed operation
+	 * @param results Frames rendered before the failed operation
+	 */
+	batch_error(size_t index, const std::string &message, std::vector<image> results);
+
+	/// Index of the failed operation in the batch
+	inline size_t index() const { return index_; }
+
+	/// Error message of the failed operation
+	inline const std::string &message() const { return message_; }
+
+	/// Frames rendered before the failed operation, in order
+	inline std::vector<image> &results() { return results_; }
+};
+}
+}
+
+#endif /* _STC_CORE_BATCH_HPP_ */
@@ -0,0 +1,63 @@
+#ifndef _STC_CORE_EXPORT_HPP_
+#define _STC_CORE_EXPORT_HPP_
+
+#include <cstdint>
+#include <string>
+
+namespace stc
+{
+namespace core
+{
+
+/// File formats frames can be exported to
+enum class export_format : uint8_t
+{
+	/// Uncompressed YUV4MPEG2 video, 4:4:4 at 60 fps
+	y4m = 0,
+	/// Raw 8-bit RGBA frames, one after the other
+	rgba = 1,
+	/// Sequence of PNG files
+	png = 2,
+	/// NumPy array of float RGBA frames, written through a memory mapping
+	npy = 3
+};
+
+/// Result of an export, returned instead of the frames
+struct export_summary
+{
+	/// Number of exported frames
+	uint32_t frames;
+	/// Number of bytes written
+	uint64_t bytes;
+	/// Duration of the export, in seconds
+	double seconds;
+};
+
+/**
+ * @brief Parses the name of an export format
+ *
+ * @param name Name of the format (y4m, rgba, png or npy), or an empty
+ *             string to guess it from the extension of \p path
+ * @param path Path of the export
+ * @return     Export format
+ * @throws std::runtime_error if the format is unknown
+ */
+export_format parse_export_format(const std::string &name, const std::string &path);
+
+/**
+ * @brief Returns the path of a frame of an export. PNG sequences are written
+ * to one file per frame, the path of which is given by a printf-style
+ * integer conversion such as %05d in the export path. If there is none,
+ * _%05d is inserted before the extension.
+ *
+ * @param path   Path of the export
+ * @param format Export format
+ * @param frame  Index of the frame in the export
+ * @return       Path of the file the frame is written to
+ * @throws std::runtime_error if the path has an invalid conversion
+ */
+std::string export_frame_path(const std::string &path, export_format format, uint32_t frame);
+}
+}
+
+#endif /* _STC_CORE_EXPORT_HPP_ */
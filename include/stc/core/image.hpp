@@ -3,6 +3,8 @@
 
 #include <array>
 #include <memory>
+#include <new>
+#include <utility>
 #include <vector>
 
 namespace stc
@@ -10,9 +12,35 @@ namespace stc
 namespace core
 {
 
+/**
+ * Allocator which default-initializes elements instead of value-initializing
+ * them, so growing a vector of floats leaves the new elements uninitialized
+ * instead of zeroing them.
+ */
+template <typename T> struct default_init_allocator : public std::allocator<T>
+{
+	template <typename U> struct rebind
+	{
+		typedef default_init_allocator<U> other;
+	};
+
+	default_init_allocator() noexcept {}
+
+	template <typename U> default_init_allocator(const default_init_allocator<U> &) noexcept {}
+
+	template <typename U> void construct(U *ptr)
+	{ ::new (static_cast<void *>(ptr)) U; }
+
+	template <typename U, typename... Args> void construct(U *ptr, Args &&... args)
+	{ ::new (static_cast<void *>(ptr)) U(std::forward<Args>(args)...); }
+};
+
+/// Storage of image pixels, which is not cleared when it is allocated or grown
+typedef std::vector<float, default_init_allocator<float>> image_data;
+
 struct image
 {
-	std::shared_ptr<std::vector<float>> data;
+	std::shared_ptr<image_data> data;
 	std::array<uint32_t, 3> dims;
 
 	// Flag to indicate the data in the data field has changed since the last
@@ -24,8 +52,22 @@ struct image
 
 	void alloc();
 
+	/**
+	 * @brief Flips the rows of the image data in place
+	 */
+	void vflip();
+
 	image();
 };
+
+/**
+ * @brief Flips the rows of pixel data in place
+ *
+ * @param pixels Pixel data
+ * @param height Number of rows
+ * @param stride Number of floats in a row
+ */
+void vflip(float *pixels, size_t height, size_t stride);
 }
 }
 
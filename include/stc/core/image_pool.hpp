@@ -0,0 +1,82 @@
+#ifndef _STC_CORE_IMAGE_POOL_HPP_
+#define _STC_CORE_IMAGE_POOL_HPP_
+
+#include <cstddef>
+#include <memory>
+
+#include "stc/core/image.hpp"
+
+namespace stc
+{
+namespace core
+{
+
+/**
+ * Recycles the storage of images. When the last reference to a buffer is
+ * dropped, the buffer goes back to a free list instead of the heap, and it is
+ * handed out again to an image of the same size class without being cleared.
+ *
+ * Size classes are four steps per power of two, so a buffer wastes at most a
+ * quarter of its capacity, and an image can change size slightly without
+ * leaving its class. Once warm, rendering at varying sizes neither faults in
+ * new pages nor zeroes them. Large buffers are advised to use transparent huge
+ * pages, where supported, before they are first touched.
+ *
+ * Buffers may be released from any thread, and may outlive the pool.
+ */
+class image_pool
+{
+	struct state;
+
+	std::shared_ptr<state> state_;
+
+public:
+	/**
+	 * @brief Creates an empty pool
+	 *
+	 * @param budget Maximum size of the free buffers kept by the pool, in
+	 *               bytes. Buffers released beyond that are freed.
+	 */
+	image_pool(size_t budget);
+
+	/**
+	 * @brief Gets the pool used by core::image, whose budget is set in MiB by
+	 * STC_IMAGE_POOL (default: 256)
+	 */
+	static image_pool &global();
+
+	/**
+	 * @brief Gets a buffer of the given size. Its contents are unspecified:
+	 * the elements of a new buffer, or of a recycled one which grows, are
+	 * left uninitialized.
+	 *
+	 * @param size Number of floats in the buffer
+	 * @return     Buffer, returned to the pool when its last reference is
+	 *             dropped
+	 */
+	std::shared_ptr<image_data> acquire(size_t size);
+
+	/**
+	 * @brief Frees all the buffers kept by the pool
+	 */
+	void clear();
+
+	/**
+	 * @brief Gets the size of the free buffers kept by the pool
+	 *
+	 * @return Size in bytes
+	 */
+	size_t free_size() const;
+
+	/**
+	 * @brief Gets the capacity of the buffers of the size class of a request
+	 *
+	 * @param size Number of floats requested
+	 * @return     Number of floats allocated for that request
+	 */
+	static size_t size_class(size_t size);
+};
+}
+}
+
+#endif /* _STC_CORE_IMAGE_POOL_HPP_ */
@@ -0,0 +1,104 @@
+#ifndef _STC_CORE_MAPPED_FRAMES_HPP_
+#define _STC_CORE_MAPPED_FRAMES_HPP_
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "stc/core/export.hpp"
+
+namespace stc
+{
+namespace core
+{
+
+/**
+ * Sequence of float frames stored in a NumPy .npy file, which is mapped in
+ * memory so frames are read back directly into the file pages. The array has
+ * the shape (frames, height, width, depth), so it can be loaded without
+ * copying with numpy.load(path, mmap_mode='r').
+ *
+ * The whole sequence never lives on the heap: written frames are handed to
+ * the kernel for writeback, and their pages can be reclaimed. Different
+ * frames can be written by several threads at once. The blocks of the file
+ * are allocated when it is created, so running out of disk space is reported
+ * then instead of faulting while frames are written.
+ */
+class mapped_frames
+{
+	const std::string path_;
+	const uint32_t frames_;
+	const size_t frame_size_;
+
+	int fd_;
+	void *map_;
+	size_t map_size_;
+	size_t header_size_;
+	bool kept_;
+
+	std::chrono::steady_clock::time_point start_;
+
+public:
+	/**
+	 * @brief Creates the file, sized for the whole sequence, and maps it
+	 *
+	 * @param path   Path of the file, replaced if it exists
+	 * @param frames Number of frames
+	 * @param height Height of the frames
+	 * @param width  Width of the frames
+	 * @param depth  Number of channels of the frames
+	 * @param keep   true to keep the frames of an existing file holding an
+	 *               array of the same shape, to resume writing it
+	 * @throws std::runtime_error if the file could not be created, allocated
+	 *                            or mapped
+	 */
+	mapped_frames(const std::string &path, uint32_t frames, uint32_t height, uint32_t width, uint32_t depth,
+				  bool keep = false);
+
+	/**
+	 * @brief Unmaps the file. Frames which were not written are left zeroed.
+	 */
+	~mapped_frames();
+
+	mapped_frames(const mapped_frames &) = delete;
+	mapped_frames &operator=(const mapped_frames &) = delete;
+
+	/**
+	 * @brief Checks if the frames of an existing file were kept
+	 *
+	 * @return false if the file was created or replaced, its frames are then
+	 *         zeroed
+	 */
+	inline bool kept() const
+	{ return kept_; }
+
+	/**
+	 * @brief Gets the storage of a frame in the mapped file
+	 *
+	 * @param index Index of the frame
+	 * @return      Pointer to height * width * depth floats, rows top first
+	 */
+	float *frame(uint32_t index);
+
+	/**
+	 * @brief Starts the writeback of a frame once it is written, so dirty
+	 * pages do not pile up over long sequences. This does nothing on other
+	 * systems than Linux.
+	 *
+	 * @param index Index of the frame
+	 */
+	void done(uint32_t index);
+
+	/**
+	 * @brief Writes the frames to the file and unmaps it
+	 *
+	 * @return Summary of the export
+	 * @throws std::runtime_error if the frames could not be written
+	 */
+	export_summary finish();
+};
+}
+}
+
+#endif /* _STC_CORE_MAPPED_FRAMES_HPP_ */
@@ -0,0 +1,96 @@
+#ifndef _STC_CORE_SHARDED_HOST_HPP_
+#define _STC_CORE_SHARDED_HOST_HPP_
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "stc/core/basic_host.hpp"
+
+namespace stc
+{
+namespace core
+{
+
+/**
+ * Host which spreads contexts over several backend hosts. Local contexts are
+ * created on the backend holding the fewest local contexts, remote contexts
+ * are placed by consistent hashing of their id. Every later call on a context
+ * is forwarded to the backend it was placed on.
+ */
+class sharded_host : public basic_host
+{
+	/// Number of points of each backend on the hash ring
+	static constexpr size_t virtual_nodes = 64;
+
+	std::vector<std::unique_ptr<basic_host>> backends_;
+
+	/// Number of local contexts placed on each backend
+	std::vector<size_t> load_;
+
+	/// Consistent hash ring, from point to backend index
+	std::map<uint64_t, size_t> ring_;
+
+	/// Backend of each local context
+	std::map<std::string, size_t> placement_;
+	std::mutex placement_mutex_;
+
+	/**
+	 * @brief Returns the backend of a context, placing it if it is unknown
+	 *
+	 * @param id Context identifier
+	 * @return   Backend the context lives on
+	 */
+	basic_host &backend(const std::string &id);
+
+	/**
+	 * @brief Forgets the placement of a local context which was reset, so it
+	 * does not count in the load of its backend anymore
+	 *
+	 * @param id Context identifier
+	 */
+	void release(const std::string &id);
+
+public:
+	/**
+	 * @brief Initializes a sharded host
+	 *
+	 * @param names    Names of the backends, used to place them on the hash ring
+	 * @param backends Backend hosts, in the same order as names
+	 */
+	sharded_host(const std::vector<std::string> &names, std::vector<std::unique_ptr<basic_host>> &&backends);
+
+	void allocate() override;
+
+	image render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
+				 const std::array<float, 4> &mouse, GLenum format) override;
+
+	image render_sound(const std::string &id, uint64_t start, uint32_t count, float rate) override;
+
+	export_summary export_frames(const std::string &id, int first, uint32_t count, size_t width, size_t height,
+								 const std::string &path, export_format format) override;
+
+	void reset(const std::string &id) override;
+
+	std::string create_local(const std::vector<std::pair<std::string, std::string>> &bufferSources) override;
+
+	std::shared_ptr<basic_context> get_context(const std::string &id) override;
+
+	/**
+	 * Prefetches contexts, sending each backend the list of its own contexts.
+	 */
+	void prefetch(const std::vector<std::string> &ids) override;
+
+	void render_ahead(const std::string &id, bool enable) override;
+
+	/**
+	 * Executes a batch, forwarding each run of consecutive operations on the
+	 * same backend as a single batch.
+	 */
+	std::vector<image> execute_batch(const std::vector<batch_op> &ops) override;
+};
+}
+}
+
+#endif /* _STC_CORE_SHARDED_HOST_HPP_ */
@@ -12,6 +12,10 @@
 
 #include "stc/core/basic_context.hpp"
 
+#include "stc/gl/remote.hpp"
+#include "stc/gl/sound.hpp"
+#include "stc/gl/texture_cache.hpp"
+
 namespace stc
 {
 namespace gl
@@ -34,22 +38,35 @@ class context : public core::basic_context
 	/// The currently rendered image
 	core::image current_image_;
 
+	/// Storage of the previous frame, reused once it is released
+	std::shared_ptr<core::image_data> spare_data_;
+
+	/// Source of the sound pass, empty if there is none
+	std::string sound_source_;
+
+	/// Sound pass renderer, compiled on first use
+	std::unique_ptr<sound_renderer> sound_;
+
 public:
 	/**
 	 * Builds a new rendering context for a given Shadertoy.
 	 *
 	 * @param shaderId Identifier of the Shadertoy to render.
+	 * @param shader   Shader fetched from the API.
+	 * @param textures Cache of the textures shared with other contexts.
 	 * @param width    Initial width of the rendering context.
 	 * @param height   Initial height of the rendering context.
 	 */
-	context(const std::string &shaderId, size_t width, size_t height);
+	context(const std::string &shaderId, const remote_shader &shader, texture_cache &textures, size_t width,
+			size_t height);
 
 	/**
 	 * Builds a multi-buffer rendering context from source.
 	 *
 	 * @param shaderId      Identifier for this rendering context.
 	 * @param bufferSources Source for all of the buffers to render. The image
-	 *                      buffer must be present.
+	 *                      buffer must be present. A "sound" entry is the
+	 *                      source of the sound pass.
 	 * @param width         Initial width of the rendering context.
 	 * @param height        Initial height of the rendering context.
 	 * @throws std::runtime_error If an error occurs during the construction of
@@ -67,6 +84,25 @@ public:
 	inline int frame_count() const
 	{ return frame_count_; }
 
+	/**
+	 * @brief Sets the number of the next frame to render by default, to undo
+	 * a frame rendered ahead which was not used
+	 *
+	 * @param frame Number of the next frame
+	 */
+	inline void frame_count(int frame)
+	{ frame_count_ = frame; }
+
+	/**
+	 * @brief Checks if frames depend on the previous ones, because the
+	 * context has buffers besides the image, or because the image reads its
+	 * own output. Rewinding the frame count is not enough to render such
+	 * frames again.
+	 *
+	 * @return true if rendering a frame changes the next ones
+	 */
+	bool has_history();
+
 	/**
 	 * @brief Renders a new frame at the given resolution
 	 *
@@ -78,6 +114,43 @@ public:
 	 */
 	void perform_render(int frame, size_t width, size_t height, const std::array<float, 4> &mouse, GLenum format);
 
+	/**
+	 * @brief Renders a new frame at the given resolution, and reads it back
+	 * into external storage instead of the current image
+	 *
+	 * @param frame  Number of the frame to render
+	 * @param width  Rendering width
+	 * @param height Rendering height
+	 * @param mouse  Mouse status
+	 * @param format Rendering format
+	 * @param dst    Destination buffer, at least large enough to hold
+	 *               width * height * depth floats
+	 */
+	void perform_render(int frame, size_t width, size_t height, const std::array<float, 4> &mouse, GLenum format,
+						float *dst);
+
+	/**
+	 * @brief Reads back the output of the last rendered frame, without
+	 * flipping it
+	 *
+	 * @param format Rendering format
+	 * @param dst    Destination buffer, at least large enough to hold
+	 *               width * height * depth floats
+	 */
+	void read_output(GLenum format, float *dst);
+
+	/**
+	 * @brief Renders samples of the sound pass
+	 *
+	 * @param start First sample to render
+	 * @param count Number of samples to render
+	 * @param rate  Sample rate, in Hz
+	 * @return      Image of count rows holding the left and right channels
+	 * @throws std::runtime_error if the context has no sound pass, or if it
+	 *                            could not be compiled
+	 */
+	core::image render_sound(uint64_t start, uint32_t count, float rate);
+
 	/**
 	 * @brief Gets the current frame result
 	 *
@@ -98,6 +171,11 @@ public:
 	 */
 	void initialize(const std::string &shaderId, size_t width, size_t height);
 
+	/**
+	 * Updates the uniforms and renders a frame, without reading it back.
+	 */
+	void render_frame(int frame, size_t width, size_t height, const std::array<float, 4> &mouse);
+
 	/**
 	 * Returns the number of components for a given format.
 	 *
@@ -153,6 +231,10 @@ public:
 
 		inline const std::shared_ptr<shadertoy::inputs::basic_input> &overriden_input() const
 		{ return overriden_input_; }
+
+		/// true if the override reads the output of a buffer
+		inline bool reads_buffer() const
+		{ return static_cast<bool>(member_input_); }
 	};
 };
 }
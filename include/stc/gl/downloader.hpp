@@ -0,0 +1,112 @@
+#ifndef _STC_GL_DOWNLOADER_HPP_
+#define _STC_GL_DOWNLOADER_HPP_
+
+#include <array>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <curl/curl.h>
+
+namespace stc
+{
+namespace gl
+{
+
+/**
+ * Downloads files over HTTP. Easy handles are pooled and share their DNS
+ * cache, TLS sessions and connections, so successive downloads from the same
+ * host do not open new connections.
+ */
+class downloader
+{
+	CURLSH *share_;
+
+	/// Locks of the data shared between the easy handles
+	std::array<std::mutex, CURL_LOCK_DATA_LAST> share_locks_;
+
+	/// Idle easy handles
+	std::vector<CURL *> pool_;
+	std::mutex pool_mutex_;
+
+	static void lock_share(CURL *handle, curl_lock_data data, curl_lock_access access, void *userptr);
+	static void unlock_share(CURL *handle, curl_lock_data data, void *userptr);
+
+	CURL *acquire();
+	void release(CURL *curl);
+
+public:
+	/// File to download
+	struct download
+	{
+		std::string url;
+		std::string path;
+	};
+
+	/// Result of a transfer
+	struct response
+	{
+		/// HTTP status code
+		long status;
+		/// Contents of the resource
+		std::string body;
+		/// Value of the ETag header, empty if absent
+		std::string etag;
+		/// Value of the Last-Modified header, empty if absent
+		std::string last_modified;
+	};
+
+	/// Maximum number of concurrent connections to a single host
+	static constexpr long max_host_connections = 6;
+
+	downloader();
+	~downloader();
+
+	downloader(const downloader &) = delete;
+	downloader &operator=(const downloader &) = delete;
+
+	/**
+	 * @brief Downloads a resource in memory
+	 *
+	 * @param url URL of the resource
+	 * @return    Contents of the resource
+	 * @throws std::runtime_error if the transfer failed
+	 */
+	std::string get(const std::string &url);
+
+	/**
+	 * @brief Downloads a resource in memory, with extra request headers. A
+	 * 304 Not Modified status is not an error.
+	 *
+	 * @param url     URL of the resource
+	 * @param headers Extra request headers, such as If-None-Match
+	 * @return        Status, contents and validators of the resource
+	 * @throws std::runtime_error if the transfer failed
+	 */
+	response get(const std::string &url, const std::vector<std::string> &headers);
+
+	/**
+	 * @brief Downloads files concurrently. Each file is written next to its
+	 * destination, in a .part file private to the transfer, and only moved
+	 * there once complete.
+	 *
+	 * @param downloads Files to download
+	 * @throws std::runtime_error if any transfer failed, once all transfers
+	 *         are complete
+	 */
+	void fetch_all(const std::vector<download> &downloads);
+};
+
+/**
+ * @brief Returns a temporary path next to a file, to write it before moving
+ * it in place. Each call returns a new path, so concurrent writers of the
+ * same file, in this process or another one, do not overwrite each other.
+ *
+ * @param path Path of the file
+ * @return     Path of the temporary file, ending with .part
+ */
+std::string part_path(const std::string &path);
+}
+}
+
+#endif /* _STC_GL_DOWNLOADER_HPP_ */
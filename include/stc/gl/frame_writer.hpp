@@ -0,0 +1,145 @@
+#ifndef _STC_GL_FRAME_WRITER_HPP_
+#define _STC_GL_FRAME_WRITER_HPP_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stc/core/export.hpp"
+#include "stc/core/image.hpp"
+
+namespace stc
+{
+namespace gl
+{
+
+/**
+ * Encodes rendered frames to files on a background thread, so encoding
+ * overlaps with rendering. Frames are handed over through a bounded queue:
+ * pushing blocks while the encoder is behind, which bounds the memory used
+ * by an export.
+ */
+class frame_writer
+{
+	const std::string path_;
+	const core::export_format format_;
+	const uint32_t width_, height_;
+
+	/// Index of the first frame written by this writer in the export
+	const uint32_t first_;
+
+	/// Output file of single file formats
+	std::unique_ptr<FILE, int (*)(FILE *)> file_;
+
+	std::deque<core::image> queue_;
+	bool closed_;
+	std::exception_ptr error_;
+	std::mutex mutex_;
+	std::condition_variable cv_;
+
+	uint32_t frames_;
+	uint64_t bytes_;
+	std::chrono::steady_clock::time_point start_;
+
+	/// Conversion buffer, only used by the encoder thread
+	std::vector<uint8_t> buffer_;
+
+	std::thread thread_;
+
+	void run();
+
+	void write_frame(const core::image &frame);
+
+	void write(const void *data, size_t size);
+
+	frame_writer(const std::string &path, core::export_format format, uint32_t width, uint32_t height,
+				 uint32_t first, bool part);
+
+public:
+	/// Number of frames waiting to be encoded before push blocks
+	static constexpr size_t queue_depth = 4;
+
+	/**
+	 * @brief Opens an export and starts its encoder thread
+	 *
+	 * @param path   Path of the export, see core::export_frame_path
+	 * @param format Export format
+	 * @param width  Width of the frames
+	 * @param height Height of the frames
+	 * @throws std::runtime_error if the output could not be opened, or the
+	 *                            format is not supported by this build
+	 */
+	frame_writer(const std::string &path, core::export_format format, uint32_t width, uint32_t height);
+
+	/**
+	 * @brief Opens a part of an export, so several writers can write
+	 * different frames of it at once. Video and raw exports must have been
+	 * created by allocate beforehand.
+	 *
+	 * @param path   Path of the export, see core::export_frame_path
+	 * @param format Export format
+	 * @param width  Width of the frames
+	 * @param height Height of the frames
+	 * @param first  Index of the first frame of the part in the export
+	 * @throws std::runtime_error if the output could not be opened, or the
+	 *                            format is not supported by this build
+	 */
+	frame_writer(const std::string &path, core::export_format format, uint32_t width, uint32_t height,
+				 uint32_t first);
+
+	/**
+	 * @brief Creates a single file export, sized for all of its frames, to be
+	 * written in parts. Frames are stored at fixed offsets, so the parts can
+	 * be written in any order. Nothing is done for PNG sequences.
+	 *
+	 * @param path   Path of the export
+	 * @param format Export format
+	 * @param width  Width of the frames
+	 * @param height Height of the frames
+	 * @param count  Number of frames of the export
+	 * @param keep   true to keep an existing file of the right size and
+	 *               header, to resume writing it
+	 * @return       true if an existing file was kept, false if it was
+	 *               created or replaced. PNG sequences are always kept.
+	 * @throws std::runtime_error if the file could not be created
+	 */
+	static bool allocate(const std::string &path, core::export_format format, uint32_t width, uint32_t height,
+						 uint32_t count, bool keep = false);
+
+	/**
+	 * @brief Stops the encoder thread. Frames not encoded yet are dropped if
+	 * finish was not called.
+	 */
+	~frame_writer();
+
+	frame_writer(const frame_writer &) = delete;
+	frame_writer &operator=(const frame_writer &) = delete;
+
+	/**
+	 * @brief Queues a RGBA frame for encoding, waiting for room in the queue
+	 *
+	 * @param frame Frame, which must not be modified until it is encoded
+	 * @throws std::runtime_error if encoding a previous frame failed
+	 */
+	void push(const core::image &frame);
+
+	/**
+	 * @brief Waits for all the queued frames to be encoded, and closes the
+	 * export
+	 *
+	 * @return Summary of the export
+	 * @throws std::runtime_error if encoding failed
+	 */
+	core::export_summary finish();
+};
+}
+}
+
+#endif /* _STC_GL_FRAME_WRITER_HPP_ */
@@ -1,9 +1,13 @@
 #ifndef _STC_GL_HOST_HPP_
 #define _STC_GL_HOST_HPP_
 
+#include <chrono>
+#include <future>
 #include <map>
 #include <memory>
+#include <set>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -14,6 +18,9 @@
 
 #include "stc/core/basic_host.hpp"
 
+#include "stc/gl/remote.hpp"
+#include "stc/gl/texture_cache.hpp"
+
 namespace stc
 {
 namespace gl
@@ -36,29 +43,103 @@ class host : public core::basic_host
 
 	void allocate() override;
 
+	/**
+	 * Detaches the rendering context from the calling thread, so it can be
+	 * used by the next thread calling into this host.
+	 */
+	void release();
+
 	core::image render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
 					   const std::array<float, 4> &mouse, GLenum format) override;
 
+	core::image render_sound(const std::string &id, uint64_t start, uint32_t count, float rate) override;
+
+	/**
+	 * Renders the frames on the calling thread, while a frame_writer encodes
+	 * the previous ones in the background.
+	 */
+	core::export_summary export_frames(const std::string &id, int first, uint32_t count, size_t width,
+									   size_t height, const std::string &path, core::export_format format) override;
+
 	void reset(const std::string &id) override;
 
 	std::string create_local(const std::vector<std::pair<std::string, std::string>> &bufferSources) override;
 
 	std::shared_ptr<core::basic_context> get_context(const std::string &id) override;
 
+	/**
+	 * Returns a context, loading it if needed. A remote context which is
+	 * still being fetched is waited for, up to the load timeout.
+	 *
+	 * @throws std::runtime_error if the context could not be loaded, or is
+	 *                            still loading once the timeout expires
+	 */
 	std::shared_ptr<context> get_gl_context(const std::string &id);
 
+	/**
+	 * Starts fetching remote contexts on background threads. They are created
+	 * on first use, once fetched.
+	 */
+	void prefetch(const std::vector<std::string> &ids) override;
+
+	/**
+	 * Renders the next frame of the context on a background thread, which
+	 * the OpenGL context is handed over to until the frame is done.
+	 */
+	void render_ahead(const std::string &id, bool enable) override;
+
+	/**
+	 * @brief Sets the maximum time to wait for a context that is being
+	 * fetched. Calls on it fail once it expires, and the fetch goes on.
+	 *
+	 * @param timeout Timeout, none to wait until the context is fetched
+	 */
+	inline void load_timeout(boost::optional<std::chrono::milliseconds> timeout)
+	{ load_timeout_ = timeout; }
+
 	private:
+	/// Frame rendered ahead of the next request
+	struct ahead_frame
+	{
+		std::shared_ptr<context> ctx;
+		int frame;
+		size_t width, height;
+		std::array<float, 4> mouse;
+		GLenum format;
+		std::future<core::image> result;
+	};
+
+	/**
+	 * Starts rendering a frame ahead on a background thread. The OpenGL
+	 * context is released by the calling thread.
+	 */
+	void start_ahead(std::shared_ptr<context> ctx, int frame, size_t width, size_t height,
+					 const std::array<float, 4> &mouse, GLenum format);
+
+	/**
+	 * Waits for the frame rendered ahead, and returns it. The OpenGL context
+	 * is then free to be made current on the calling thread.
+	 */
+	std::unique_ptr<ahead_frame> finish_ahead();
+
+	/**
+	 * Waits for the frame rendered ahead and drops it, so the next render
+	 * call on its context renders that frame again.
+	 */
+	void discard_ahead();
+
+	/**
+	 * Returns the fetch of a remote shader, starting it if needed.
+	 */
+	std::shared_future<std::shared_ptr<const remote_shader>> fetch(const std::string &id);
+
 	/**
 	 * Instantiate a new context from the given arguments.
 	 */
 	template <class... T> inline std::shared_ptr<context> new_context(T &&... args)
 	{
-		// Get default size
-		int width, height;
-		glfwGetFramebufferSize(st_window, &width, &height);
-
-		// Allocate context
-		auto ptr(std::make_shared<context>(std::forward<T>(args)..., width, height));
+		// Allocate context at the default size
+		auto ptr(std::make_shared<context>(std::forward<T>(args)..., default_width_, default_height_));
 
 		// Add to context map
 		st_contexts.insert(std::make_pair(ptr->id(), ptr));
@@ -68,10 +149,21 @@ class host : public core::basic_host
 
 	/// OpenGL window for rendering
 	GLFWwindow *st_window;
-	/// Number of allocated local contexts
-	int local_counter;
+	/// Default framebuffer size for new contexts
+	int default_width_, default_height_;
+	/// Thread which allocated the host, the only one allowed to poll events
+	std::thread::id main_thread_;
 	/// List of rendering contexts by name
 	std::map<std::string, std::shared_ptr<context>> st_contexts;
+	/// Textures shared by the rendering contexts
+	texture_cache textures_;
+	/// Remote shaders being fetched in the background, by context id
+	std::map<std::string, std::shared_future<std::shared_ptr<const remote_shader>>> loading_;
+	/// Maximum time to wait for a context being fetched
+	boost::optional<std::chrono::milliseconds> load_timeout_;
+	/// Contexts rendered ahead, and the frame being rendered ahead if any
+	std::set<std::string> render_ahead_ids_;
+	std::unique_ptr<ahead_frame> ahead_;
 
 	// Allocation state
 	bool m_remoteInit;
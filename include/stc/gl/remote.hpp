@@ -1,10 +1,13 @@
 #ifndef _STC_GL_REMOTE_HPP_
 #define _STC_GL_REMOTE_HPP_
 
+#include <memory>
 #include <string>
 
 #include <shadertoy.hpp>
 
+#include "stc/gl/texture_cache.hpp"
+
 namespace stc
 {
 namespace gl
@@ -13,8 +16,50 @@ namespace gl
 void init_remote();
 void free_remote();
 
-void load_remote(const std::string &shaderId, const std::string &shaderApiKey, shadertoy::render_context &context,
-				 shadertoy::swap_chain &chain, const shadertoy::rsize &render_size);
+/**
+ * @brief Returns the base URL of the Shadertoy API, set by the STC_API_URL
+ * environment variable so a local server can stand in for shadertoy.com
+ *
+ * @return Base URL, without a trailing slash
+ */
+std::string api_base_url();
+
+/// Shader loaded from the API, with its input files downloaded
+struct remote_shader;
+
+/**
+ * @brief Loads the spec of a shader and downloads its input files. This only
+ * uses the network and the cache, so it can run on any thread.
+ *
+ * @param shaderId     Id of the shader
+ * @param shaderApiKey API key
+ * @return             Loaded shader, for load_remote
+ * @throws std::runtime_error if the shader could not be loaded
+ */
+std::shared_ptr<const remote_shader> fetch_remote(const std::string &shaderId, const std::string &shaderApiKey);
+
+/**
+ * @brief Returns the source of the sound pass of a loaded shader, preceded by
+ * its common code
+ *
+ * @param shader Shader returned by fetch_remote
+ * @return       Sound pass source, empty if the shader has no sound pass
+ */
+std::string remote_sound_source(const remote_shader &shader);
+
+/**
+ * @brief Creates the buffers of a loaded shader in a swap chain. This must run
+ * with the OpenGL context current.
+ *
+ * @param shaderId    Id of the shader
+ * @param shader      Shader returned by fetch_remote
+ * @param textures    Cache of the textures of the host
+ * @param context     Rendering context
+ * @param chain       Swap chain to add the buffers to
+ * @param render_size Rendering size
+ */
+void load_remote(const std::string &shaderId, const remote_shader &shader, texture_cache &textures,
+				 shadertoy::render_context &context, shadertoy::swap_chain &chain, const shadertoy::rsize &render_size);
 }
 }
 
@@ -0,0 +1,114 @@
+#ifndef _STC_GL_REMOTE_CACHE_HPP_
+#define _STC_GL_REMOTE_CACHE_HPP_
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include <json/json.h>
+
+#include "stc/gl/downloader.hpp"
+
+namespace stc
+{
+namespace gl
+{
+
+/**
+ * Persistent cache of the shader specs and media files loaded from the
+ * Shadertoy API. The cache is shared by all processes using the same
+ * directory, and evicts the least recently used files once its size exceeds
+ * its capacity.
+ *
+ * Shader specs are revalidated with the API once they are older than the
+ * maximum age, using their ETag or Last-Modified date. Media files are named
+ * after their contents by the API, and never revalidated.
+ */
+class remote_cache
+{
+	const boost::filesystem::path root_;
+	const uint64_t capacity_;
+	const std::chrono::seconds max_age_;
+	const bool offline_;
+
+	/// Serializes evictions from the same process
+	std::mutex evict_mutex_;
+
+public:
+	/**
+	 * @brief Initializes a cache
+	 *
+	 * @param root     Directory of the cache, created if needed
+	 * @param capacity Maximum total size of the cached files, in bytes
+	 * @param max_age  Age after which shader specs are revalidated
+	 * @param offline  true to never access the network
+	 */
+	remote_cache(const boost::filesystem::path &root, uint64_t capacity, std::chrono::seconds max_age,
+				 bool offline);
+
+	/**
+	 * @brief Initializes a cache from the environment:
+	 *  - STC_CACHE_DIR: directory of the cache, defaults to
+	 *    $XDG_CACHE_HOME/shadertoy-connector or ~/.cache/shadertoy-connector
+	 *  - STC_CACHE_SIZE: capacity in MiB, defaults to 1024
+	 *  - STC_CACHE_TTL: maximum age of shader specs in seconds, defaults to 3600
+	 *  - STC_OFFLINE: set to 1 to only use cached files
+	 */
+	static std::unique_ptr<remote_cache> from_environment();
+
+	inline bool offline() const { return offline_; }
+
+	/**
+	 * @brief Returns the path a shader spec is cached at
+	 *
+	 * @param shader_id Id of the shader
+	 * @throws std::runtime_error if the id is not a valid file name
+	 */
+	boost::filesystem::path shader_path(const std::string &shader_id) const;
+
+	/**
+	 * @brief Returns the path a media file is cached at
+	 *
+	 * @param src Path of the media file on the API server
+	 */
+	boost::filesystem::path media_path(const std::string &src) const;
+
+	/**
+	 * @brief Loads a shader spec, from the cache if it is fresh enough or
+	 * cannot be revalidated, from the API otherwise.
+	 *
+	 * @param dl           Downloader to use
+	 * @param base_url     Base URL of the API
+	 * @param shader_id    Id of the shader
+	 * @param shader_key   API key
+	 * @param[out] fetched true if the spec was written to the cache
+	 * @return             Shader spec
+	 * @throws std::runtime_error if the spec could not be loaded
+	 */
+	Json::Value load_shader(downloader &dl, const std::string &base_url, const std::string &shader_id,
+							const std::string &shader_key, bool &fetched);
+
+	/**
+	 * @brief Marks cached files as recently used
+	 *
+	 * @param paths Paths of the files
+	 */
+	void touch(const std::vector<boost::filesystem::path> &paths);
+
+	/**
+	 * @brief Removes the least recently used files until the cache fits its
+	 * capacity
+	 *
+	 * @param keep Files in use, which are never removed
+	 */
+	void evict(const std::vector<boost::filesystem::path> &keep);
+};
+}
+}
+
+#endif /* _STC_GL_REMOTE_CACHE_HPP_ */
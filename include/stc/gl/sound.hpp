@@ -0,0 +1,65 @@
+#ifndef _STC_GL_SOUND_HPP_
+#define _STC_GL_SOUND_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include <epoxy/gl.h>
+
+#include "stc/core/image.hpp"
+
+namespace stc
+{
+namespace gl
+{
+
+/**
+ * Renders the sound pass of a Shadertoy. Like on shadertoy.com, mainSound is
+ * evaluated on the GPU for a block of samples at once, one sample per texel,
+ * and the block is read back in bulk.
+ *
+ * The renderer must only be used while the OpenGL context it was created in
+ * is current.
+ */
+class sound_renderer
+{
+	GLuint program_;
+	GLuint vertex_array_;
+	GLuint texture_;
+	GLuint framebuffer_;
+
+	GLint sample_rate_location_;
+	GLint sample_offset_location_;
+	GLint time_offset_location_;
+	GLint block_width_location_;
+
+public:
+	/// Size of the blocks of samples, in texels
+	static constexpr GLsizei block_width = 512, block_height = 512;
+
+	/**
+	 * @brief Compiles a sound pass
+	 *
+	 * @param source Source of the sound pass, defining mainSound
+	 * @throws std::runtime_error if the source could not be compiled
+	 */
+	sound_renderer(const std::string &source);
+	~sound_renderer();
+
+	sound_renderer(const sound_renderer &) = delete;
+	sound_renderer &operator=(const sound_renderer &) = delete;
+
+	/**
+	 * @brief Renders samples of the sound pass
+	 *
+	 * @param start First sample to render
+	 * @param count Number of samples to render
+	 * @param rate  Sample rate, in Hz
+	 * @return      Image of count rows holding the left and right channels
+	 */
+	core::image render(uint64_t start, uint32_t count, float rate);
+};
+}
+}
+
+#endif /* _STC_GL_SOUND_HPP_ */
@@ -0,0 +1,77 @@
+#ifndef _STC_GL_TEXTURE_CACHE_HPP_
+#define _STC_GL_TEXTURE_CACHE_HPP_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include <shadertoy.hpp>
+
+namespace stc
+{
+namespace gl
+{
+
+/**
+ * Textures loaded from files, shared by all the contexts of a host. Each file
+ * is decoded and uploaded once, with its mipmaps, and the resulting texture is
+ * never modified afterwards.
+ *
+ * Inputs returned by the cache have their own sampler, so contexts sharing a
+ * texture can still use different filtering and wrapping modes.
+ *
+ * Textures are freed once no context uses them anymore, unless they are among
+ * the most recently used textures which fit in the budget of the cache. The
+ * cache must only be used while the OpenGL context of its host is current.
+ */
+class texture_cache
+{
+	struct entry;
+	class shared_input;
+
+	/// Source URI and vertical flip of a texture
+	typedef std::pair<std::string, bool> key;
+
+	/// Maximum size of the retained textures, in bytes
+	const size_t budget_;
+
+	/// All textures in use, by key
+	std::map<key, std::weak_ptr<entry>> entries_;
+
+	/// Retained textures, from most to least recently used
+	std::list<std::shared_ptr<entry>> retained_;
+
+	/// Releases the least recently used textures beyond the budget
+	void trim();
+
+public:
+	/**
+	 * @brief Initializes an empty texture cache
+	 *
+	 * @param budget Maximum size of the textures kept while unused, in bytes
+	 */
+	texture_cache(size_t budget);
+
+	/**
+	 * @brief Returns an input for a texture file, which shares its texture
+	 * with the other inputs for the same file
+	 *
+	 * @param uri   URI of the texture file
+	 * @param vflip true if the texture should be flipped vertically
+	 * @return      Input using the shared texture, null if no loader
+	 *              supports \p uri
+	 */
+	std::shared_ptr<shadertoy::inputs::basic_input> acquire(const std::string &uri, bool vflip);
+
+	/**
+	 * @brief Releases all the retained textures. Textures still in use are
+	 * freed along with their last input.
+	 */
+	void clear();
+};
+}
+}
+
+#endif /* _STC_GL_TEXTURE_CACHE_HPP_ */
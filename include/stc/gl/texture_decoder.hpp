@@ -0,0 +1,44 @@
+#ifndef _STC_GL_TEXTURE_DECODER_HPP_
+#define _STC_GL_TEXTURE_DECODER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace stc
+{
+namespace gl
+{
+
+/// Texture file decoded in memory, as RGBA8 texels
+struct decoded_texture
+{
+	uint32_t width;
+	uint32_t height;
+	/// Rows of texels, from the first one uploaded to the last
+	std::vector<uint8_t> texels;
+};
+
+/**
+ * @brief Checks if a texture file can be decoded without an OpenGL context,
+ * depending on its format and the codecs the connector was built with
+ *
+ * @param path Path to the texture file
+ * @return     true if decode_texture supports \p path
+ */
+bool can_decode_texture(const std::string &path);
+
+/**
+ * @brief Decodes a PNG or JPEG texture file. This does not use OpenGL, so it
+ * can run on any thread.
+ *
+ * @param path  Path to the texture file
+ * @param vflip true to flip the texture vertically, like file inputs do
+ * @return      Decoded texels
+ * @throws std::runtime_error if the file could not be decoded
+ */
+decoded_texture decode_texture(const std::string &path, bool vflip);
+}
+}
+
+#endif /* _STC_GL_TEXTURE_DECODER_HPP_ */
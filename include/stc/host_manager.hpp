@@ -17,6 +17,14 @@ class host_manager
 	/// Name of the currently selected host for rendering
 	std::string current_;
 
+	/**
+	 * @brief Creates the host object for a renderer specification
+	 *
+	 * @param identifier local, a server address, or a comma-separated list of those
+	 * @return           Unallocated host object
+	 */
+	std::unique_ptr<core::basic_host> make_host(const std::string &identifier);
+
 public:
 	host_manager();
 
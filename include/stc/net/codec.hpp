@@ -0,0 +1,120 @@
+#ifndef _STC_NET_CODEC_HPP_
+#define _STC_NET_CODEC_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "stc/core/image.hpp"
+
+namespace stc
+{
+namespace net
+{
+
+/**
+ * Encodings of the pixel payload of a rendered frame. All codecs are lossless
+ * and operate on the raw bytes of the frame, so decoded frames are bit-exact.
+ */
+enum class codec : uint8_t
+{
+	/// Raw float pixels
+	none = 0,
+	/// LZ4 block compression
+	lz4 = 1,
+	/// Zstandard compression
+	zstd = 2,
+	/// XOR against the previous frame of the context, then LZ4
+	delta_lz4 = 3,
+	/// XOR against the previous frame of the context, then Zstandard
+	delta_zstd = 4
+};
+
+/**
+ * @brief Parses a codec name (none, lz4, zstd, delta-lz4 or delta-zstd)
+ *
+ * @param name Name of the codec
+ * @return     Matching codec
+ * @throws std::runtime_error if the name is unknown
+ */
+codec parse_codec(const std::string &name);
+
+/**
+ * @brief Returns the name of a codec, as accepted by parse_codec
+ *
+ * @param c Codec
+ * @return  Name of the codec
+ */
+const char *codec_name(codec c);
+
+/**
+ * @brief Checks if a codec is available in this build
+ *
+ * @param c Codec to check
+ * @return  true if frames can be encoded and decoded using this codec
+ */
+bool codec_supported(codec c);
+
+/**
+ * @brief Checks if a codec encodes frames relative to a previous frame
+ *
+ * @param c Codec to check
+ * @return  true if the codec needs a base frame
+ */
+bool codec_is_delta(codec c);
+
+/**
+ * @brief Returns the codec used to compress the frame once the delta step is
+ * done, ie. the codec itself for non-delta codecs.
+ *
+ * @param c Codec
+ * @return  Compression codec
+ */
+codec codec_without_delta(codec c);
+
+/**
+ * @brief Encodes a frame
+ *
+ * @param c     Codec to use, must be supported
+ * @param data  Frame contents
+ * @param base  Previous frame, with the same size as data. Only used by delta codecs.
+ * @param out   Encoded payload
+ */
+void encode_frame(codec c, const core::image_data &data, const core::image_data *base,
+				  std::vector<char> &out);
+
+/**
+ * @brief Decodes a frame
+ *
+ * @param c     Codec used to encode the payload
+ * @param src   Encoded payload
+ * @param size  Size of the encoded payload, in bytes
+ * @param base  Previous frame, with the same size as data. Only used by delta codecs.
+ * @param data  Frame contents, must already have the size of the decoded frame
+ * @throws std::runtime_error if the payload cannot be decoded into data
+ */
+void decode_frame(codec c, const void *src, size_t size, const core::image_data *base,
+				  core::image_data &data);
+
+/**
+ * @brief Returns a sequence number to number frames from. Its upper 32 bits
+ * are a random epoch, so the sequence numbers of different servers, workers or
+ * runs of the same server do not match, and a client never gets a delta
+ * against a frame it has from another sender.
+ *
+ * @return Sequence number before the first frame, never 0
+ */
+uint64_t first_sequence();
+
+/**
+ * @brief Returns the epoch of a sequence number, see first_sequence
+ *
+ * @param sequence Sequence number of a frame
+ * @return         Epoch of the sender of the frame
+ */
+inline uint32_t sequence_epoch(uint64_t sequence)
+{ return static_cast<uint32_t>(sequence >> 32); }
+}
+}
+
+#endif /* _STC_NET_CODEC_HPP_ */
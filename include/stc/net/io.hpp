@@ -1,6 +1,11 @@
 #ifndef _STC_NET_IO_HPP_
 #define _STC_NET_IO_HPP_
 
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
 #include <zmq.hpp>
 
 #include <shadertoy/spdlog/spdlog.h>
@@ -44,12 +49,49 @@ public:
 		socket_.send(t.data(), bytes, flags);
 	}
 
+	/**
+	 * @brief Sends a shared buffer without copying it. The message holds a
+	 * reference on the buffer until ZMQ is done sending it, so the buffer must
+	 * not be modified in the meantime.
+	 *
+	 * @param t     Buffer to send
+	 * @param flags Send flags
+	 */
+	template <typename T, typename Alloc>
+	void send_shared_buf(const std::shared_ptr<std::vector<T, Alloc>> &t, int flags = 0)
+	{
+		size_t bytes = sizeof(T) * t->size();
+		log_->debug("send({}): <zero-copy, output suppressed>", bytes);
+
+		auto ref(new std::shared_ptr<std::vector<T, Alloc>>(t));
+		zmq::message_t msg(const_cast<T *>(t->data()), bytes, [](void *, void *hint) {
+			delete static_cast<std::shared_ptr<std::vector<T, Alloc>> *>(hint);
+		}, ref);
+
+		socket_.send(msg, flags);
+	}
+
 	void send_empty(int flags = 0);
 
+	/**
+	 * @brief Sends a prepared message
+	 *
+	 * @param msg   Message to send, emptied by sending it
+	 * @param flags Send flags
+	 */
+	void send_message(zmq::message_t &msg, int flags = 0);
+
 	void send_string(const std::string &str, int flags = 0);
 
 	bool recv_wait(int timeout = -1);
 
+	/**
+	 * @brief Checks if the message being received has more frames
+	 *
+	 * @return true if at least one frame of the current message is left to read
+	 */
+	bool recv_more();
+
 	template <typename T>
 	void recv_data(T &response, int flags = 0)
 	{
@@ -80,8 +122,8 @@ public:
 		return result;
 	}
 
-	template <typename T>
-	void recv_buf(std::vector<T> &t, int flags = 0)
+	template <typename T, typename Alloc>
+	void recv_buf(std::vector<T, Alloc> &t, int flags = 0)
 	{
 		size_t bytes = t.size() * sizeof(T);
 		size_t rcv = socket_.recv(t.data(), bytes, flags);
@@ -94,11 +136,96 @@ public:
 	std::string recv_string(int flags = 0);
 };
 
+/**
+ * Reads the frames of a multipart message which has already been received,
+ * with the same interface as io.
+ */
+class message_reader
+{
+	std::shared_ptr<spdlog::logger> &log_;
+	std::vector<zmq::message_t> parts_;
+	size_t next_;
+
+	zmq::message_t &next_part();
+
+public:
+	message_reader(std::shared_ptr<spdlog::logger> &log, std::vector<zmq::message_t> &&parts);
+
+	/**
+	 * @brief Checks if there are frames left to read
+	 *
+	 * @return true if at least one frame can be read
+	 */
+	inline bool more() const
+	{ return next_ < parts_.size(); }
+
+	template <typename T>
+	void recv_data(T &response)
+	{
+		auto &part(next_part());
+		if (part.size() != sizeof(T))
+			throw std::runtime_error("Unexpected frame size in reply");
+		memcpy(&response, part.data(), sizeof(T));
+		log_->debug("recv({}): {}", sizeof(T), response);
+	}
+
+	template <typename T>
+	void recv_data_noout(T &response)
+	{
+		auto &part(next_part());
+		if (part.size() != sizeof(T))
+			throw std::runtime_error("Unexpected frame size in reply");
+		memcpy(&response, part.data(), sizeof(T));
+		log_->debug("recv({}): <output suppressed>", sizeof(T));
+	}
+
+	template <typename T>
+	T recv_data()
+	{
+		T result;
+		recv_data(result);
+		return result;
+	}
+
+	template <typename T>
+	T recv_data_noout()
+	{
+		T result;
+		recv_data_noout(result);
+		return result;
+	}
+
+	template <typename T, typename Alloc>
+	void recv_buf(std::vector<T, Alloc> &t)
+	{
+		auto &part(next_part());
+		size_t bytes = t.size() * sizeof(T);
+		if (part.size() != bytes)
+			throw std::runtime_error("Unexpected buffer size in reply");
+		memcpy(t.data(), part.data(), bytes);
+		log_->debug("recv({}): <output suppressed>", bytes);
+	}
+
+	/**
+	 * @brief Reads the next frame without copying it
+	 *
+	 * @return Reference to the frame, valid as long as the reader
+	 */
+	const zmq::message_t &recv_message();
+
+	void recv_empty();
+
+	std::string recv_string();
+};
+
 template <>
 void io::send_data_noout<core::image>(const core::image &img, int flags);
 
 template <>
 void io::recv_data_noout<core::image>(core::image &img, int flags);
+
+template <>
+void message_reader::recv_data_noout<core::image>(core::image &img);
 }
 }
 
@@ -0,0 +1,85 @@
+#ifndef _STC_NET_MULTIPART_HPP_
+#define _STC_NET_MULTIPART_HPP_
+
+#include <string>
+#include <vector>
+
+#include <zmq.hpp>
+
+namespace stc
+{
+namespace net
+{
+
+/**
+ * Routing information of a request, as read from its frames by the
+ * components which forward requests (server front end, broker).
+ */
+struct route_key
+{
+	/// Index of the empty frame ending the routing envelope
+	size_t delimiter;
+	/// Name of the request
+	std::string request;
+	/// Context the request applies to, empty if there is none
+	std::string id;
+};
+
+/**
+ * @brief Receives all the frames of a message
+ *
+ * @param socket Socket to receive from
+ * @param parts  Vector the frames are appended to
+ * @return       false if no message could be received
+ */
+bool recv_multipart(zmq::socket_t &socket, std::vector<zmq::message_t> &parts);
+
+/**
+ * @brief Sends frames as a single message
+ *
+ * @param socket Socket to send to
+ * @param parts  Frames to send, emptied by sending them
+ * @param first  Index of the first frame to send
+ */
+void send_multipart(zmq::socket_t &socket, std::vector<zmq::message_t> &parts, size_t first = 0);
+
+/**
+ * @brief Returns the contents of a frame as a string
+ */
+std::string part_string(const zmq::message_t &part);
+
+/**
+ * @brief Finds the empty delimiter ending the routing envelope of a message
+ *
+ * @param parts Frames of the message
+ * @param first Index of the first frame to consider
+ * @return      Index of the delimiter, or parts.size() if there is none
+ */
+size_t find_delimiter(const std::vector<zmq::message_t> &parts, size_t first = 0);
+
+/**
+ * @brief Reads the routing information of a request. String protocol
+ * requests start with their name, and requests on a context follow it with
+ * the context id. Binary protocol requests hold both in their header frame.
+ *
+ * @param parts Frames of the request, routing envelope included
+ * @param key   Routing information
+ * @param first Index of the first frame of the routing envelope
+ * @return      false if the request is malformed
+ */
+bool parse_route_key(const std::vector<zmq::message_t> &parts, route_key &key, size_t first = 0);
+
+/**
+ * @brief Reads the status of a reply, and the value it starts with, such as
+ * the id of the context created by a create_local request.
+ *
+ * @param parts Frames of the reply, routing envelope included
+ * @param value First value of the reply, empty if there is none
+ * @param first Index of the first frame of the routing envelope
+ * @return      true if the reply reports a success
+ */
+bool parse_reply_status(const std::vector<zmq::message_t> &parts, std::string &value, size_t first = 0);
+}
+}
+
+#endif /* _STC_NET_MULTIPART_HPP_ */
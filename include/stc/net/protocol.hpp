@@ -0,0 +1,205 @@
+#ifndef _STC_NET_PROTOCOL_HPP_
+#define _STC_NET_PROTOCOL_HPP_
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <zmq.hpp>
+
+namespace stc
+{
+namespace net
+{
+
+/// Magic number starting the header of binary protocol frames ("STCB")
+const uint32_t binary_magic = 0x42435453;
+
+/**
+ * Version of the binary protocol implemented by this library. Peers agree on
+ * the highest version both implement, and requests use the encoding of that
+ * version:
+ *
+ * 1. Initial version
+ * 2. Sources and input images referenced by digest: create_local sends a
+ *    by_digest byte before each source, set_input accepts input type 2, and
+ *    frames may carry flag_missing or flag_blobs
+ * 3. prefetch opcode
+ * 4. render_sound opcode
+ * 5. export_frames opcode
+ * 6. batch replies end with a uint8 failed flag, followed if set by the
+ *    uint32 index and the message of the operation which failed. The frames
+ *    rendered before it are still sent.
+ */
+const uint8_t binary_version = 6;
+
+/// Oldest version of the binary protocol still understood
+const uint8_t binary_min_version = 1;
+
+/**
+ * Operations of the binary protocol. Each one matches the request of the
+ * string protocol with the same name.
+ */
+enum class opcode : uint8_t
+{
+	ping = 0,
+	render = 1,
+	reset = 2,
+	create_local = 3,
+	get_context = 4,
+	set_input = 5,
+	set_input_filter = 6,
+	reset_input = 7,
+	/// List of operations on a context, only available in the binary protocol
+	batch = 8,
+	prefetch = 9,
+	render_sound = 10,
+	/// Matches the "export" request of the string protocol
+	export_frames = 11
+};
+
+/// Flags of binary protocol frames
+enum frame_flags : uint16_t
+{
+	/// The reply is an error, its arguments hold the error message
+	flag_error = 1,
+	/// The reply lists the digests of the blobs the server does not have, as
+	/// a uint32 count followed by the digests. The request should be sent
+	/// again with these blobs attached.
+	flag_missing = 2,
+	/// The request has blobs attached: the frame after the header holds
+	/// their uint32 count, and they come next, before the other payloads
+	flag_blobs = 4
+};
+
+#pragma pack(push, 1)
+/**
+ * Header of a binary protocol message. It is followed, in the same frame, by
+ * the context id and the packed arguments. Bulk payloads such as images
+ * travel in the next frames.
+ */
+struct frame_header
+{
+	uint32_t magic;
+	uint8_t version;
+	uint8_t opcode;
+	uint16_t flags;
+	uint64_t request_id;
+	/// Size of the context id following the header
+	uint32_t id_size;
+	/// Size of the arguments following the context id
+	uint32_t args_size;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(frame_header) == 24, "frame_header must be packed");
+
+/**
+ * @brief Returns the string protocol name of an opcode
+ *
+ * @param op Opcode
+ * @return   Request name, "unknown" for invalid opcodes
+ */
+const char *opcode_name(opcode op);
+
+/**
+ * @brief Returns the binary protocol version which introduced an opcode
+ *
+ * @param op Opcode
+ * @return   Version from which peers understand the opcode
+ */
+uint8_t opcode_version(opcode op);
+
+/**
+ * @brief Checks if a frame starts a binary protocol message
+ *
+ * @param part First frame of the request, after the routing envelope
+ * @return     true if the frame starts with a binary protocol header
+ */
+bool is_binary_frame(const zmq::message_t &part);
+
+/**
+ * Packs the arguments of a binary protocol message
+ */
+class binary_writer
+{
+	std::vector<char> buf_;
+
+public:
+	template <typename T>
+	void write(const T &value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "binary_writer only packs trivial types");
+
+		auto offset(buf_.size());
+		buf_.resize(offset + sizeof(T));
+		memcpy(buf_.data() + offset, &value, sizeof(T));
+	}
+
+	void write_string(const std::string &str);
+
+	inline const std::vector<char> &data() const
+	{ return buf_; }
+};
+
+/**
+ * Unpacks the arguments of a binary protocol message. The reader does not
+ * own the memory it reads from.
+ */
+class binary_reader
+{
+	const char *ptr_;
+	const char *end_;
+
+	void check(size_t size) const;
+
+public:
+	binary_reader(const void *data, size_t size);
+
+	template <typename T>
+	T read()
+	{
+		static_assert(std::is_trivially_copyable<T>::value, "binary_reader only unpacks trivial types");
+
+		check(sizeof(T));
+
+		T value;
+		memcpy(&value, ptr_, sizeof(T));
+		ptr_ += sizeof(T);
+		return value;
+	}
+
+	std::string read_string();
+};
+
+/**
+ * @brief Builds the first frame of a binary protocol message
+ *
+ * @param op         Operation
+ * @param flags      Frame flags
+ * @param request_id Identifier of the request, echoed in the reply
+ * @param id         Context id, or the created context id in create_local replies
+ * @param args       Packed arguments
+ * @param version    Protocol version agreed with the peer
+ * @return           Frame holding the header, the context id and the arguments
+ */
+zmq::message_t make_binary_frame(opcode op, uint16_t flags, uint64_t request_id, const std::string &id,
+								 const binary_writer &args, uint8_t version = binary_version);
+
+/**
+ * @brief Decodes the first frame of a binary protocol message
+ *
+ * @param part   Frame to decode, which must outlive the returned reader
+ * @param header Decoded header
+ * @param id     Decoded context id
+ * @return       Reader for the arguments
+ * @throws std::runtime_error if the frame is malformed or has an unsupported version
+ */
+binary_reader parse_binary_frame(const zmq::message_t &part, frame_header &header, std::string &id);
+}
+}
+
+#endif /* _STC_NET_PROTOCOL_HPP_ */
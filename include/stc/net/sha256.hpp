@@ -0,0 +1,67 @@
+#ifndef _STC_NET_SHA256_HPP_
+#define _STC_NET_SHA256_HPP_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace stc
+{
+namespace net
+{
+
+/**
+ * Incremental SHA-256 hash, used to address blobs by their contents
+ */
+class sha256
+{
+	std::array<uint32_t, 8> state_;
+	std::array<uint8_t, 64> block_;
+	size_t block_size_;
+	uint64_t total_size_;
+
+	void transform(const uint8_t *block);
+
+public:
+	/// Size of a digest, in bytes
+	static constexpr size_t digest_size = 32;
+
+	sha256();
+
+	/**
+	 * @brief Hashes more data
+	 *
+	 * @param data Data to hash
+	 * @param size Size of data, in bytes
+	 */
+	void update(const void *data, size_t size);
+
+	/**
+	 * @brief Completes the hash. The object must not be updated afterwards.
+	 *
+	 * @return Raw digest of digest_size bytes
+	 */
+	std::string digest();
+
+	/**
+	 * @brief Hashes a buffer
+	 *
+	 * @param data Data to hash
+	 * @param size Size of data, in bytes
+	 * @return     Raw digest of digest_size bytes
+	 */
+	static std::string hash(const void *data, size_t size);
+
+	/**
+	 * @brief Formats a raw digest for logging
+	 *
+	 * @param digest Raw digest
+	 * @return       Lowercase hexadecimal representation of the digest
+	 */
+	static std::string hex(const std::string &digest);
+};
+}
+}
+
+#endif /* _STC_NET_SHA256_HPP_ */
@@ -0,0 +1,116 @@
+#ifndef _STC_NET_SHM_RING_HPP_
+#define _STC_NET_SHM_RING_HPP_
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+namespace stc
+{
+namespace net
+{
+
+/**
+ * Location of a payload written to a shm_ring
+ */
+struct shm_slot
+{
+	/// Logical position of the payload, ie. the number of bytes written to the
+	/// ring before it, padding included
+	uint64_t position;
+	/// Size of the payload in bytes
+	uint64_t size;
+};
+
+struct shm_ring_header;
+
+/**
+ * Ring buffer in POSIX shared memory, used to transfer frames between a
+ * client and a server on the same host without copying them through sockets.
+ *
+ * The client creates the ring and the server writes payloads into it. Readers
+ * do not take part in the synchronization: a payload is only valid until the
+ * writer wraps around and overwrites it, which readers detect by checking the
+ * write position after reading, as with a seqlock.
+ */
+class shm_ring
+{
+	std::string name_;
+	void *map_;
+	size_t map_size_;
+
+	shm_ring_header *header_;
+	char *data_;
+
+	/// Guards reservations by the threads of this process
+	std::mutex write_mutex_;
+
+public:
+	/**
+	 * @brief Creates a new shared memory ring with a unique name
+	 *
+	 * @param capacity Size of the data area of the ring, in bytes
+	 * @throws std::runtime_error if the shared memory cannot be created
+	 */
+	shm_ring(size_t capacity);
+
+	/**
+	 * @brief Maps an existing shared memory ring
+	 *
+	 * @param name Name of the ring, as returned by name()
+	 * @throws std::runtime_error if the ring cannot be mapped
+	 */
+	shm_ring(const std::string &name);
+
+	~shm_ring();
+
+	shm_ring(const shm_ring &) = delete;
+	shm_ring &operator=(const shm_ring &) = delete;
+
+	inline const std::string &name() const
+	{ return name_; }
+
+	/**
+	 * @brief Size of the data area of the ring
+	 */
+	uint64_t capacity() const;
+
+	/**
+	 * @brief Removes the name of the ring, so it is released once all the
+	 * processes which mapped it unmap it.
+	 */
+	void unlink();
+
+	/**
+	 * @brief Writes a payload to the ring. Payloads are never split, so the
+	 * end of the data area may be skipped.
+	 *
+	 * @param src  Payload to write
+	 * @param size Size of the payload in bytes
+	 * @param slot Location of the written payload
+	 * @return     false if the payload is larger than the ring
+	 */
+	bool write(const void *src, size_t size, shm_slot &slot);
+
+	/**
+	 * @brief Returns a pointer to a payload in the ring. The payload must be
+	 * checked with valid() after it has been read.
+	 *
+	 * @param slot Location of the payload
+	 * @return     Pointer to the payload
+	 * @throws std::runtime_error if the slot is out of the bounds of the ring
+	 */
+	const void *data(const shm_slot &slot) const;
+
+	/**
+	 * @brief Checks that a payload has not been overwritten since it was written
+	 *
+	 * @param slot Location of the payload
+	 * @return     true if the data read from the slot so far is intact
+	 */
+	bool valid(const shm_slot &slot) const;
+};
+}
+}
+
+#endif /* _STC_NET_SHM_RING_HPP_ */
@@ -0,0 +1,70 @@
+#ifndef _STC_SERVER_BLOB_STORE_HPP_
+#define _STC_SERVER_BLOB_STORE_HPP_
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace stc
+{
+namespace server
+{
+
+/// Contents of a blob, shared with the requests using it
+typedef std::shared_ptr<const std::vector<char>> blob;
+
+/**
+ * Blobs uploaded by clients, by SHA-256 digest of their contents. The store
+ * is shared by all workers and clients, and evicts the least recently used
+ * blobs once its size exceeds its capacity.
+ */
+class blob_store
+{
+	/// Maximum total size of the blobs, in bytes
+	const size_t capacity_;
+	size_t size_;
+
+	/// Digests, from most to least recently used
+	std::list<std::string> usage_;
+
+	struct entry
+	{
+		blob data;
+		std::list<std::string>::iterator usage;
+	};
+
+	std::map<std::string, entry> blobs_;
+	std::mutex mutex_;
+
+public:
+	/**
+	 * @brief Initializes an empty blob store
+	 *
+	 * @param capacity Maximum total size of the blobs, in bytes
+	 */
+	blob_store(size_t capacity);
+
+	/**
+	 * @brief Adds a blob to the store. Blobs larger than the capacity of the
+	 * store are not kept.
+	 *
+	 * @param digest SHA-256 digest of the blob, which must match its contents
+	 * @param data   Contents of the blob
+	 */
+	void put(const std::string &digest, blob data);
+
+	/**
+	 * @brief Finds a blob, marking it as recently used
+	 *
+	 * @param digest SHA-256 digest of the blob
+	 * @return       Contents of the blob, null if it is not in the store
+	 */
+	blob find(const std::string &digest);
+};
+}
+}
+
+#endif /* _STC_SERVER_BLOB_STORE_HPP_ */
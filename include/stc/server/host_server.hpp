@@ -1,6 +1,7 @@
 #ifndef _STC_SERVER_HOST_SERVER_HPP_
 #define _STC_SERVER_HOST_SERVER_HPP_
 
+#include <chrono>
 #include <memory>
 #include <string>
 
@@ -9,6 +10,29 @@ namespace stc
 namespace server
 {
 
+/**
+ * Options of a server
+ */
+struct host_server_options
+{
+	/// Endpoints to bind the front end socket to, separated by commas
+	std::string bind_address;
+	/// Endpoint to publish the frames of subscriptions on
+	std::string publish_address;
+	/// Number of worker threads, each owning a GL context
+	size_t workers;
+	/// Maximum total size of the blobs uploaded by clients, in bytes
+	size_t blob_cache_size;
+	/// Maximum time a request waits for its context to be fetched, zero to
+	/// wait until it is fetched
+	std::chrono::milliseconds load_timeout;
+	/// Directory clients can export frames to, empty to refuse exports
+	std::string export_dir;
+	/// Time after which a stream which was not renewed by its client is
+	/// stopped, zero for streams to run until they are unsubscribed
+	std::chrono::milliseconds stream_lease;
+};
+
 class host_server_impl;
 
 class host_server
@@ -16,7 +40,12 @@ class host_server
 	host_server_impl * const impl_;
 
 public:
-	host_server(const std::string &bind_address);
+	/**
+	 * @brief Creates a server which dispatches requests to a pool of workers
+	 *
+	 * @param options Server options
+	 */
+	host_server(const host_server_options &options);
 	~host_server();
 
 	void run();
@@ -31,6 +31,40 @@ bool impl_st_parse_input(std::string &inputSpecName, std::string &buffer, int &c
 
 	return true;
 }
+
+GLint impl_st_parse_filter(const std::string &filterName, const std::string &inputSpecName)
+{
+	std::string filterMethod(filterName);
+	std::transform(filterMethod.begin(), filterMethod.end(),
+		filterMethod.begin(), ::tolower);
+
+	if (filterMethod.compare("linear") == 0)
+		return GL_LINEAR;
+	else if (filterMethod.compare("nearest") == 0)
+		return GL_NEAREST;
+	else if (filterMethod.compare("mipmap") == 0)
+		return GL_LINEAR_MIPMAP_LINEAR;
+
+	std::stringstream ss;
+	ss << "Invalid filter type '" << filterMethod << "' for " << inputSpecName;
+	throw std::runtime_error(ss.str());
+}
+
+GLenum impl_st_parse_format(const std::string &formatName)
+{
+	std::string format(formatName);
+	std::transform(format.begin(), format.end(),
+		format.begin(), ::tolower);
+
+	if (format.compare("rgba") == 0)
+		return GL_RGBA;
+	else if (format.compare("rgb") == 0)
+		return GL_RGB;
+	else if (format.compare("luminance") == 0)
+		return GL_LUMINANCE;
+
+	throw std::runtime_error("Invalid Format parameter");
+}
 }
 
 #if OMW_OCTAVE
@@ -43,11 +77,16 @@ DEFUN_DLD(shadertoy_octave, args, , "shadertoy_octave() initializes the shaderto
 
 	wrapper.set_autoload("st_set_renderer");
 	wrapper.set_autoload("st_render");
+	wrapper.set_autoload("st_render_sound");
+	wrapper.set_autoload("st_export");
 	wrapper.set_autoload("st_reset");
 	wrapper.set_autoload("st_compile");
 	wrapper.set_autoload("st_set_input");
 	wrapper.set_autoload("st_set_input_filter");
 	wrapper.set_autoload("st_reset_input");
+	wrapper.set_autoload("st_batch");
+	wrapper.set_autoload("st_prefetch");
+	wrapper.set_autoload("st_set_render_ahead");
 
 	return octave_value();
 }
@@ -90,6 +129,10 @@ OM_DEFUN(st_set_renderer, "st_set_renderer('local'|'tcp://hostname') sets the cu
 
 OM_DEFUN(st_render, "st_render('id', [frame, [width, [height, [format, [mouse, [timing]]]]]]) renders a Shadertoy as an image")
 
+OM_DEFUN(st_render_sound, "st_render_sound('id', [start, [nsamples, [rate]]]) renders the sound pass of a Shadertoy as a Nx2 matrix")
+
+OM_DEFUN(st_export, "st_export('id', frames, size, 'path'[, 'format']) renders frames to a Y4M video, raw RGBA frames, PNG files or a .npy array")
+
 OM_DEFUN(st_reset, "st_reset('id') resets a context")
 
 OM_DEFUN(st_compile, "st_compile('source', 'a', 'sourceA') compiles the source of a program and "
@@ -100,3 +143,10 @@ OM_DEFUN(st_set_input, "st_set_input('id', 'image.0', matrix1[, 'image.1', matri
 OM_DEFUN(st_set_input_filter, "st_set_input('id', 'image.0', 'linear'[, 'image.1', 'nearest'[, ...]]])")
 
 OM_DEFUN(st_reset_input, "st_reset_input('id', 'image.0'[, 'image.1'[, ...]]])")
+
+OM_DEFUN(st_prefetch, "st_prefetch('id1'[, 'id2'[, ...]]) starts loading contexts in the background")
+
+OM_DEFUN(st_set_render_ahead, "st_set_render_ahead('id'[, enable]) renders the next frame of a context in the background")
+
+OM_DEFUN(st_batch, "st_batch('id', 'image.0', matrix, 'filter:image.0', 'linear', 'render', [frame width height][, ...]) "
+				   "runs several operations at once and returns a cell array of the rendered images")
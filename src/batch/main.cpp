@@ -0,0 +1,609 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include <json/json.h>
+
+#include "stc/core/export.hpp"
+#include "stc/core/image.hpp"
+#include "stc/core/mapped_frames.hpp"
+#include "stc/gl/context.hpp"
+#include "stc/gl/frame_writer.hpp"
+#include "stc/gl/host.hpp"
+#include "stc/gl/texture_decoder.hpp"
+
+namespace fs = boost::filesystem;
+namespace po = boost::program_options;
+
+using namespace stc;
+
+namespace
+{
+
+/// Input override of a job, applied once its context is created
+struct job_input
+{
+	std::string buffer;
+	size_t channel;
+	/// Name of the buffer to read from, if this is not an image input
+	std::string source;
+	std::shared_ptr<core::image> image;
+};
+
+/// Range of frames of a shader rendered to a single export
+struct batch_job
+{
+	std::string name;
+	/// Remote shadertoy.com id, if this is not a local shader
+	std::string remote_id;
+	/// Buffer sources for local shaders, image last
+	std::vector<std::pair<std::string, std::string>> sources;
+
+	/// true if frames do not depend on the previous ones, so they can be
+	/// rendered in any order. Buffers may read their previous output, and
+	/// the passes of remote shaders are not known in advance.
+	bool stateless;
+
+	uint32_t width;
+	uint32_t height;
+	int first;
+	uint32_t count;
+
+	std::string output;
+	core::export_format format;
+
+	/// Mouse position of each frame, the last one is held
+	std::vector<std::array<float, 4>> mouse;
+	std::vector<job_input> inputs;
+
+	/// Output of NumPy exports, shared by the workers rendering this job
+	std::shared_ptr<core::mapped_frames> mapped;
+};
+
+/// Frames of a job rendered by a worker at once
+struct batch_chunk
+{
+	size_t job;
+	/// Index of the first frame of the chunk in the export
+	uint32_t first;
+	uint32_t count;
+};
+
+std::array<float, 4> parse_mouse(const Json::Value &spec)
+{
+	std::array<float, 4> mouse{ 0.f, 0.f, 0.f, 0.f };
+	for (Json::ArrayIndex i = 0; i < spec.size() && i < 4; ++i)
+		mouse[i] = spec[i].asFloat();
+	return mouse;
+}
+
+/// Decodes an image file to a texture input
+std::shared_ptr<core::image> load_input_image(const std::string &path)
+{
+	auto texture(gl::decode_texture(path, true));
+
+	auto img(std::make_shared<core::image>());
+	img->dims = { texture.height, texture.width, 4 };
+	img->alloc();
+
+	std::transform(texture.texels.begin(), texture.texels.end(), img->data->begin(),
+				   [](uint8_t texel) { return texel / 255.f; });
+
+	return img;
+}
+
+std::vector<batch_job> load_manifest(const std::string &path, const std::string &output_dir)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		std::stringstream ss;
+		ss << "Could not open manifest file " << path;
+		throw std::runtime_error(ss.str());
+	}
+
+	Json::Value spec;
+	ifs >> spec;
+
+	// Input files are relative to the manifest
+	auto manifest_dir(fs::path(path).parent_path());
+
+	std::vector<batch_job> jobs;
+	std::set<std::string> names;
+
+	for (const auto &job_spec : spec["jobs"])
+	{
+		batch_job job;
+		job.name = job_spec["name"].asString();
+
+		if (job.name.empty() || job.name.find_first_of("\t\n") != std::string::npos ||
+			!names.insert(job.name).second)
+		{
+			std::stringstream ss;
+			ss << "Jobs must have unique single line names, got '" << job.name << "'";
+			throw std::runtime_error(ss.str());
+		}
+
+		if (job_spec.isMember("id"))
+		{
+			job.remote_id = job_spec["id"].asString();
+		}
+		else
+		{
+			for (const auto &buffer : job_spec["buffers"].getMemberNames())
+				job.sources.emplace_back(buffer, job_spec["buffers"][buffer].asString());
+			job.sources.emplace_back("image", job_spec["image"].asString());
+		}
+
+		const auto &size(job_spec["size"]);
+		job.width = size.isArray() ? size[0].asUInt() : size.asUInt();
+		job.height = size.isArray() ? size[1].asUInt() : size.asUInt();
+
+		// N renders frames 0 to N-1, [first last] renders an inclusive range
+		const auto &frames(job_spec["frames"]);
+		job.first = frames.isArray() ? frames[0].asInt() : 0;
+		int last = frames.isArray() ? frames[1].asInt() : frames.asInt() - 1;
+
+		if (job.width == 0 || job.height == 0 || last < job.first)
+		{
+			std::stringstream ss;
+			ss << "Invalid size or frame range for job " << job.name;
+			throw std::runtime_error(ss.str());
+		}
+
+		job.count = last - job.first + 1;
+
+		job.output = (fs::path(output_dir) / job_spec["output"].asString()).string();
+		job.format = core::parse_export_format(job_spec.get("format", "").asString(), job.output);
+
+		// Single position, or one per frame
+		const auto &mouse(job_spec["mouse"]);
+		if (mouse.isArray() && mouse.size() > 0 && mouse[0].isArray())
+		{
+			for (const auto &position : mouse)
+				job.mouse.push_back(parse_mouse(position));
+		}
+		else
+		{
+			job.mouse.push_back(parse_mouse(mouse));
+		}
+
+		// "image.0": "a" reads buffer a, "image.0": { "file": "tex.png" } an image
+		const auto &inputs(job_spec["inputs"]);
+		for (const auto &name : inputs.getMemberNames())
+		{
+			auto dot_pos(name.find('.'));
+			if (dot_pos == std::string::npos)
+			{
+				std::stringstream ss;
+				ss << "Invalid input specification " << name << " for job " << job.name;
+				throw std::runtime_error(ss.str());
+			}
+
+			job_input input;
+			input.buffer = name.substr(0, dot_pos);
+			input.channel = std::atoi(name.c_str() + dot_pos + 1);
+
+			if (inputs[name].isObject())
+				input.image = load_input_image((manifest_dir / inputs[name]["file"].asString()).string());
+			else
+				input.source = inputs[name].asString();
+
+			job.inputs.push_back(std::move(input));
+		}
+
+		job.stateless = job.remote_id.empty() && job.sources.size() == 1 &&
+						std::all_of(job.inputs.begin(), job.inputs.end(),
+									[](const job_input &input) { return static_cast<bool>(input.image); });
+
+		jobs.push_back(std::move(job));
+	}
+
+	if (jobs.empty())
+		throw std::runtime_error("The manifest does not define any job");
+
+	return jobs;
+}
+
+/**
+ * Log of the chunks which were written, appended as they complete, so an
+ * interrupted run can be resumed.
+ */
+class progress_log
+{
+	std::ofstream log_;
+	std::mutex mutex_;
+
+public:
+	/**
+	 * @brief Opens the log, and reads the chunks it already holds
+	 *
+	 * @param path    Path of the log
+	 * @param restart true to discard the previous progress
+	 * @param done    Completed chunks, as (job name, first frame, frame count)
+	 */
+	progress_log(const std::string &path, bool restart, std::set<std::tuple<std::string, uint32_t, uint32_t>> &done)
+		: log_(),
+		mutex_()
+	{
+		if (!restart)
+		{
+			std::ifstream ifs(path);
+			std::string name;
+			uint32_t first, count;
+
+			// Job names cannot hold the separators, see load_manifest
+			while (std::getline(ifs, name, '\t') && ifs >> first >> count && ifs.ignore())
+				done.emplace(name, first, count);
+		}
+
+		log_.open(path, restart ? std::ios::trunc : std::ios::app);
+		if (!log_)
+		{
+			std::stringstream ss;
+			ss << "Could not open progress file " << path;
+			throw std::runtime_error(ss.str());
+		}
+	}
+
+	void write(const std::string &name, uint32_t first, uint32_t count)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		log_ << name << '\t' << first << ' ' << count << '\n' << std::flush;
+	}
+};
+
+/**
+ * Worker thread owning a GL context, which renders chunks until the queue is
+ * empty.
+ */
+class batch_worker
+{
+	std::vector<batch_job> &jobs_;
+	gl::host host_;
+
+	/// Context of each job, created on first use
+	std::map<size_t, std::string> contexts_;
+
+	/// Index of the next frame of each stateful job, the frames before it
+	/// were rendered by this worker
+	std::map<size_t, uint32_t> positions_;
+
+	std::string context_id(size_t index)
+	{
+		auto it = contexts_.find(index);
+		if (it != contexts_.end())
+			return it->second;
+
+		const auto &job(jobs_[index]);
+		auto id(job.remote_id.empty() ? host_.create_local(job.sources) : job.remote_id);
+		auto context(host_.get_context(id));
+
+		for (const auto &input : job.inputs)
+		{
+			if (input.image)
+				context->set_input(input.buffer, input.channel, input.image);
+			else
+				context->set_input(input.buffer, input.channel, input.source);
+		}
+
+		contexts_.emplace(index, id);
+		return id;
+	}
+
+	void render(const batch_chunk &chunk)
+	{
+		const auto &job(jobs_[chunk.job]);
+		auto context(host_.get_gl_context(context_id(chunk.job)));
+
+		auto mouse = [&job](uint32_t index) { return job.mouse[std::min<size_t>(index, job.mouse.size() - 1)]; };
+
+		if (!job.stateless)
+		{
+			// Bring the buffers to the state of the first frame of the chunk,
+			// for example when resuming after chunks which are already done
+			auto &position(positions_[chunk.job]);
+			for (; position < chunk.first; ++position)
+				context->perform_render(job.first + static_cast<int>(position), job.width, job.height,
+										mouse(position), GL_RGBA);
+
+			position = chunk.first + chunk.count;
+		}
+
+		if (job.mapped)
+		{
+			for (uint32_t i = chunk.first; i < chunk.first + chunk.count; ++i)
+			{
+				context->perform_render(job.first + static_cast<int>(i), job.width, job.height, mouse(i), GL_RGBA,
+										job.mapped->frame(i));
+				job.mapped->done(i);
+			}
+
+			return;
+		}
+
+		gl::frame_writer writer(job.output, job.format, job.width, job.height, chunk.first);
+
+		for (uint32_t i = chunk.first; i < chunk.first + chunk.count; ++i)
+		{
+			context->perform_render(job.first + static_cast<int>(i), job.width, job.height, mouse(i), GL_RGBA);
+			writer.push(context->current_image());
+		}
+
+		writer.finish();
+	}
+
+public:
+	batch_worker(std::vector<batch_job> &jobs)
+		: jobs_(jobs),
+		host_(),
+		contexts_(),
+		positions_()
+	{
+	}
+
+	/**
+	 * Allocates the rendering context. GLFW requires this to happen on the
+	 * main thread, the context is then released for the worker thread.
+	 */
+	void allocate()
+	{
+		host_.allocate();
+		host_.release();
+	}
+
+	/**
+	 * Renders tasks until the queue is empty. The chunks of a task are
+	 * rendered in order.
+	 */
+	void run(const std::vector<std::vector<batch_chunk>> &tasks, std::atomic<size_t> &next,
+			 std::vector<char> &failed, std::mutex &failed_mutex, progress_log &progress,
+			 std::atomic<uint64_t> &rendered)
+	{
+		for (size_t index; (index = next++) < tasks.size();)
+		{
+			for (const auto &chunk : tasks[index])
+			{
+				const auto &job(jobs_[chunk.job]);
+
+				{
+					std::lock_guard<std::mutex> guard(failed_mutex);
+					if (failed[chunk.job])
+						break;
+				}
+
+				try
+				{
+					render(chunk);
+				}
+				catch (std::exception &ex)
+				{
+					std::lock_guard<std::mutex> guard(failed_mutex);
+					std::cerr << job.name << ": " << ex.what() << std::endl;
+					failed[chunk.job] = 1;
+					break;
+				}
+
+				progress.write(job.name, chunk.first, chunk.count);
+				rendered += chunk.count;
+
+				std::cerr << job.name << ": frames " << chunk.first << "-" << chunk.first + chunk.count - 1 << " of "
+						  << job.count << " done" << std::endl;
+			}
+		}
+
+		// Hand the GL context back so the host can be destroyed by the main thread
+		host_.release();
+	}
+};
+
+int run_batch(std::vector<batch_job> &jobs, size_t workers, uint32_t chunk_size, const std::string &progress_path,
+			  bool restart)
+{
+	std::set<std::tuple<std::string, uint32_t, uint32_t>> done;
+	progress_log progress(progress_path, restart, done);
+
+	// Stateless jobs are split in one task per chunk, so they are spread
+	// across the workers. Each stateful job is a single task, rendered in
+	// order by one worker, and queued first as it takes longer.
+	std::vector<std::vector<batch_chunk>> tasks, stateless_tasks;
+	std::vector<char> failed(jobs.size(), 0);
+	size_t chunk_count = 0;
+
+	for (size_t j = 0; j < jobs.size(); ++j)
+	{
+		auto &job(jobs[j]);
+		std::vector<batch_chunk> chunks;
+
+		// Frames written to a file which was removed since are rendered again
+		bool exists = job.format == core::export_format::png || fs::exists(job.output);
+		auto written = [&job, exists](uint32_t first, uint32_t count) {
+			if (job.format != core::export_format::png)
+				return exists;
+
+			for (uint32_t i = first; i < first + count; ++i)
+				if (!fs::exists(core::export_frame_path(job.output, job.format, i)))
+					return false;
+
+			return true;
+		};
+
+		auto resumed = [&](uint32_t first, uint32_t count) {
+			return done.count(std::make_tuple(job.name, first, count)) && written(first, count);
+		};
+
+		bool resume = false;
+		for (uint32_t first = 0; first < job.count && !resume; first += chunk_size)
+			resume = resumed(first, std::min(chunk_size, job.count - first));
+
+		// Create the outputs before the workers write parts of them. A file
+		// which does not match the job anymore is replaced, and the chunks
+		// logged as done are then rendered again.
+		try
+		{
+			auto parent(fs::path(job.output).parent_path());
+			if (!parent.empty())
+				fs::create_directories(parent);
+
+			if (job.format == core::export_format::npy)
+			{
+				job.mapped = std::make_shared<core::mapped_frames>(job.output, job.count, job.height, job.width, 4,
+																	resume);
+				resume = resume && job.mapped->kept();
+			}
+			else
+			{
+				resume = gl::frame_writer::allocate(job.output, job.format, job.width, job.height, job.count,
+													resume) && resume;
+			}
+		}
+		catch (std::exception &ex)
+		{
+			std::cerr << job.name << ": " << ex.what() << std::endl;
+			failed[j] = 1;
+		}
+
+		for (uint32_t first = 0; first < job.count; first += chunk_size)
+		{
+			uint32_t count = std::min(chunk_size, job.count - first);
+
+			if (!resume || !resumed(first, count))
+				chunks.push_back(batch_chunk{ j, first, count });
+		}
+
+		if (chunks.empty())
+		{
+			job.mapped.reset();
+			continue;
+		}
+
+		chunk_count += chunks.size();
+
+		if (job.stateless)
+		{
+			for (const auto &chunk : chunks)
+				stateless_tasks.push_back({ chunk });
+		}
+		else
+		{
+			tasks.push_back(std::move(chunks));
+		}
+	}
+
+	tasks.insert(tasks.end(), stateless_tasks.begin(), stateless_tasks.end());
+
+	std::cerr << chunk_count << " chunks to render, " << done.size() << " already done" << std::endl;
+
+	std::vector<std::unique_ptr<batch_worker>> runners;
+	for (size_t i = 0; i < std::min(workers, tasks.size()); ++i)
+	{
+		runners.emplace_back(std::make_unique<batch_worker>(jobs));
+		runners.back()->allocate();
+	}
+
+	auto start(std::chrono::steady_clock::now());
+	std::atomic<size_t> next(0);
+	std::atomic<uint64_t> rendered(0);
+	std::mutex failed_mutex;
+
+	std::vector<std::thread> threads;
+	for (auto &runner : runners)
+	{
+		threads.emplace_back([&runner, &tasks, &next, &failed, &failed_mutex, &progress, &rendered]() {
+			runner->run(tasks, next, failed, failed_mutex, progress, rendered);
+		});
+	}
+
+	for (auto &thread : threads)
+		thread.join();
+
+	// Unmap the NumPy outputs
+	for (auto &job : jobs)
+		job.mapped.reset();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::cerr << "Rendered " << rendered << " frames in " << elapsed << "s (" << rendered / std::max(elapsed, 1e-9)
+			  << " fps)" << std::endl;
+
+	return std::count(failed.begin(), failed.end(), 1) == 0 ? 0 : 2;
+}
+}
+
+int main(int argc, char *argv[])
+{
+	std::string manifest_path, output_dir, progress_path;
+	size_t workers;
+	uint32_t chunk_size;
+	bool restart;
+
+	try
+	{
+		po::options_description desc("shadertoy-connector batch renderer");
+		desc.add_options()
+			("help,h", "Show this help message")
+			("manifest,m", po::value<std::string>(&manifest_path)->required(), "JSON manifest of the jobs to render")
+			("output,o", po::value<std::string>(&output_dir)->default_value("."), "Directory the job outputs are relative to")
+			("workers,w", po::value<size_t>(&workers)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+			 "Number of rendering worker threads, each owning a GL context")
+			("chunk,c", po::value<uint32_t>(&chunk_size)->default_value(32), "Number of frames rendered by a worker at once")
+			("progress,p", po::value<std::string>(&progress_path), "Progress file (default: manifest path with .progress appended)")
+			("restart", po::bool_switch(&restart)->default_value(false), "Render all the frames again, ignoring the progress file");
+
+		po::positional_options_description positional;
+		positional.add("manifest", 1);
+
+		po::variables_map vm;
+		po::store(po::command_line_parser(argc, argv).options(desc).positional(positional).run(), vm);
+
+		if (vm.count("help"))
+		{
+			std::cout << desc << std::endl;
+			return 0;
+		}
+
+		po::notify(vm);
+	}
+	catch (const po::error &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+
+	workers = std::max<size_t>(1, workers);
+	chunk_size = std::max<uint32_t>(1, chunk_size);
+
+	if (progress_path.empty())
+		progress_path = manifest_path + ".progress";
+
+#ifndef _WIN32
+	// llvmpipe starts one rasterizer thread per core in each context, share
+	// the cores between the workers instead
+	auto cores(std::max(1u, std::thread::hardware_concurrency()));
+	setenv("LP_NUM_THREADS", std::to_string(std::max<size_t>(1, cores / workers)).c_str(), 0);
+#endif
+
+	try
+	{
+		auto jobs(load_manifest(manifest_path, output_dir));
+		return run_batch(jobs, workers, chunk_size, progress_path, restart);
+	}
+	catch (std::exception &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include <json/json.h>
+
+#include "stc/core/image.hpp"
+#include "stc/gl/context.hpp"
+#include "stc/gl/host.hpp"
+
+#if SHADERTOY_CONNECTOR_HAS_ZMQ
+#include "stc/net/io.hpp"
+#endif
+
+namespace po = boost::program_options;
+
+using namespace stc;
+
+namespace
+{
+
+/// Shader used for the render and readback benchmarks
+const char *render_source = "void mainImage(out vec4 O, in vec2 U){O=vec4(U/iResolution.xy, sin(iTime), 1.);}";
+
+/// Shader used for the input upload benchmark
+const char *upload_source = "void mainImage(out vec4 O, in vec2 U){O=texture(iChannel0, U/iResolution.xy);}";
+
+struct bench_format
+{
+	std::string name;
+	GLenum format;
+	uint32_t depth;
+};
+
+struct bench_size
+{
+	uint32_t width;
+	uint32_t height;
+};
+
+struct bench_options
+{
+	double min_time;
+	size_t min_iterations;
+	size_t warmup;
+	std::string filter;
+};
+
+class bench_runner
+{
+	const bench_options &opts_;
+	Json::Value results_;
+
+public:
+	bench_runner(const bench_options &opts)
+		: opts_(opts),
+		results_(Json::arrayValue)
+	{
+	}
+
+	inline const Json::Value &results() const
+	{ return results_; }
+
+	/**
+	 * @brief Runs a benchmark case until both the minimum time and the minimum
+	 * number of iterations are reached, and records its statistics.
+	 *
+	 * @param name   Name of the benchmark case
+	 * @param size   Image size for this case
+	 * @param format Image format for this case
+	 * @param bytes  Size of the pixel payload processed by one iteration
+	 * @param fun    Function to benchmark
+	 */
+	void run(const std::string &name, const bench_size &size, const bench_format &format, size_t bytes,
+			 const std::function<void()> &fun)
+	{
+		if (!opts_.filter.empty() && name.find(opts_.filter) == std::string::npos)
+			return;
+
+		std::cerr << name << " " << size.width << "x" << size.height << " " << format.name << std::endl;
+
+		for (size_t i = 0; i < opts_.warmup; ++i)
+			fun();
+
+		std::vector<int64_t> samples;
+		auto deadline(std::chrono::steady_clock::now() + std::chrono::duration<double>(opts_.min_time));
+
+		while (samples.size() < opts_.min_iterations || std::chrono::steady_clock::now() < deadline)
+		{
+			auto start(std::chrono::steady_clock::now());
+			fun();
+			auto end(std::chrono::steady_clock::now());
+
+			samples.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+		}
+
+		std::sort(samples.begin(), samples.end());
+
+		int64_t total = 0;
+		for (auto sample : samples)
+			total += sample;
+
+		auto percentile = [&samples](double p) {
+			return static_cast<Json::Int64>(samples[static_cast<size_t>(p * (samples.size() - 1))]);
+		};
+
+		Json::Value result;
+		result["name"] = name;
+		result["width"] = size.width;
+		result["height"] = size.height;
+		result["format"] = format.name;
+		result["bytes"] = static_cast<Json::UInt64>(bytes);
+		result["iterations"] = static_cast<Json::UInt64>(samples.size());
+		result["mean_ns"] = static_cast<Json::Int64>(total / static_cast<int64_t>(samples.size()));
+		result["min_ns"] = static_cast<Json::Int64>(samples.front());
+		result["p50_ns"] = percentile(0.5);
+		result["p90_ns"] = percentile(0.9);
+		result["p99_ns"] = percentile(0.99);
+		result["max_ns"] = static_cast<Json::Int64>(samples.back());
+
+		results_.append(result);
+	}
+};
+
+std::vector<bench_size> parse_sizes(const std::string &spec)
+{
+	std::vector<bench_size> sizes;
+	std::stringstream ss(spec);
+	std::string item;
+
+	while (std::getline(ss, item, ','))
+	{
+		bench_size size;
+		char x;
+		std::stringstream is(item);
+
+		if (!(is >> size.width >> x >> size.height) || x != 'x' || size.width == 0 || size.height == 0)
+		{
+			std::stringstream err;
+			err << "Invalid size specification '" << item << "'";
+			throw std::runtime_error(err.str());
+		}
+
+		sizes.push_back(size);
+	}
+
+	return sizes;
+}
+
+std::vector<bench_format> parse_formats(const std::string &spec)
+{
+	std::vector<bench_format> formats;
+	std::stringstream ss(spec);
+	std::string item;
+
+	while (std::getline(ss, item, ','))
+	{
+		std::transform(item.begin(), item.end(), item.begin(), ::tolower);
+
+		if (item.compare("rgba") == 0)
+			formats.push_back(bench_format{ item, GL_RGBA, 4 });
+		else if (item.compare("rgb") == 0)
+			formats.push_back(bench_format{ item, GL_RGB, 3 });
+		else if (item.compare("luminance") == 0)
+			formats.push_back(bench_format{ item, GL_LUMINANCE, 1 });
+		else
+		{
+			std::stringstream err;
+			err << "Invalid format '" << item << "'";
+			throw std::runtime_error(err.str());
+		}
+	}
+
+	return formats;
+}
+
+std::shared_ptr<core::image> make_image(const bench_size &size, uint32_t depth)
+{
+	auto img(std::make_shared<core::image>());
+	img->dims[0] = size.height;
+	img->dims[1] = size.width;
+	img->dims[2] = depth;
+	img->alloc();
+
+	for (size_t i = 0; i < img->data->size(); ++i)
+		(*img->data)[i] = static_cast<float>(i % 256) / 255.f;
+
+	return img;
+}
+
+void run_benchmarks(bench_runner &runner, Json::Value &doc, const std::vector<bench_size> &sizes,
+					const std::vector<bench_format> &formats)
+{
+	gl::host host;
+	host.allocate();
+
+	doc["renderer"] = reinterpret_cast<const char *>(glGetString(GL_RENDERER));
+	doc["version"] = reinterpret_cast<const char *>(glGetString(GL_VERSION));
+
+	std::array<float, 4> mouse{ 0.f, 0.f, 0.f, 0.f };
+
+	std::vector<std::pair<std::string, std::string>> render_sources;
+	render_sources.emplace_back("image", render_source);
+	auto render_id(host.create_local(render_sources));
+	auto render_context(host.get_gl_context(render_id));
+
+	std::vector<std::pair<std::string, std::string>> upload_sources;
+	upload_sources.emplace_back("image", upload_source);
+	auto upload_id(host.create_local(upload_sources));
+	auto upload_context(host.get_gl_context(upload_id));
+
+#if SHADERTOY_CONNECTOR_HAS_ZMQ
+	auto log(spdlog::stderr_color_mt("stc-bench"));
+	log->set_level(spdlog::level::warn);
+
+	zmq::context_t zmq_context(1);
+	zmq::socket_t sender(zmq_context, ZMQ_PAIR), receiver(zmq_context, ZMQ_PAIR);
+	receiver.bind("inproc://stc-bench");
+	sender.connect("inproc://stc-bench");
+
+	net::io send_io(log, sender), recv_io(log, receiver);
+#endif
+
+	for (const auto &size : sizes)
+	{
+		for (const auto &format : formats)
+		{
+			size_t bytes = sizeof(float) * size.width * size.height * format.depth;
+
+			runner.run("perform_render", size, format, bytes, [&]() {
+				host.render(render_id, 0, size.width, size.height, mouse, format.format);
+			});
+
+			// Bring the context to the right size for readback
+			host.render(render_id, 0, size.width, size.height, mouse, format.format);
+			std::vector<float> readback(bytes / sizeof(float));
+			runner.run("readback", size, format, bytes, [&]() {
+				render_context->read_output(format.format, readback.data());
+			});
+
+			auto img(make_image(size, format.depth));
+			runner.run("vflip", size, format, bytes, [&]() {
+				img->vflip();
+			});
+
+			runner.run("image_alloc", size, format, bytes, [&]() {
+				core::image fresh;
+				fresh.dims = img->dims;
+				fresh.alloc();
+			});
+
+			// Baseline for image_alloc, which recycles buffers
+			runner.run("image_alloc_heap", size, format, bytes, [&]() {
+				auto fresh(std::make_shared<std::vector<float>>(bytes / sizeof(float)));
+			});
+
+#if SHADERTOY_CONNECTOR_HAS_ZMQ
+			core::image received;
+			runner.run("io_image_send_recv", size, format, bytes, [&]() {
+				send_io.send_data_noout(*img);
+				recv_io.recv_data_noout(received);
+			});
+#endif
+
+			// Uploads are performed lazily, so render a single pixel to trigger it
+			runner.run("override_input_upload", size, format, bytes, [&]() {
+				upload_context->set_input("image", 0, img);
+				host.render(upload_id, 0, 1, 1, mouse, GL_RGBA);
+			});
+		}
+	}
+}
+}
+
+int main(int argc, char *argv[])
+{
+	bench_options opts;
+	bool hardware;
+	std::string sizes_spec, formats_spec, output_path;
+
+	try
+	{
+		po::options_description desc("shadertoy-connector microbenchmarks");
+		desc.add_options()
+			("help,h", "Show this help message")
+			("sizes,s", po::value<std::string>(&sizes_spec)->default_value("64x64,640x360,1920x1080"), "Comma-separated list of WIDTHxHEIGHT sizes")
+			("formats,f", po::value<std::string>(&formats_spec)->default_value("rgba,rgb,luminance"), "Comma-separated list of formats")
+			("min-time,t", po::value<double>(&opts.min_time)->default_value(0.5), "Minimum measurement time per case, in seconds")
+			("min-iterations,n", po::value<size_t>(&opts.min_iterations)->default_value(10), "Minimum number of iterations per case")
+			("warmup,w", po::value<size_t>(&opts.warmup)->default_value(2), "Number of unmeasured iterations per case")
+			("filter", po::value<std::string>(&opts.filter)->default_value(""), "Only run cases whose name contains this string")
+			("hardware", po::bool_switch(&hardware)->default_value(false), "Do not force the software GL implementation")
+			("output,o", po::value<std::string>(&output_path)->default_value("-"), "JSON results file, - for stdout");
+
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help"))
+		{
+			std::cout << desc << std::endl;
+			return 0;
+		}
+	}
+	catch (const po::error &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+
+#ifndef _WIN32
+	// Results are only comparable across machines on the software rasterizer
+	if (!hardware)
+		setenv("LIBGL_ALWAYS_SOFTWARE", "1", 0);
+#endif
+
+	try
+	{
+		auto sizes(parse_sizes(sizes_spec));
+		auto formats(parse_formats(formats_spec));
+
+		bench_runner runner(opts);
+		Json::Value doc;
+		run_benchmarks(runner, doc, sizes, formats);
+		doc["results"] = runner.results();
+
+		if (output_path.compare("-") == 0)
+		{
+			std::cout << doc << std::endl;
+		}
+		else
+		{
+			std::ofstream ofs(output_path);
+			ofs << doc << std::endl;
+		}
+	}
+	catch (std::exception &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
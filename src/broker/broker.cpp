@@ -0,0 +1,564 @@
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <map>
+#include <memory>
+#include <sstream>
+
+#include <zmq.hpp>
+
+#include <shadertoy/spdlog/spdlog.h>
+#include <shadertoy/spdlog/fmt/ostr.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#endif
+
+#include "stc/broker/broker.hpp"
+#include "stc/net/multipart.hpp"
+
+using namespace stc;
+using namespace stc::broker;
+
+namespace stc
+{
+namespace broker
+{
+
+typedef std::chrono::steady_clock steady_clock;
+
+/**
+ * Server the broker forwards requests to
+ */
+struct backend
+{
+	/// Endpoint of the server
+	const std::string address;
+
+	/// DEALER socket connected to the server
+	zmq::socket_t socket;
+
+	/// Number of requests sent to the server without reply yet
+	size_t inflight;
+
+	/// Number of exports among them. A worker of the server is busy for the
+	/// whole export, so requests queued behind it may be late.
+	size_t exports;
+
+	/// false if the server missed a health check, in which case no new
+	/// contexts are placed on it
+	bool healthy;
+
+	/// Time the last health check was sent, and whether it is still pending
+	steady_clock::time_point ping_sent;
+	bool ping_pending;
+
+	backend(zmq::context_t &context, const std::string &addr)
+		: address(addr),
+		socket(context, ZMQ_DEALER),
+		inflight(0),
+		exports(0),
+		healthy(true),
+		ping_sent(),
+		ping_pending(false)
+	{
+	}
+};
+
+/**
+ * Request forwarded to a backend, waiting for its reply
+ */
+struct pending_request
+{
+	/// Backend the request was sent to
+	size_t backend;
+	/// Name of the request, empty for health checks
+	std::string request;
+	/// Context of the request, to forget the placement of reset contexts
+	std::string id;
+	/// Routing envelope of the client, to fail the request on timeout
+	std::vector<zmq::message_t> envelope;
+	/// Time the request was forwarded
+	steady_clock::time_point sent;
+};
+
+/**
+ * Backend a context was placed on
+ */
+struct placement
+{
+	size_t backend;
+	/// true for contexts created by create_local, which only exist on their
+	/// backend. Remote contexts can be moved to another backend.
+	bool local;
+	/// Position of remote contexts in the usage list of the broker
+	std::list<std::string>::iterator usage;
+};
+
+class broker_impl
+{
+	const broker_options options_;
+
+	zmq::context_t context_;
+	zmq::socket_t frontend_;
+
+	std::shared_ptr<spdlog::logger> log_;
+
+	std::vector<std::unique_ptr<backend>> backends_;
+
+	/// Requests in flight, by the tag the broker prepends to their envelope
+	std::map<uint64_t, pending_request> pending_;
+	uint64_t next_tag_;
+
+	/// Placement of the known contexts
+	std::map<std::string, placement> affinity_;
+
+	/// Remote contexts, most recently used first. Only the last
+	/// max_remote_placements are remembered: the others are placed again,
+	/// and reloaded, when they are used next.
+	std::list<std::string> usage_;
+	static constexpr size_t max_remote_placements = 16384;
+
+	/// Places a remote context, forgetting the least recently used ones
+	void place_remote(const std::string &id, size_t index)
+	{
+		auto it = affinity_.find(id);
+		if (it != affinity_.end())
+		{
+			it->second.backend = index;
+			usage_.splice(usage_.begin(), usage_, it->second.usage);
+			return;
+		}
+
+		while (usage_.size() >= max_remote_placements)
+		{
+			affinity_.erase(usage_.back());
+			usage_.pop_back();
+		}
+
+		usage_.push_front(id);
+		affinity_.emplace(id, placement{ index, false, usage_.begin() });
+	}
+
+	/// Forgets the placement of a context
+	void forget(const std::string &id)
+	{
+		auto it = affinity_.find(id);
+		if (it == affinity_.end())
+			return;
+
+		if (!it->second.local)
+			usage_.erase(it->second.usage);
+		affinity_.erase(it);
+	}
+
+	/// true for requests which are not about a context
+	static bool is_global(const std::string &request)
+	{
+		return request.compare("ping") == 0 || request.compare("hello") == 0 ||
+			   request.compare("attach_shm") == 0 || request.compare("detach_shm") == 0;
+	}
+
+	/**
+	 * Returns the healthy backend with the fewest requests in flight, or
+	 * backends_.size() if all backends are unhealthy.
+	 */
+	size_t least_loaded() const
+	{
+		size_t best = backends_.size();
+
+		for (size_t i = 0; i < backends_.size(); ++i)
+			if (backends_[i]->healthy && (best == backends_.size() || backends_[i]->inflight < backends_[best]->inflight))
+				best = i;
+
+		return best;
+	}
+
+	/// Picks the backend for a request, see least_loaded for the return value
+	size_t route(const net::route_key &key)
+	{
+		if (key.request.compare("create_local") == 0 || key.id.empty() || is_global(key.request))
+			return least_loaded();
+
+		auto it = affinity_.find(key.id);
+		if (it != affinity_.end())
+		{
+			// Local contexts cannot move, so keep trying their backend
+			if (it->second.local)
+				return it->second.backend;
+
+			if (backends_[it->second.backend]->healthy)
+			{
+				usage_.splice(usage_.begin(), usage_, it->second.usage);
+				return it->second.backend;
+			}
+
+			log_->info("Moving context {} away from {}", key.id, backends_[it->second.backend]->address);
+		}
+
+		auto best(least_loaded());
+		if (best < backends_.size())
+			place_remote(key.id, best);
+
+		return best;
+	}
+
+	/// Sends the routing envelope of a client followed by an error
+	void send_error(std::vector<zmq::message_t> &envelope, const std::string &error)
+	{
+		for (auto &part : envelope)
+			frontend_.send(part, ZMQ_SNDMORE);
+
+		zmq::message_t status(5);
+		memcpy(status.data(), "ERROR", 5);
+		frontend_.send(status, ZMQ_SNDMORE);
+
+		zmq::message_t message(error.size());
+		memcpy(message.data(), error.data(), error.size());
+		frontend_.send(message);
+	}
+
+	/// Forwards a message to a backend, tagged so its reply can be matched
+	uint64_t forward(size_t index, std::vector<zmq::message_t> &parts, const std::string &request,
+					 const std::string &id = std::string())
+	{
+		auto &be(*backends_[index]);
+		uint64_t tag = next_tag_++;
+
+		zmq::message_t tag_part(sizeof(tag));
+		memcpy(tag_part.data(), &tag, sizeof(tag));
+		be.socket.send(tag_part, ZMQ_SNDMORE);
+
+		// Keep a copy of the client envelope, up to the delimiter
+		pending_request req{ index, request, id, std::vector<zmq::message_t>(), steady_clock::now() };
+		auto delimiter(net::find_delimiter(parts));
+		for (size_t i = 0; i <= delimiter && i < parts.size(); ++i)
+		{
+			req.envelope.emplace_back();
+			req.envelope.back().copy(&parts[i]);
+		}
+
+		net::send_multipart(be.socket, parts);
+
+		be.inflight++;
+		if (request.compare("export") == 0)
+			be.exports++;
+
+		pending_.emplace(tag, std::move(req));
+
+		return tag;
+	}
+
+	void handle_client()
+	{
+		std::vector<zmq::message_t> parts;
+		if (!net::recv_multipart(frontend_, parts))
+			return;
+
+		net::route_key key;
+		if (!net::parse_route_key(parts, key))
+		{
+			log_->error("Dropping malformed request");
+			return;
+		}
+
+		auto index(route(key));
+		if (index == backends_.size())
+		{
+			log_->warn("No healthy backend for '{}'", key.request);
+
+			parts.resize(key.delimiter + 1);
+			send_error(parts, "No backend available");
+			return;
+		}
+
+		log_->debug("Dispatching '{}' to {}", key.request, backends_[index]->address);
+		forward(index, parts, key.request, key.id);
+	}
+
+	/// Replaces a wildcard host in an endpoint sent by a backend by the host of that backend
+	static std::string rewrite_endpoint(const std::string &endpoint, const std::string &backend_address)
+	{
+		auto host_start = endpoint.find("://");
+		auto host_end = endpoint.rfind(':');
+		auto backend_start = backend_address.find("://");
+		auto backend_end = backend_address.rfind(':');
+
+		if (host_start == std::string::npos || host_end == std::string::npos || host_end < host_start + 3 ||
+			backend_start == std::string::npos || backend_end == std::string::npos || backend_end < backend_start + 3)
+			return endpoint;
+
+		auto host(endpoint.substr(host_start + 3, host_end - host_start - 3));
+		if (host.compare("*") != 0 && host.compare("0.0.0.0") != 0)
+			return endpoint;
+
+		return endpoint.substr(0, host_start + 3) +
+			   backend_address.substr(backend_start + 3, backend_end - backend_start - 3) +
+			   endpoint.substr(host_end);
+	}
+
+	void handle_backend(size_t index)
+	{
+		auto &be(*backends_[index]);
+
+		std::vector<zmq::message_t> parts;
+		if (!net::recv_multipart(be.socket, parts))
+			return;
+
+		uint64_t tag;
+		if (parts.empty() || parts[0].size() != sizeof(tag))
+		{
+			log_->error("Dropping malformed reply from {}", be.address);
+			return;
+		}
+
+		memcpy(&tag, parts[0].data(), sizeof(tag));
+
+		auto it = pending_.find(tag);
+		if (it == pending_.end())
+		{
+			// The request timed out, the client already got an error
+			log_->debug("Dropping late reply from {}", be.address);
+			return;
+		}
+
+		auto request(std::move(it->second.request));
+		auto id(std::move(it->second.id));
+		pending_.erase(it);
+		be.inflight--;
+		if (request.compare("export") == 0)
+			be.exports--;
+
+		if (!be.healthy)
+			log_->info("Backend {} is healthy again", be.address);
+		be.healthy = true;
+
+		if (request.empty())
+		{
+			// Health check
+			be.ping_pending = false;
+			return;
+		}
+
+		auto delimiter(net::find_delimiter(parts, 1));
+		std::string value;
+		bool ok = net::parse_reply_status(parts, value, 1);
+
+		if (ok && request.compare("create_local") == 0 && !value.empty())
+		{
+			// Local contexts only exist on the backend which created them
+			affinity_[value] = placement{ index, true, usage_.end() };
+		}
+		else if (ok && request.compare("reset") == 0)
+		{
+			// The context is created again on next use, possibly elsewhere
+			forget(id);
+		}
+		else if (ok && request.compare("subscribe") == 0 && delimiter + 3 < parts.size())
+		{
+			// Clients subscribe to the backend directly
+			auto endpoint(rewrite_endpoint(net::part_string(parts[delimiter + 3]), be.address));
+
+			zmq::message_t part(endpoint.size());
+			memcpy(part.data(), endpoint.data(), endpoint.size());
+			parts[delimiter + 3].move(&part);
+		}
+
+		net::send_multipart(frontend_, parts, 1);
+	}
+
+	/// Sends due health checks and fails requests which timed out
+	void check_backends()
+	{
+		auto now(steady_clock::now());
+
+		for (auto it = pending_.begin(); it != pending_.end();)
+		{
+			// Exports last as long as the frames take to render
+			bool is_export = it->second.request.compare("export") == 0;
+			int timeout = is_export ? options_.export_timeout : options_.timeout;
+
+			if ((is_export && timeout <= 0) || now - it->second.sent < std::chrono::milliseconds(timeout))
+			{
+				++it;
+				continue;
+			}
+
+			auto &be(*backends_[it->second.backend]);
+			be.inflight--;
+			if (is_export)
+				be.exports--;
+
+			if (be.exports > 0)
+			{
+				// The server is busy exporting, not unreachable: only the
+				// request fails
+				log_->warn("Backend {} did not reply in time while exporting", be.address);
+			}
+			else
+			{
+				if (be.healthy)
+					log_->warn("Backend {} did not reply in time, draining it", be.address);
+				be.healthy = false;
+			}
+
+			if (it->second.request.empty())
+				be.ping_pending = false;
+			else
+				send_error(it->second.envelope, "Backend did not reply in time");
+
+			it = pending_.erase(it);
+		}
+
+		for (size_t i = 0; i < backends_.size(); ++i)
+		{
+			auto &be(*backends_[i]);
+
+			if (be.ping_pending || now - be.ping_sent < std::chrono::milliseconds(options_.ping_interval))
+				continue;
+
+			std::vector<zmq::message_t> ping;
+			ping.emplace_back();
+
+			zmq::message_t name(4);
+			memcpy(name.data(), "ping", 4);
+			ping.push_back(std::move(name));
+
+			forward(i, ping, std::string());
+			be.ping_sent = now;
+			be.ping_pending = true;
+		}
+	}
+
+	// Signal handling
+	std::atomic<bool> continue_;
+
+	static broker_impl *current_broker;
+
+	static void sigterm_handler(int)
+	{
+		if (current_broker)
+		{
+			current_broker->continue_ = false;
+		}
+	}
+
+public:
+	broker_impl(const broker_options &options)
+		: options_(options),
+		context_(1),
+		frontend_(context_, ZMQ_ROUTER),
+		log_(spdlog::stderr_color_mt("shadertoy-broker")),
+		backends_(),
+		pending_(),
+		next_tag_(0),
+		affinity_(),
+		usage_(),
+		continue_(false)
+	{
+		if (options_.backends.empty())
+			throw std::runtime_error("No backend given");
+
+		for (const auto &address : options_.backends)
+			backends_.emplace_back(std::make_unique<backend>(context_, address));
+	}
+
+	void run()
+	{
+		current_broker = this;
+		continue_ = true;
+
+#ifndef _WIN32
+		struct sigaction previous_term_handler;
+		struct sigaction previous_int_handler;
+
+		struct sigaction new_handler;
+		new_handler.sa_handler = broker_impl::sigterm_handler;
+		new_handler.sa_flags = 0;
+		sigemptyset(&new_handler.sa_mask);
+
+		sigaction(SIGINT, &new_handler, &previous_int_handler);
+		sigaction(SIGTERM, &new_handler, &previous_term_handler);
+#endif
+
+		for (auto &be : backends_)
+		{
+			log_->info("Connecting to backend {}", be->address);
+
+			// Do not wait for unreachable backends when exiting
+			int linger = 0;
+			be->socket.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+			be->socket.connect(be->address);
+		}
+
+		std::stringstream bind_addresses(options_.bind_address);
+		std::string endpoint;
+		while (std::getline(bind_addresses, endpoint, ','))
+		{
+			log_->info("Binding to {}", endpoint);
+			frontend_.bind(endpoint);
+		}
+
+		std::vector<zmq::pollitem_t> items;
+		items.push_back({ static_cast<void *>(frontend_), 0, ZMQ_POLLIN, 0 });
+		for (auto &be : backends_)
+			items.push_back({ static_cast<void *>(be->socket), 0, ZMQ_POLLIN, 0 });
+
+		while (continue_)
+		{
+			try
+			{
+				zmq::poll(items.data(), items.size(), 100);
+			}
+			catch (zmq::error_t &e)
+			{
+				log_->warn("zmq::poll: {}", e.what());
+				continue;
+			}
+
+			// Replies first, so backends are not starved by new requests
+			for (size_t i = 0; i < backends_.size(); ++i)
+				if (items[i + 1].revents & ZMQ_POLLIN)
+					handle_backend(i);
+
+			if (items[0].revents & ZMQ_POLLIN)
+				handle_client();
+
+			check_backends();
+		}
+
+		log_->info("Terminating broker");
+
+		int linger = 0;
+		frontend_.setsockopt(ZMQ_LINGER, &linger, sizeof(linger));
+
+#ifndef _WIN32
+		sigaction(SIGINT, &previous_int_handler, NULL);
+		sigaction(SIGTERM, &previous_term_handler, NULL);
+#endif
+
+		current_broker = nullptr;
+	}
+};
+
+broker_impl *broker_impl::current_broker = nullptr;
+
+// The class shares its name with the namespace, so its members are defined
+// in the namespace scope where broker names the class
+broker::broker(const broker_options &options)
+	: impl_(new broker_impl(options))
+{
+}
+
+broker::~broker()
+{
+	delete impl_;
+}
+
+void broker::run()
+{
+	impl_->run();
+}
+}
+}
@@ -0,0 +1,64 @@
+#include <iostream>
+#include <sstream>
+
+#include "stc/broker/broker.hpp"
+
+#include <shadertoy/spdlog/spdlog.h>
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+int main(int argc, char *argv[])
+{
+	bool debug_mode;
+	std::string backends;
+	stc::broker::broker_options options;
+
+	try
+	{
+		po::options_description desc("shadertoy-connector broker");
+		desc.add_options()
+			("help,h", "Show this help message")
+			("debug,d", po::bool_switch(&debug_mode)->default_value(false), "Enable debug output")
+			("bind,b", po::value<std::string>(&options.bind_address)->default_value("tcp://*:13710"), "Endpoints to bind to, separated by commas")
+			("backends,B", po::value<std::string>(&backends)->required(), "Endpoints of the servers, separated by commas")
+			("ping-interval", po::value<int>(&options.ping_interval)->default_value(1000), "Time between health checks of a server, in milliseconds")
+			("timeout", po::value<int>(&options.timeout)->default_value(30000), "Time after which a server which did not reply is drained, in milliseconds")
+			("export-timeout", po::value<int>(&options.export_timeout)->default_value(0), "Time after which an export which did not complete is failed, in milliseconds, 0 for no limit");
+
+		po::variables_map vm;
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+
+		if (vm.count("help"))
+		{
+			std::cout << desc << std::endl;
+			return 0;
+		}
+
+		po::notify(vm);
+
+		std::stringstream ss(backends);
+		std::string backend;
+		while (std::getline(ss, backend, ','))
+			options.backends.push_back(backend);
+
+		if (debug_mode)
+			spdlog::set_level(spdlog::level::debug);
+
+		stc::broker::broker brk(options);
+		brk.run();
+	}
+	catch (const po::error &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+	catch (const std::exception &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
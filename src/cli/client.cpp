@@ -1,14 +1,419 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <random>
+#include <sstream>
+#include <thread>
 
 #include "stc/client/net_host.hpp"
 
 #include <shadertoy/spdlog/spdlog.h>
 
-int main(int argc, char *argv[])
+#include <boost/program_options.hpp>
+
+#include <json/json.h>
+
+namespace po = boost::program_options;
+
+using namespace stc;
+
+namespace
+{
+
+/// Shader source or remote id used by a workload
+struct workload_shader
+{
+	/// Remote shadertoy.com id, if this is not a local shader
+	std::string remote_id;
+	/// Buffer sources for local shaders, image last
+	std::vector<std::pair<std::string, std::string>> sources;
+};
+
+/// Single step of the workload loop
+struct workload_step
+{
+	/// Request type: render or set_input
+	std::string type;
+	/// Name of the shader to run this step on
+	std::string shader;
+
+	// render parameters
+	uint32_t width;
+	uint32_t height;
+	GLenum format;
+	int frames;
+
+	// set_input parameters
+	std::string input_buffer;
+	size_t input_channel;
+	std::array<uint32_t, 3> input_dims;
+};
+
+struct workload
+{
+	std::map<std::string, workload_shader> shaders;
+	std::vector<workload_step> steps;
+
+	size_t connections;
+	double duration;
+	size_t requests;
+};
+
+GLenum parse_format(std::string name)
+{
+	std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+	if (name.compare("rgba") == 0)
+		return GL_RGBA;
+	else if (name.compare("rgb") == 0)
+		return GL_RGB;
+	else if (name.compare("luminance") == 0)
+		return GL_LUMINANCE;
+
+	std::stringstream ss;
+	ss << "Invalid format '" << name << "'";
+	throw std::runtime_error(ss.str());
+}
+
+workload load_workload(const std::string &path)
+{
+	std::ifstream ifs(path);
+	if (!ifs)
+	{
+		std::stringstream ss;
+		ss << "Could not open workload file " << path;
+		throw std::runtime_error(ss.str());
+	}
+
+	Json::Value spec;
+	ifs >> spec;
+
+	workload result;
+	result.connections = spec.get("connections", 1).asUInt();
+	result.duration = spec.get("duration", 0.0).asDouble();
+	result.requests = spec.get("requests", 0).asUInt();
+
+	// Shaders, by name
+	for (const auto &name : spec["shaders"].getMemberNames())
+	{
+		const auto &shader_spec(spec["shaders"][name]);
+		workload_shader shader;
+
+		if (shader_spec.isMember("id"))
+		{
+			shader.remote_id = shader_spec["id"].asString();
+		}
+		else
+		{
+			for (const auto &buffer : shader_spec["buffers"].getMemberNames())
+				shader.sources.emplace_back(buffer, shader_spec["buffers"][buffer].asString());
+			shader.sources.emplace_back("image", shader_spec["image"].asString());
+		}
+
+		result.shaders.emplace(name, std::move(shader));
+	}
+
+	// Steps, executed in order by each connection
+	for (const auto &step_spec : spec["steps"])
+	{
+		workload_step step;
+		step.type = step_spec["type"].asString();
+		step.shader = step_spec["shader"].asString();
+
+		if (result.shaders.find(step.shader) == result.shaders.end())
+		{
+			std::stringstream ss;
+			ss << "Unknown shader '" << step.shader << "' in workload step";
+			throw std::runtime_error(ss.str());
+		}
+
+		if (step.type.compare("render") == 0)
+		{
+			step.width = step_spec.get("width", 640).asUInt();
+			step.height = step_spec.get("height", 360).asUInt();
+			step.format = parse_format(step_spec.get("format", "rgba").asString());
+			step.frames = step_spec.get("frames", 1).asInt();
+		}
+		else if (step.type.compare("set_input") == 0)
+		{
+			auto input(step_spec.get("input", "image.0").asString());
+			auto dot_pos(input.find('.'));
+			if (dot_pos == std::string::npos)
+			{
+				std::stringstream ss;
+				ss << "Invalid input specification " << input;
+				throw std::runtime_error(ss.str());
+			}
+
+			step.input_buffer = input.substr(0, dot_pos);
+			step.input_channel = std::atoi(input.c_str() + dot_pos + 1);
+			step.input_dims = { step_spec.get("height", 256).asUInt(), step_spec.get("width", 256).asUInt(),
+								step_spec.get("depth", 4).asUInt() };
+		}
+		else
+		{
+			std::stringstream ss;
+			ss << "Unknown workload step type '" << step.type << "'";
+			throw std::runtime_error(ss.str());
+		}
+
+		result.steps.push_back(std::move(step));
+	}
+
+	if (result.steps.empty())
+		throw std::runtime_error("The workload does not define any step");
+
+	return result;
+}
+
+/// Latency samples by request type
+typedef std::map<std::string, std::vector<int64_t>> latency_map;
+
+class connection_runner
 {
-	spdlog::set_level(spdlog::level::debug);
+	const workload &workload_;
+	client::net_host host_;
+
+	/// Context for each workload shader
+	std::map<std::string, std::pair<std::string, std::shared_ptr<core::basic_context>>> contexts_;
+
+	/// Input images for set_input steps, indexed by step
+	std::vector<std::shared_ptr<core::image>> inputs_;
+
+	latency_map latencies_;
+	size_t errors_;
+
+	template <typename Fun> void measure(const std::string &type, Fun &&fun)
+	{
+		auto start(std::chrono::steady_clock::now());
+
+		try
+		{
+			fun();
+		}
+		catch (std::exception &ex)
+		{
+			std::cerr << type << ": " << ex.what() << std::endl;
+			errors_++;
+			return;
+		}
+
+		auto end(std::chrono::steady_clock::now());
+		latencies_[type].push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	}
+
+public:
+	connection_runner(const workload &workload, const std::string &target)
+		: workload_(workload),
+		host_(target),
+		contexts_(),
+		inputs_(),
+		latencies_(),
+		errors_(0)
+	{
+	}
+
+	inline const latency_map &latencies() const
+	{ return latencies_; }
+
+	inline size_t errors() const
+	{ return errors_; }
+
+	void setup()
+	{
+		host_.allocate();
+
+		for (const auto &pair : workload_.shaders)
+		{
+			std::string id(pair.second.remote_id);
+
+			if (id.empty())
+			{
+				measure("create_local", [&]() { id = host_.create_local(pair.second.sources); });
+
+				if (id.empty())
+					continue;
+			}
+
+			measure("get_context", [&]() {
+				contexts_[pair.first] = std::make_pair(id, host_.get_context(id));
+			});
+		}
+
+		// Generate input images once
+		std::mt19937 rng(42);
+		std::uniform_real_distribution<float> dist(0.f, 1.f);
 
-	stc::client::net_host client("tcp://localhost:13710");
+		for (const auto &step : workload_.steps)
+		{
+			std::shared_ptr<core::image> img;
+
+			if (step.type.compare("set_input") == 0)
+			{
+				img = std::make_shared<core::image>();
+				img->dims = step.input_dims;
+				img->alloc();
+				std::generate(img->data->begin(), img->data->end(), [&]() { return dist(rng); });
+			}
+
+			inputs_.push_back(img);
+		}
+	}
+
+	/**
+	 * @brief Runs the workload steps until the deadline or the shared request
+	 * budget is exhausted
+	 */
+	void run(std::chrono::steady_clock::time_point deadline, std::atomic<long> &budget)
+	{
+		std::array<float, 4> mouse{ 0.f, 0.f, 0.f, 0.f };
+
+		// Nothing to do if all the contexts failed to load
+		if (contexts_.empty())
+			return;
+
+		while (true)
+		{
+			for (size_t i = 0; i < workload_.steps.size(); ++i)
+			{
+				const auto &step(workload_.steps[i]);
+				auto it = contexts_.find(step.shader);
+				if (it == contexts_.end())
+					continue;
+
+				const auto &id(it->second.first);
+				const auto &context(it->second.second);
+
+				int repeat = step.type.compare("render") == 0 ? step.frames : 1;
+				for (int r = 0; r < repeat; ++r)
+				{
+					if (std::chrono::steady_clock::now() >= deadline || budget.fetch_sub(1) <= 0)
+						return;
+
+					if (step.type.compare("render") == 0)
+					{
+						measure("render", [&]() {
+							host_.render(id, {}, step.width, step.height, mouse, step.format);
+						});
+					}
+					else
+					{
+						measure("set_input", [&]() {
+							context->set_input(step.input_buffer, step.input_channel, inputs_[i]);
+						});
+					}
+				}
+			}
+		}
+	}
+};
+
+Json::Value report(const latency_map &latencies, double elapsed, size_t errors)
+{
+	Json::Value result;
+	result["elapsed"] = elapsed;
+	result["errors"] = static_cast<Json::UInt64>(errors);
+
+	std::cout << std::left << std::setw(14) << "request" << std::right << std::setw(10) << "count"
+			  << std::setw(12) << "req/s" << std::setw(12) << "p50 (ms)" << std::setw(12) << "p90 (ms)"
+			  << std::setw(12) << "p99 (ms)" << std::setw(12) << "max (ms)" << std::endl;
+
+	for (auto pair : latencies)
+	{
+		auto &samples(pair.second);
+		if (samples.empty())
+			continue;
+
+		std::sort(samples.begin(), samples.end());
+
+		auto percentile = [&samples](double p) {
+			return samples[static_cast<size_t>(p * (samples.size() - 1))] / 1e6;
+		};
+
+		// Setup requests are not part of the timed run
+		bool setup = pair.first.compare("create_local") == 0 || pair.first.compare("get_context") == 0;
+		double throughput = setup ? 0.0 : samples.size() / elapsed;
+
+		std::cout << std::left << std::setw(14) << pair.first << std::right << std::setw(10) << samples.size()
+				  << std::fixed << std::setprecision(2) << std::setw(12) << throughput << std::setw(12)
+				  << percentile(0.5) << std::setw(12) << percentile(0.9) << std::setw(12) << percentile(0.99)
+				  << std::setw(12) << samples.back() / 1e6 << std::endl;
+
+		Json::Value entry;
+		entry["count"] = static_cast<Json::UInt64>(samples.size());
+		entry["throughput"] = throughput;
+		entry["p50_ms"] = percentile(0.5);
+		entry["p90_ms"] = percentile(0.9);
+		entry["p99_ms"] = percentile(0.99);
+		entry["max_ms"] = samples.back() / 1e6;
+		result["requests"][pair.first] = entry;
+	}
+
+	std::cout << "errors: " << errors << std::endl;
+
+	return result;
+}
+
+int run_load(const workload &wl, const std::string &target, const std::string &output_path)
+{
+	std::vector<std::unique_ptr<connection_runner>> runners;
+
+	// Connections and their contexts are set up before the timed run
+	for (size_t i = 0; i < wl.connections; ++i)
+	{
+		runners.emplace_back(std::make_unique<connection_runner>(wl, target));
+		runners.back()->setup();
+	}
+
+	auto start(std::chrono::steady_clock::now());
+	auto deadline(wl.duration > 0 ? start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+										std::chrono::duration<double>(wl.duration))
+								   : std::chrono::steady_clock::time_point::max());
+	std::atomic<long> budget(wl.requests > 0 ? static_cast<long>(wl.requests) : std::numeric_limits<long>::max());
+
+	std::vector<std::thread> threads;
+	for (auto &runner : runners)
+		threads.emplace_back([&runner, deadline, &budget]() { runner->run(deadline, budget); });
+
+	for (auto &thread : threads)
+		thread.join();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	// Merge per-connection results
+	latency_map latencies;
+	size_t errors = 0;
+	for (auto &runner : runners)
+	{
+		for (const auto &pair : runner->latencies())
+		{
+			auto &samples(latencies[pair.first]);
+			samples.insert(samples.end(), pair.second.begin(), pair.second.end());
+		}
+
+		errors += runner->errors();
+	}
+
+	auto result(report(latencies, elapsed, errors));
+	result["connections"] = static_cast<Json::UInt64>(wl.connections);
+
+	if (!output_path.empty())
+	{
+		std::ofstream ofs(output_path);
+		ofs << result << std::endl;
+	}
+
+	return errors == 0 ? 0 : 2;
+}
+
+int run_smoke_test(const std::string &target)
+{
+	stc::client::net_host client(target);
 	client.allocate();
 
 	std::vector<std::pair<std::string, std::string>> buffer_sources;
@@ -19,7 +424,7 @@ int main(int argc, char *argv[])
 
 	std::cerr << "Resetting context inputs" << std::endl;
 	auto context = client.get_context(context_id);
-	
+
 	std::cerr << "Obtained context" << std::endl;
 	context->reset_input("image", 0);
 
@@ -35,3 +440,72 @@ int main(int argc, char *argv[])
 
 	return 0;
 }
+}
+
+int main(int argc, char *argv[])
+{
+	bool debug_mode;
+	std::string target, workload_path, output_path;
+	size_t connections, requests;
+	double duration;
+
+	po::variables_map vm;
+
+	try
+	{
+		po::options_description desc("shadertoy-connector client");
+		desc.add_options()
+			("help,h", "Show this help message")
+			("debug,d", po::bool_switch(&debug_mode)->default_value(false), "Enable debug output")
+			("target,t", po::value<std::string>(&target)->default_value("tcp://localhost:13710"), "Server endpoint")
+			("workload,w", po::value<std::string>(&workload_path), "Workload description file, enables load generation")
+			("connections,c", po::value<size_t>(&connections), "Number of concurrent connections (overrides the workload)")
+			("duration", po::value<double>(&duration), "Run duration in seconds (overrides the workload)")
+			("requests,n", po::value<size_t>(&requests), "Total number of requests (overrides the workload)")
+			("output,o", po::value<std::string>(&output_path)->default_value(""), "JSON report file");
+
+		po::store(po::parse_command_line(argc, argv, desc), vm);
+		po::notify(vm);
+
+		if (vm.count("help"))
+		{
+			std::cout << desc << std::endl;
+			return 0;
+		}
+	}
+	catch (const po::error &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+
+	spdlog::set_level(debug_mode ? spdlog::level::debug : spdlog::level::warn);
+
+	try
+	{
+		if (!vm.count("workload"))
+		{
+			spdlog::set_level(spdlog::level::debug);
+			return run_smoke_test(target);
+		}
+
+		auto wl(load_workload(workload_path));
+
+		if (vm.count("connections"))
+			wl.connections = connections;
+		if (vm.count("duration"))
+			wl.duration = duration;
+		if (vm.count("requests"))
+			wl.requests = requests;
+
+		if (wl.duration <= 0 && wl.requests == 0)
+			throw std::runtime_error("Either a duration or a request count must be specified");
+
+		return run_load(wl, target, output_path);
+	}
+	catch (std::exception &ex)
+	{
+		std::cerr << ex.what() << std::endl;
+		return 1;
+	}
+}
@@ -1,7 +1,24 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <utility>
 
 #include "stc/client/net_host.hpp"
+#include "stc/net/codec.hpp"
 #include "stc/net/io.hpp"
+#include "stc/net/multipart.hpp"
+#include "stc/net/protocol.hpp"
+#include "stc/net/sha256.hpp"
+#include "stc/net/shm_ring.hpp"
 
 #include <zmq.hpp>
 
@@ -18,30 +35,1142 @@ namespace stc
 namespace client
 {
 
+static std::shared_ptr<spdlog::logger> client_logger()
+{
+	// Several hosts may share the same logger
+	auto log(spdlog::get("shadertoy-client"));
+	if (!log)
+		log = spdlog::stderr_color_mt("shadertoy-client");
+	return log;
+}
+
 struct net_host_impl
 {
+	/// Number of delta bases kept per context, so replies to pipelined
+	/// requests can still be decoded
+	static constexpr size_t max_delta_bases = 4;
+
+	/// Default size of the shared memory ring, in MiB
+	static constexpr size_t default_shm_size = 256;
+
 	const std::string target_address;
 
+	/// Codec requested for rendered frames
+	net::codec codec;
+
+	/// true unless the string protocol was forced with protocol=legacy
+	bool allow_binary;
+
+	/// Version the server answered to hello, 0 if it predates negotiation
+	uint8_t server_version;
+
+	/// Binary protocol version agreed with the server, 0 for the string protocol
+	uint8_t protocol_version;
+
+	/// true unless content addressing was disabled with blobs=off
+	bool use_blobs;
+
+	/// Size from which sources and input images are sent as blobs, in bytes
+	static constexpr size_t blob_threshold = 4096;
+
+	/**
+	 * Blob referenced by a request by its SHA-256 digest, uploaded only if
+	 * the server does not have it yet
+	 */
+	struct blob_ref
+	{
+		std::string digest;
+		/// Contents of the blob, either floats or bytes
+		std::shared_ptr<core::image_data> floats;
+		std::shared_ptr<std::vector<char>> bytes;
+	};
+
+	/// Shared memory ring frames are received through, for shm:// targets
+	bool use_shm;
+	size_t shm_size;
+	std::unique_ptr<net::shm_ring> ring;
+
 	zmq::context_t context;
+
+	/// DEALER socket connected to the server, only used by the I/O thread
 	zmq::socket_t socket;
 
+	/// Pipe from the calling threads to the I/O thread
+	zmq::socket_t pipe_in;
+	zmq::socket_t pipe_out;
+
+	/// SUB socket receiving the frames of subscriptions, only used by the I/O thread
+	zmq::socket_t stream_socket;
+	std::set<std::string> publishers;
+
+	/// Pipe for subscription commands to the I/O thread, guarded by send_mutex
+	zmq::socket_t control_in;
+	zmq::socket_t control_out;
+
 	std::shared_ptr<spdlog::logger> log;
 
+	/// Writes requests to pipe_out, guarded by send_mutex
 	net::io io;
+	std::mutex send_mutex;
+	uint64_t next_request_id;
+
+	/// Request id of lease renewals, sent by the I/O thread itself
+	static constexpr uint64_t renew_request_id = std::numeric_limits<uint64_t>::max();
+
+	/// Id of the request being written by send, guarded by send_mutex
+	uint64_t sending_request_id;
+
+	/// Replies of the requests in flight, by request id
+	std::map<uint64_t, std::promise<std::vector<zmq::message_t>>> pending;
+	std::mutex pending_mutex;
+
+	std::thread io_thread;
+	std::atomic<bool> running;
+
+	/// Storage of the last received frame, reused once the caller released it
+	std::shared_ptr<core::image_data> spare_frame;
+	std::mutex frame_mutex;
+
+	/// Active subscription of this host
+	struct subscription
+	{
+		std::string context_id;
+		std::string topic;
+		net_host::frame_callback callback;
+		/// Lease of the stream on the server, zero if it does not expire
+		std::chrono::milliseconds lease;
+		/// Time the lease is renewed next
+		std::chrono::steady_clock::time_point renewal;
+	};
+
+	/// Active subscriptions, by stream id
+	std::map<std::string, subscription> subscriptions;
+	std::mutex subscription_mutex;
+
+	/// Frames received with a delta codec, by context id and sequence number
+	std::map<std::string, std::map<uint64_t, std::shared_ptr<core::image_data>>> delta_bases;
+	std::mutex delta_mutex;
+
+	/// Render request sent ahead of the next render call
+	struct ahead_frame
+	{
+		std::string id;
+		/// Frame number, or no value if the server picks the next frame
+		boost::optional<int> frame;
+		size_t width, height;
+		std::array<float, 4> mouse;
+		GLenum format;
+		std::future<core::image> result;
+	};
+
+	/// Contexts rendered ahead, and the request sent ahead if any
+	std::set<std::string> render_ahead_ids;
+	std::unique_ptr<ahead_frame> ahead;
+	std::mutex ahead_mutex;
+
+	/// Removes the request sent ahead. Its reply is dropped when it arrives.
+	std::unique_ptr<ahead_frame> take_ahead()
+	{
+		std::lock_guard<std::mutex> guard(ahead_mutex);
+		return std::move(ahead);
+	}
+
+	/**
+	 * Returns the control endpoint of a target. shm://path targets are
+	 * controlled over ipc://path.
+	 */
+	static std::string control_address(const std::string &target)
+	{
+		auto address(target.substr(0, target.find('?')));
+
+		if (address.compare(0, 6, "shm://") == 0)
+			return std::string("ipc://") + address.substr(6);
+
+		return address;
+	}
 
 	net_host_impl(const std::string &target)
-		: target_address(target),
+		: target_address(control_address(target)),
+		codec(net::codec::none),
+		allow_binary(true),
+		server_version(0),
+		protocol_version(0),
+		use_blobs(true),
+		use_shm(target.compare(0, 6, "shm://") == 0),
+		shm_size(default_shm_size),
+		ring(),
 		context(1),
-		socket(context, ZMQ_REQ),
-		log(spdlog::stderr_color_mt("shadertoy-client")),
-		io(log, socket)
+		socket(context, ZMQ_DEALER),
+		pipe_in(context, ZMQ_PAIR),
+		pipe_out(context, ZMQ_PAIR),
+		stream_socket(context, ZMQ_SUB),
+		control_in(context, ZMQ_PAIR),
+		control_out(context, ZMQ_PAIR),
+		log(client_logger()),
+		io(log, pipe_out),
+		next_request_id(0),
+		sending_request_id(0),
+		running(false)
 	{
+		parse_options(target);
+	}
+
+	/**
+	 * Parses the options following the target address, as in
+	 * tcp://host:port?codec=delta-lz4
+	 */
+	void parse_options(const std::string &target)
+	{
+		auto query = target.find('?');
+		if (query == std::string::npos)
+			return;
+
+		std::stringstream ss(target.substr(query + 1));
+		std::string option;
+
+		while (std::getline(ss, option, '&'))
+		{
+			auto eq = option.find('=');
+			auto key(option.substr(0, eq));
+			auto value(eq == std::string::npos ? std::string() : option.substr(eq + 1));
+
+			if (key.compare("codec") == 0)
+			{
+				codec = net::parse_codec(value);
+
+				if (!net::codec_supported(codec))
+				{
+					std::stringstream err;
+					err << "Codec " << value << " is not supported by this build";
+					throw std::runtime_error(err.str());
+				}
+			}
+			else if (key.compare("protocol") == 0)
+			{
+				if (value.compare("legacy") == 0)
+				{
+					allow_binary = false;
+				}
+				else if (value.compare("binary") != 0)
+				{
+					std::stringstream err;
+					err << "Unknown protocol " << value;
+					throw std::runtime_error(err.str());
+				}
+			}
+			else if (key.compare("blobs") == 0)
+			{
+				use_blobs = value.compare("off") != 0;
+			}
+			else if (key.compare("shm_size") == 0)
+			{
+				shm_size = std::stoul(value);
+			}
+			else
+			{
+				std::stringstream err;
+				err << "Unknown renderer option '" << key << "'";
+				throw std::runtime_error(err.str());
+			}
+		}
+	}
+
+	/**
+	 * @brief Returns the sequence number of the most recent delta base of a
+	 * context, or 0 if there is none.
+	 */
+	uint64_t last_delta_base(const std::string &id)
+	{
+		std::lock_guard<std::mutex> guard(delta_mutex);
+
+		auto it = delta_bases.find(id);
+		if (it == delta_bases.end() || it->second.empty())
+			return 0;
+
+		return it->second.rbegin()->first;
+	}
+
+	/**
+	 * @brief Receives an encoded frame into an image
+	 *
+	 * @param id            Context the frame was rendered for
+	 * @param requested     Codec requested for this frame
+	 * @param base_sequence Sequence number of the base sent with the request
+	 * @param reader        Reader positioned on the encoding details
+	 * @param result        Image to receive the frame into
+	 */
+	void recv_encoded(const std::string &id, net::codec requested, uint64_t base_sequence,
+					  net::message_reader &reader, core::image &result)
+	{
+		auto used(static_cast<net::codec>(reader.recv_data<uint8_t>()));
+		auto sequence(reader.recv_data<uint64_t>());
+		reader.recv_data_noout(result.dims);
+
+		// The payload is either in the reply or in the shared memory ring
+		bool in_ring = ring && reader.recv_data<uint8_t>() != 0;
+		net::shm_slot slot;
+
+		if (in_ring)
+			reader.recv_data_noout(slot);
+
+		decode_payload(id, requested, base_sequence, used, sequence, in_ring ? &slot : nullptr, reader, result);
+	}
+
+	/**
+	 * @brief Decodes the payload of an encoded frame, once its encoding
+	 * details have been read
+	 *
+	 * @param id            Context the frame was rendered for
+	 * @param requested     Codec requested for this frame
+	 * @param base_sequence Sequence number of the base sent with the request
+	 * @param used          Codec the server used for this frame
+	 * @param sequence      Sequence number of this frame
+	 * @param slot          Location of the payload in the shared memory ring,
+	 *                      null if the payload is the next frame of the reply
+	 * @param reader        Reader positioned on the payload
+	 * @param result        Image to receive the frame into, with its dims set
+	 */
+	void decode_payload(const std::string &id, net::codec requested, uint64_t base_sequence, net::codec used,
+						uint64_t sequence, const net::shm_slot *slot, net::message_reader &reader,
+						core::image &result)
+	{
+		const void *src;
+		size_t size;
+
+		if (slot)
+		{
+			if (!ring)
+				throw std::runtime_error("Frame sent through shared memory without a ring");
+
+			src = ring->data(*slot);
+			size = slot->size;
+		}
+		else
+		{
+			const auto &payload(reader.recv_message());
+			src = payload.data();
+			size = payload.size();
+		}
+
+		result.alloc();
+
+		std::lock_guard<std::mutex> guard(delta_mutex);
+		auto &bases(delta_bases[id]);
+
+		const core::image_data *base = nullptr;
+		if (net::codec_is_delta(used))
+		{
+			auto it = bases.find(base_sequence);
+			if (it == bases.end())
+				throw std::runtime_error("Missing delta base frame");
+
+			base = it->second.get();
+		}
+
+		try
+		{
+			net::decode_frame(used, src, size, base, *result.data);
+		}
+		catch (std::exception &)
+		{
+			// Decoding errors are expected if the payload was overwritten
+			if (!slot || ring->valid(*slot))
+				throw;
+		}
+
+		if (slot && !ring->valid(*slot))
+			throw std::runtime_error("Frame was overwritten in shared memory before it was read, increase shm_size");
+
+		if (net::codec_is_delta(requested))
+		{
+			// Bases from another epoch were sent by a server which does not
+			// render this context anymore, and they would be mistaken for the
+			// most recent ones
+			if (!bases.empty() && net::sequence_epoch(bases.rbegin()->first) != net::sequence_epoch(sequence))
+				bases.clear();
+
+			bases[sequence] = result.data;
+
+			while (bases.size() > max_delta_bases)
+				bases.erase(bases.begin());
+		}
+	}
+
+	/// Receives the next frame into the previous frame storage if nobody else uses it
+	void reuse_frame(core::image &result)
+	{
+		std::lock_guard<std::mutex> guard(frame_mutex);
+		if (spare_frame.use_count() == 1)
+			result.data = std::move(spare_frame);
+	}
+
+	/// Keeps the storage of a received frame for reuse
+	void keep_frame(const core::image &result)
+	{
+		std::lock_guard<std::mutex> guard(frame_mutex);
+		spare_frame = result.data;
+	}
+
+	/**
+	 * @brief Packs the arguments of a binary render request
+	 *
+	 * @return Sequence number of the delta base sent with the request
+	 */
+	uint64_t write_render_args(net::binary_writer &args, const std::string &id, int32_t frame, size_t width,
+							   size_t height, const std::array<float, 4> &mouse, GLenum format)
+	{
+		uint64_t base_sequence = net::codec_is_delta(codec) ? last_delta_base(id) : 0;
+
+		args.write<int32_t>(frame);
+		args.write<uint32_t>(width);
+		args.write<uint32_t>(height);
+		args.write(mouse);
+		args.write<int32_t>(format);
+		args.write<uint8_t>(static_cast<uint8_t>(codec));
+		args.write(base_sequence);
+		args.write_string(ring ? ring->name() : std::string());
+
+		return base_sequence;
+	}
+
+	/**
+	 * @brief Receives a frame from a binary render reply
+	 *
+	 * @param id            Context the frame was rendered for
+	 * @param requested     Codec requested for this frame
+	 * @param base_sequence Sequence number of the base sent with the request
+	 * @param reply         Reader positioned on the encoding details
+	 * @param reader        Reader positioned on the payload frame
+	 * @return              Rendered frame
+	 */
+	core::image read_rendered(const std::string &id, net::codec requested, uint64_t base_sequence,
+							  net::binary_reader &reply, net::message_reader &reader)
+	{
+		core::image result;
+		reuse_frame(result);
+
+		result.frame_timing = reply.read<uint64_t>();
+		auto used(static_cast<net::codec>(reply.read<uint8_t>()));
+		auto sequence(reply.read<uint64_t>());
+		result.dims = reply.read<std::array<uint32_t, 3>>();
+
+		// The payload is either in the reply or in the shared memory ring
+		bool in_ring = reply.read<uint8_t>() != 0;
+		net::shm_slot slot;
+
+		if (in_ring)
+			slot = reply.read<net::shm_slot>();
+
+		decode_payload(id, requested, base_sequence, used, sequence, in_ring ? &slot : nullptr, reader, result);
+
+		keep_frame(result);
+		return result;
+	}
+
+	/**
+	 * @brief Executes a run of batch operations on a single context with one
+	 * binary request
+	 *
+	 * @param begin First operation of the run
+	 * @param end   End of the run
+	 * @return      Frames rendered by the run
+	 * @throws core::batch_error if the server reports a failed operation
+	 */
+	std::vector<core::image> execute_run(std::vector<core::batch_op>::const_iterator begin,
+										 std::vector<core::batch_op>::const_iterator end)
+	{
+		const auto &id(begin->id);
+
+		net::binary_writer args;
+		args.write<uint32_t>(end - begin);
+
+		// Images are sent as payload frames in order, or as blobs
+		std::vector<std::shared_ptr<core::image_data>> payloads;
+		std::vector<blob_ref> blobs;
+
+		// Base sequence of each render, to decode delta frames
+		std::vector<uint64_t> bases;
+
+		for (auto it = begin; it != end; ++it)
+		{
+			args.write<uint8_t>(static_cast<uint8_t>(it->kind));
+
+			switch (it->kind)
+			{
+			case core::batch_kind::render:
+				// Renders after the first one refer to the same base, which the
+				// server then replaces with a keyframe
+				bases.push_back(write_render_args(args, id, it->frame.get_value_or(std::numeric_limits<int>::min()),
+												  it->width, it->height, it->mouse, it->format));
+				break;
+
+			case core::batch_kind::reset:
+				break;
+
+			default:
+				args.write_string(it->buffer);
+				args.write<uint8_t>(it->channel);
+
+				if (it->kind == core::batch_kind::set_input_filter)
+				{
+					args.write<int32_t>(it->min_filter);
+				}
+				else if (it->kind == core::batch_kind::set_input)
+				{
+					write_input(args, it->input, payloads, blobs);
+				}
+				break;
+			}
+		}
+
+		return request_binary(net::opcode::batch, id, args,
+							  [this, id, bases](const std::string &, net::binary_reader &reply,
+												net::message_reader &reader) {
+			auto frame_count(reply.read<uint32_t>());
+			if (frame_count > bases.size())
+				throw std::runtime_error("Unexpected number of frames in batch reply");
+
+			std::vector<core::image> results;
+			for (auto i = 0u; i < frame_count; ++i)
+				results.emplace_back(read_rendered(id, codec, bases[i], reply, reader));
+
+			if (protocol_version >= 6 && reply.read<uint8_t>() != 0)
+			{
+				auto index(reply.read<uint32_t>());
+				auto message(reply.read_string());
+				throw core::batch_error(index, message, std::move(results));
+			}
+
+			return results;
+		}, payloads, blobs).get();
+	}
+
+	/// Maps the shared memory ring on the server side
+	void attach_ring()
+	{
+		ring = std::make_unique<net::shm_ring>(shm_size << 20);
+
+		try
+		{
+			request([this](net::io &io) {
+				io.send_string("attach_shm", ZMQ_SNDMORE);
+				io.send_string(ring->name());
+			}, [](net::message_reader &) {
+			}).get();
+		}
+		catch (...)
+		{
+			ring->unlink();
+			ring.reset();
+			throw;
+		}
+
+		// Both processes have mapped the ring, its name is not needed anymore
+		ring->unlink();
+		log->info("Receiving frames through shared memory {}", ring->name());
+	}
+
+	/// Unmaps the shared memory ring on the server side, waiting a bounded time
+	void detach_ring()
+	{
+		auto reply(send([this](net::io &io) {
+			io.send_string("detach_shm", ZMQ_SNDMORE);
+			io.send_string(ring->name());
+		}));
+
+		if (reply.wait_for(std::chrono::seconds(1)) != std::future_status::ready)
+			log->warn("Server did not acknowledge the release of {}", ring->name());
+	}
+
+	~net_host_impl()
+	{
+		if (running)
+		{
+			cancel_subscriptions();
+
+			if (ring)
+				detach_ring();
+		}
+
+		running = false;
+
+		if (io_thread.joinable())
+			io_thread.join();
 	}
 
 	void connect()
 	{
+		std::stringstream pipe_address;
+		pipe_address << "inproc://stc-client-" << static_cast<void *>(this);
+
+		pipe_in.bind(pipe_address.str());
+		pipe_out.connect(pipe_address.str());
+
+		std::stringstream control_address;
+		control_address << "inproc://stc-client-control-" << static_cast<void *>(this);
+
+		control_in.bind(control_address.str());
+		control_out.connect(control_address.str());
+
+		// Keep few frames in queue, so slow subscribers drop frames instead of lagging
+		int hwm = 2;
+		stream_socket.setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
+
 		log->info("Connecting to {}", target_address);
 		socket.connect(target_address);
+
+		running = true;
+		io_thread = std::thread([this]() { run_io(); });
+	}
+
+	/**
+	 * Agrees on the binary protocol version with the server. Servers which
+	 * predate the binary protocol answer the hello request with an unknown
+	 * request error, and are then spoken to with the string protocol.
+	 *
+	 * The hello request is a single frame: servers which predate it reply to
+	 * unknown requests before reading the rest of the message, which their
+	 * socket does not allow.
+	 *
+	 * The hello request is also sent when the string protocol is forced, as
+	 * it tells whether the server understands the encoding details appended
+	 * to string render requests. Servers which do not answer it would read
+	 * them as the next request, so frames are then received raw.
+	 */
+	void negotiate()
+	{
+		try
+		{
+			server_version = request([](net::io &io) {
+				io.send_string("hello");
+			}, [](net::message_reader &reader) {
+				return std::min(reader.recv_data<uint8_t>(), net::binary_version);
+			}).get();
+		}
+		catch (std::runtime_error &ex)
+		{
+			log->info("Server does not support the binary protocol: {}", ex.what());
+			server_version = 0;
+		}
+
+		protocol_version = allow_binary ? server_version : 0;
+		log->info("Using protocol version {}", static_cast<int>(protocol_version));
+
+		if (server_version == 0 && codec != net::codec::none)
+		{
+			log->warn("Server does not support frame codecs, receiving raw frames");
+			codec = net::codec::none;
+		}
+	}
+
+	/// true if requests use the binary protocol
+	inline bool binary() const
+	{ return protocol_version > 0; }
+
+	/// true if an operation is sent with the binary protocol
+	inline bool binary(net::opcode op) const
+	{ return binary() && protocol_version >= net::opcode_version(op); }
+
+	/// true if sources and input images may be sent as blobs
+	inline bool blobs_enabled() const
+	{ return use_blobs && protocol_version >= 2; }
+
+	static void forward(zmq::socket_t &from, zmq::socket_t &to)
+	{
+		int more;
+		do
+		{
+			zmq::message_t part;
+			from.recv(&part);
+
+			size_t opt = sizeof(int);
+			from.getsockopt(ZMQ_RCVMORE, &more, &opt);
+
+			to.send(part, more ? ZMQ_SNDMORE : 0);
+		}
+		while (more);
+	}
+
+	void handle_reply()
+	{
+		std::vector<zmq::message_t> parts;
+
+		int more;
+		do
+		{
+			parts.emplace_back();
+			socket.recv(&parts.back());
+
+			size_t opt = sizeof(int);
+			socket.getsockopt(ZMQ_RCVMORE, &more, &opt);
+		}
+		while (more);
+
+		// Replies are prefixed by the request id and the empty delimiter
+		uint64_t request_id;
+		if (parts.size() < 2 || parts[0].size() != sizeof(request_id) || parts[1].size() != 0)
+		{
+			log->error("Dropping malformed reply");
+			return;
+		}
+
+		memcpy(&request_id, parts[0].data(), sizeof(request_id));
+		parts.erase(parts.begin(), parts.begin() + 2);
+
+		if (request_id == renew_request_id)
+		{
+			// Streams which completed cannot be renewed, this is expected
+			if (parts.size() >= 2 && net::part_string(parts[0]).compare("ERROR") == 0)
+				log->debug("Could not renew stream: {}", net::part_string(parts[1]));
+			return;
+		}
+
+		std::lock_guard<std::mutex> guard(pending_mutex);
+		auto it = pending.find(request_id);
+		if (it == pending.end())
+		{
+			log->error("Dropping reply to unknown request {}", request_id);
+			return;
+		}
+
+		it->second.set_value(std::move(parts));
+		pending.erase(it);
+	}
+
+	/**
+	 * Resolves the publish endpoint sent by the server, which is bound on all
+	 * interfaces, to the host the server was reached at.
+	 */
+	std::string resolve_publisher(const std::string &endpoint) const
+	{
+		auto scheme = endpoint.find("://");
+		if (scheme == std::string::npos)
+			return endpoint;
+
+		auto host_start = scheme + 3;
+		auto host_end = endpoint.rfind(':');
+		if (host_end == std::string::npos || host_end < host_start)
+			return endpoint;
+
+		auto host(endpoint.substr(host_start, host_end - host_start));
+		if (host.compare("*") != 0 && host.compare("0.0.0.0") != 0)
+			return endpoint;
+
+		// Servers reached over ipc run on this host
+		if (target_address.compare(0, 6, "tcp://") != 0)
+			return endpoint.substr(0, host_start) + "127.0.0.1" + endpoint.substr(host_end);
+
+		auto target_start = target_address.find("://");
+		auto target_end = target_address.rfind(':');
+		if (target_start == std::string::npos || target_end == std::string::npos || target_end < target_start + 3)
+			return endpoint;
+
+		return endpoint.substr(0, host_start) +
+			   target_address.substr(target_start + 3, target_end - target_start - 3) +
+			   endpoint.substr(host_end);
+	}
+
+	/// Applies a subscription command sent by a calling thread
+	void handle_control()
+	{
+		zmq::message_t command, endpoint, topic;
+		control_in.recv(&command);
+		control_in.recv(&endpoint);
+		control_in.recv(&topic);
+
+		std::string endpoint_str(static_cast<const char *>(endpoint.data()), endpoint.size());
+
+		if (command.size() == 1 && *static_cast<const char *>(command.data()) == '+')
+		{
+			if (publishers.insert(endpoint_str).second)
+			{
+				log->info("Connecting to publisher {}", endpoint_str);
+				stream_socket.connect(endpoint_str);
+			}
+
+			stream_socket.setsockopt(ZMQ_SUBSCRIBE, topic.data(), topic.size());
+		}
+		else
+		{
+			stream_socket.setsockopt(ZMQ_UNSUBSCRIBE, topic.data(), topic.size());
+		}
+	}
+
+	/// Decodes a published frame and hands it to its subscription callback
+	void handle_stream()
+	{
+		std::vector<zmq::message_t> parts;
+
+		int more;
+		do
+		{
+			parts.emplace_back();
+			stream_socket.recv(&parts.back());
+
+			size_t opt = sizeof(int);
+			stream_socket.getsockopt(ZMQ_RCVMORE, &more, &opt);
+		}
+		while (more);
+
+		try
+		{
+			net::message_reader reader(log, std::move(parts));
+
+			auto topic(reader.recv_string());
+			auto sequence(reader.recv_data<uint64_t>());
+
+			core::image frame;
+			reader.recv_data(frame.frame_timing);
+			auto used(static_cast<net::codec>(reader.recv_data<uint8_t>()));
+			reader.recv_data_noout(frame.dims);
+			const auto &payload(reader.recv_message());
+
+			frame.alloc();
+			net::decode_frame(used, payload.data(), payload.size(), nullptr, *frame.data);
+
+			// Hold the lock during the callback, so unsubscribe waits for it
+			std::lock_guard<std::mutex> guard(subscription_mutex);
+			for (const auto &pair : subscriptions)
+			{
+				if (pair.second.topic.compare(topic) == 0)
+				{
+					pair.second.callback(sequence, frame);
+					break;
+				}
+			}
+		}
+		catch (std::exception &ex)
+		{
+			log->error("Dropping stream frame: {}", ex.what());
+		}
+	}
+
+	/**
+	 * Sends a subscription command to the I/O thread.
+	 *
+	 * @param subscribe true to subscribe to the topic, false to unsubscribe
+	 * @param endpoint  Publish endpoint of the server
+	 * @param topic     Topic of the stream
+	 */
+	void send_control(bool subscribe, const std::string &endpoint, const std::string &topic)
+	{
+		std::lock_guard<std::mutex> guard(send_mutex);
+
+		zmq::message_t command(1), endpoint_msg(endpoint.size()), topic_msg(topic.size());
+		*static_cast<char *>(command.data()) = subscribe ? '+' : '-';
+		memcpy(endpoint_msg.data(), endpoint.data(), endpoint.size());
+		memcpy(topic_msg.data(), topic.data(), topic.size());
+
+		control_out.send(command, ZMQ_SNDMORE);
+		control_out.send(endpoint_msg, ZMQ_SNDMORE);
+		control_out.send(topic_msg);
+	}
+
+	void run_io()
+	{
+		zmq::pollitem_t items[] = {
+			{ static_cast<void *>(pipe_in), 0, ZMQ_POLLIN, 0 },
+			{ static_cast<void *>(socket), 0, ZMQ_POLLIN, 0 },
+			{ static_cast<void *>(control_in), 0, ZMQ_POLLIN, 0 },
+			{ static_cast<void *>(stream_socket), 0, ZMQ_POLLIN, 0 }
+		};
+
+		while (running)
+		{
+			try
+			{
+				zmq::poll(&items[0], sizeof(items) / sizeof(items[0]), 100);
+			}
+			catch (zmq::error_t &e)
+			{
+				log->warn("zmq::poll: {}", e.what());
+				continue;
+			}
+
+			if (items[0].revents & ZMQ_POLLIN)
+				forward(pipe_in, socket);
+
+			if (items[1].revents & ZMQ_POLLIN)
+				handle_reply();
+
+			if (items[2].revents & ZMQ_POLLIN)
+				handle_control();
+
+			if (items[3].revents & ZMQ_POLLIN)
+				handle_stream();
+
+			renew_subscriptions();
+		}
+	}
+
+	/// Renews the leases of the streams which are due, so the server keeps
+	/// rendering them. Replies are not waited for.
+	void renew_subscriptions()
+	{
+		auto now(std::chrono::steady_clock::now());
+		std::vector<std::pair<std::string, std::string>> due;
+
+		{
+			std::lock_guard<std::mutex> guard(subscription_mutex);
+			for (auto &pair : subscriptions)
+			{
+				if (pair.second.lease.count() == 0 || pair.second.renewal > now)
+					continue;
+
+				// Three attempts before the lease runs out
+				pair.second.renewal = now + pair.second.lease / 3;
+				due.emplace_back(pair.second.context_id, pair.first);
+			}
+		}
+
+		// The I/O thread only forwards whole requests, so it can send its own
+		// between them, without taking send_mutex
+		for (const auto &stream : due)
+		{
+			std::vector<std::string> request{ "renew", stream.first, stream.second };
+
+			zmq::message_t request_id(sizeof(renew_request_id)), delimiter;
+			memcpy(request_id.data(), &renew_request_id, sizeof(renew_request_id));
+			socket.send(request_id, ZMQ_SNDMORE);
+			socket.send(delimiter, ZMQ_SNDMORE);
+
+			for (size_t i = 0; i < request.size(); ++i)
+			{
+				zmq::message_t part(request[i].size());
+				memcpy(part.data(), request[i].data(), request[i].size());
+				socket.send(part, i + 1 < request.size() ? ZMQ_SNDMORE : 0);
+			}
+		}
+	}
+
+	/**
+	 * Sends a request and returns a future for its raw reply.
+	 *
+	 * @param build Writes the request frames to the given io
+	 */
+	template <typename Build>
+	std::future<std::vector<zmq::message_t>> send(Build &&build)
+	{
+		std::future<std::vector<zmq::message_t>> reply;
+
+		std::lock_guard<std::mutex> guard(send_mutex);
+		uint64_t request_id = next_request_id++;
+		sending_request_id = request_id;
+
+		{
+			std::lock_guard<std::mutex> pending_guard(pending_mutex);
+			reply = pending[request_id].get_future();
+		}
+
+		// Routing envelope, echoed back by the server
+		io.send_data(request_id, ZMQ_SNDMORE);
+		io.send_empty(ZMQ_SNDMORE);
+
+		build(io);
+
+		return reply;
+	}
+
+	/**
+	 * Sends a request and returns a future for its parsed reply.
+	 *
+	 * @param build Writes the request frames to the given io
+	 * @param parse Parses the reply from a message_reader, on the thread which
+	 *              waits on the returned future
+	 */
+	template <typename Build, typename Parse>
+	auto request(Build &&build, Parse parse) -> std::future<decltype(parse(std::declval<net::message_reader &>()))>
+	{
+		auto reply(send(std::forward<Build>(build)));
+
+		return std::async(std::launch::deferred, [this, parse, reply = std::move(reply)]() mutable {
+			net::message_reader reader(log, reply.get());
+
+			auto status(reader.recv_string());
+			if (status.compare("ERROR") == 0)
+			{
+				throw std::runtime_error(reader.recv_string());
+			}
+
+			return parse(reader);
+		});
+	}
+
+	/**
+	 * Sends a binary protocol request and returns a future for its raw reply.
+	 *
+	 * @param op       Operation
+	 * @param id       Context id
+	 * @param args     Packed arguments
+	 * @param payloads Bulk payloads sent after the header frame, one frame each
+	 * @param attached Blobs attached to the request, sent before the payloads
+	 */
+	std::future<std::vector<zmq::message_t>> send_binary(net::opcode op, const std::string &id,
+														 const net::binary_writer &args,
+														 const std::vector<std::shared_ptr<core::image_data>> &payloads,
+														 const std::vector<const blob_ref *> &attached)
+	{
+		return send([&](net::io &io) {
+			auto frame(net::make_binary_frame(op, attached.empty() ? 0 : net::flag_blobs, sending_request_id, id,
+											  args, protocol_version));
+			io.send_message(frame, payloads.empty() && attached.empty() ? 0 : ZMQ_SNDMORE);
+
+			if (!attached.empty())
+			{
+				io.send_data<uint32_t>(attached.size(), ZMQ_SNDMORE);
+
+				for (size_t i = 0; i < attached.size(); ++i)
+				{
+					int flags = i + 1 < attached.size() || !payloads.empty() ? ZMQ_SNDMORE : 0;
+
+					if (attached[i]->floats)
+						io.send_shared_buf(attached[i]->floats, flags);
+					else
+						io.send_shared_buf(attached[i]->bytes, flags);
+				}
+			}
+
+			for (size_t i = 0; i < payloads.size(); ++i)
+				io.send_shared_buf(payloads[i], i + 1 < payloads.size() ? ZMQ_SNDMORE : 0);
+		});
+	}
+
+	/**
+	 * Sends a binary protocol request and returns a future for its parsed
+	 * reply. If the server is missing some of the blobs the request
+	 * references, the request is sent again with these blobs attached.
+	 *
+	 * @param op       Operation
+	 * @param id       Context id
+	 * @param args     Packed arguments
+	 * @param parse    Parses the reply from its context id, its arguments and
+	 *                 a reader positioned on its payload frames
+	 * @param payloads Bulk payloads sent after the header frame, one frame each
+	 * @param blobs    Blobs referenced by the request
+	 */
+	template <typename Parse>
+	auto request_binary(net::opcode op, const std::string &id, const net::binary_writer &args, Parse parse,
+						const std::vector<std::shared_ptr<core::image_data>> &payloads = {},
+						const std::vector<blob_ref> &blobs = {})
+		-> std::future<decltype(parse(std::declval<const std::string &>(), std::declval<net::binary_reader &>(),
+									  std::declval<net::message_reader &>()))>
+	{
+		auto reply(send_binary(op, id, args, payloads, {}));
+
+		return std::async(std::launch::deferred, [this, op, id, args, parse, payloads, blobs,
+												  reply = std::move(reply)]() mutable {
+			auto parts(reply.get());
+			if (parts.empty())
+				throw std::runtime_error("Empty reply");
+
+			net::frame_header header;
+			std::string reply_id;
+			auto reply_args(net::parse_binary_frame(parts[0], header, reply_id));
+
+			if (header.flags & net::flag_missing)
+			{
+				// Upload the blobs the server does not have along with the request
+				std::vector<const blob_ref *> attached;
+
+				for (auto count = reply_args.read<uint32_t>(); count > 0; --count)
+				{
+					auto digest(reply_args.read_string());
+					auto it = std::find_if(blobs.begin(), blobs.end(), [&digest](const blob_ref &blob) {
+						return blob.digest.compare(digest) == 0;
+					});
+
+					if (it == blobs.end())
+						throw std::runtime_error("Server asked for an unknown blob");
+
+					attached.push_back(&*it);
+				}
+
+				log->info("Uploading {} blobs", attached.size());
+				parts = send_binary(op, id, args, payloads, attached).get();
+			}
+
+			net::message_reader reader(log, std::move(parts));
+			reply_args = net::parse_binary_frame(reader.recv_message(), header, reply_id);
+
+			if (header.flags & net::flag_missing)
+				throw std::runtime_error("Server could not keep the uploaded blobs, increase its --blob-cache");
+
+			if (header.flags & net::flag_error)
+			{
+				throw std::runtime_error(reply_args.read_string());
+			}
+
+			return parse(reply_id, reply_args, reader);
+		});
+	}
+
+	/**
+	 * @brief Packs the value of an input. Large images are sent as blobs if
+	 * they are enabled, other images as payloads.
+	 *
+	 * @param args     Arguments to pack the value into
+	 * @param input    Value of the input
+	 * @param payloads Payloads of the request
+	 * @param blobs    Blobs referenced by the request
+	 */
+	void write_input(net::binary_writer &args, const boost::variant<std::string, std::shared_ptr<core::image>> &input,
+					 std::vector<std::shared_ptr<core::image_data>> &payloads, std::vector<blob_ref> &blobs)
+	{
+		if (const auto img = boost::get<const std::shared_ptr<core::image>>(&input))
+		{
+			const auto &data((*img)->data);
+			size_t bytes = data->size() * sizeof(float);
+
+			if (blobs_enabled() && bytes >= blob_threshold)
+			{
+				blob_ref blob;
+				blob.digest = net::sha256::hash(data->data(), bytes);
+				blob.floats = data;
+
+				args.write<uint8_t>(2);
+				args.write((*img)->dims);
+				args.write_string(blob.digest);
+
+				blobs.push_back(std::move(blob));
+			}
+			else
+			{
+				args.write<uint8_t>(0);
+				args.write((*img)->dims);
+				payloads.push_back(data);
+			}
+		}
+		else
+		{
+			args.write<uint8_t>(1);
+			args.write_string(boost::get<const std::string>(input));
+		}
+	}
+
+	/**
+	 * Stops the streams of the remaining subscriptions, waiting a bounded
+	 * time for the server since the host is being destroyed.
+	 */
+	void cancel_subscriptions()
+	{
+		std::map<std::string, subscription> remaining;
+
+		{
+			std::lock_guard<std::mutex> guard(subscription_mutex);
+			remaining.swap(subscriptions);
+		}
+
+		for (const auto &pair : remaining)
+		{
+			auto reply(send([&](net::io &io) {
+				io.send_string("unsubscribe", ZMQ_SNDMORE);
+				io.send_string(pair.second.context_id, ZMQ_SNDMORE);
+				io.send_string(pair.first);
+			}));
+
+			if (reply.wait_for(std::chrono::seconds(1)) != std::future_status::ready)
+				log->warn("Server did not acknowledge the end of stream {}", pair.first);
+		}
 	}
 };
 }
@@ -55,80 +1184,111 @@ net_context::net_context(const std::string &id, net_host_impl *impl)
 
 void net_context::set_input(const std::string &buffer, size_t channel, const boost::variant<std::string, std::shared_ptr<core::image>> &data)
 {
-	impl_->io.send_string("context", ZMQ_SNDMORE);
-	impl_->io.send_string(id(), ZMQ_SNDMORE);
-	impl_->io.send_string("set_input", ZMQ_SNDMORE);
-
-	// Send input specification
-	impl_->io.send_string(buffer, ZMQ_SNDMORE);
-	impl_->io.send_data<uint8_t>(channel, ZMQ_SNDMORE);
+	set_input_async(buffer, channel, data).get();
+}
 
-	// Send contents
-	if (const auto img = boost::get<const std::shared_ptr<core::image>>(&data))
-	{
-		impl_->io.send_string("image", ZMQ_SNDMORE);
-		impl_->io.send_data_noout(**img);
-	}
-	else
+std::future<void> net_context::set_input_async(const std::string &buffer, size_t channel,
+											   const boost::variant<std::string, std::shared_ptr<core::image>> &data)
+{
+	if (impl_->binary())
 	{
-		impl_->io.send_string("buffer", ZMQ_SNDMORE);
-		impl_->io.send_string(boost::get<const std::string>(data));
+		net::binary_writer args;
+		args.write_string(buffer);
+		args.write<uint8_t>(channel);
+
+		std::vector<std::shared_ptr<core::image_data>> payloads;
+		std::vector<net_host_impl::blob_ref> blobs;
+		impl_->write_input(args, data, payloads, blobs);
+
+		return impl_->request_binary(net::opcode::set_input, id(), args,
+									 [](const std::string &, net::binary_reader &, net::message_reader &) {
+			// ok, no return value
+		}, payloads, blobs);
 	}
 
-	impl_->io.recv_wait();
+	return impl_->request([&](net::io &io) {
+		io.send_string("context", ZMQ_SNDMORE);
+		io.send_string(id(), ZMQ_SNDMORE);
+		io.send_string("set_input", ZMQ_SNDMORE);
 
-	auto status(impl_->io.recv_string());
+		// Send input specification
+		io.send_string(buffer, ZMQ_SNDMORE);
+		io.send_data<uint8_t>(channel, ZMQ_SNDMORE);
 
-	if (status.compare("ERROR") == 0)
-	{
-		throw std::runtime_error(impl_->io.recv_string());
-	}
-	// else ok, no return value
+		// Send contents
+		if (const auto img = boost::get<const std::shared_ptr<core::image>>(&data))
+		{
+			io.send_string("image", ZMQ_SNDMORE);
+			io.send_data_noout(**img);
+		}
+		else
+		{
+			io.send_string("buffer", ZMQ_SNDMORE);
+			io.send_string(boost::get<const std::string>(data));
+		}
+	}, [](net::message_reader &) {
+		// ok, no return value
+	});
 }
 
 void net_context::set_input_filter(const std::string &buffer, size_t channel, GLint minFilter)
 {
-	impl_->io.send_string("context", ZMQ_SNDMORE);
-	impl_->io.send_string(id(), ZMQ_SNDMORE);
-	impl_->io.send_string("set_input_filter", ZMQ_SNDMORE);
-
-	// Send input specification
-	impl_->io.send_string(buffer, ZMQ_SNDMORE);
-	impl_->io.send_data<uint8_t>(channel, ZMQ_SNDMORE);
+	if (impl_->binary())
+	{
+		net::binary_writer args;
+		args.write_string(buffer);
+		args.write<uint8_t>(channel);
+		args.write<int32_t>(minFilter);
 
-	// Send filter
-	impl_->io.send_data<int32_t>(minFilter);
+		impl_->request_binary(net::opcode::set_input_filter, id(), args,
+							  [](const std::string &, net::binary_reader &, net::message_reader &) {
+			// ok, no return value
+		}).get();
+		return;
+	}
 
-	impl_->io.recv_wait();
+	impl_->request([&](net::io &io) {
+		io.send_string("context", ZMQ_SNDMORE);
+		io.send_string(id(), ZMQ_SNDMORE);
+		io.send_string("set_input_filter", ZMQ_SNDMORE);
 
-	auto status(impl_->io.recv_string());
+		// Send input specification
+		io.send_string(buffer, ZMQ_SNDMORE);
+		io.send_data<uint8_t>(channel, ZMQ_SNDMORE);
 
-	if (status.compare("ERROR") == 0)
-	{
-		throw std::runtime_error(impl_->io.recv_string());
-	}
-	// else ok, no return value
+		// Send filter
+		io.send_data<int32_t>(minFilter);
+	}, [](net::message_reader &) {
+		// ok, no return value
+	}).get();
 }
 
 void net_context::reset_input(const std::string &buffer, size_t channel)
 {
-	impl_->io.send_string("context", ZMQ_SNDMORE);
-	impl_->io.send_string(id(), ZMQ_SNDMORE);
-	impl_->io.send_string("reset_input", ZMQ_SNDMORE);
-
-	// Send input specification
-	impl_->io.send_string(buffer, ZMQ_SNDMORE);
-	impl_->io.send_data<uint8_t>(channel);
+	if (impl_->binary())
+	{
+		net::binary_writer args;
+		args.write_string(buffer);
+		args.write<uint8_t>(channel);
 
-	impl_->io.recv_wait();
+		impl_->request_binary(net::opcode::reset_input, id(), args,
+							  [](const std::string &, net::binary_reader &, net::message_reader &) {
+			// ok, no return value
+		}).get();
+		return;
+	}
 
-	auto status(impl_->io.recv_string());
+	impl_->request([&](net::io &io) {
+		io.send_string("context", ZMQ_SNDMORE);
+		io.send_string(id(), ZMQ_SNDMORE);
+		io.send_string("reset_input", ZMQ_SNDMORE);
 
-	if (status.compare("ERROR") == 0)
-	{
-		throw std::runtime_error(impl_->io.recv_string());
-	}
-	// else ok, no return value
+		// Send input specification
+		io.send_string(buffer, ZMQ_SNDMORE);
+		io.send_data<uint8_t>(channel);
+	}, [](net::message_reader &) {
+		// ok, no return value
+	}).get();
 }
 
 net_host::net_host(const std::string &target)
@@ -144,104 +1304,484 @@ net_host::~net_host()
 void net_host::allocate()
 {
 	impl_->connect();
+	impl_->negotiate();
+
+	if (impl_->use_shm)
+		impl_->attach_ring();
 }
 
 core::image net_host::render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
 							 const std::array<float, 4> &mouse, GLenum format)
+{
+	boost::optional<core::image> image;
+
+	if (auto ahead = impl_->take_ahead())
+	{
+		if (ahead->id == id && (!frame || frame == ahead->frame) && ahead->width == width &&
+			ahead->height == height && ahead->mouse == mouse && ahead->format == format)
+		{
+			try
+			{
+				image = ahead->result.get();
+				frame = ahead->frame;
+			}
+			catch (std::runtime_error &)
+			{
+				// Render it again below, to report the error
+			}
+		}
+
+		// The server already counted the frame rendered ahead, unless it was
+		// requested by number
+		if (!image && !frame && ahead->id == id)
+			frame = ahead->frame;
+	}
+
+	if (!image)
+		image = render_async(id, frame, width, height, mouse, format).get();
+
+	std::lock_guard<std::mutex> guard(impl_->ahead_mutex);
+	if (impl_->render_ahead_ids.count(id))
+	{
+		// Ask for the next frame now, so it is rendered while the caller
+		// processes this one
+		boost::optional<int> next;
+		if (frame)
+			next = *frame + 1;
+
+		impl_->ahead.reset(new net_host_impl::ahead_frame{ id, next, width, height, mouse, format,
+														   render_async(id, next, width, height, mouse, format) });
+	}
+
+	return *image;
+}
+
+std::future<core::image> net_host::render_async(const std::string &id, boost::optional<int> frame, size_t width,
+												size_t height, const std::array<float, 4> &mouse, GLenum format)
 {
 	int act_frame = frame.get_value_or(std::numeric_limits<int>::min());
 	impl_->log->info("render id: {} frame: {} width: {} height: {}", id, act_frame, width, height);
 
-	impl_->io.send_string("render", ZMQ_SNDMORE);
+	if (impl_->binary())
+	{
+		net::binary_writer args;
+		auto base_sequence(impl_->write_render_args(args, id, act_frame, width, height, mouse, format));
+
+		return impl_->request_binary(net::opcode::render, id, args,
+									 [impl = impl_, id, codec = impl_->codec, base_sequence](
+										 const std::string &, net::binary_reader &reply, net::message_reader &reader) {
+			return impl->read_rendered(id, codec, base_sequence, reply, reader);
+		});
+	}
+
+	auto codec(impl_->codec);
+	uint64_t base_sequence = net::codec_is_delta(codec) ? impl_->last_delta_base(id) : 0;
+
+	// Encoding details are needed to receive the frame through shared memory
+	bool encoded = codec != net::codec::none || impl_->ring;
+
+	return impl_->request([&](net::io &io) {
+		io.send_string("render", ZMQ_SNDMORE);
+
+		io.send_string(id, ZMQ_SNDMORE);
+		io.send_data<int32_t>(act_frame, ZMQ_SNDMORE);
+		io.send_data<uint32_t>(width, ZMQ_SNDMORE);
+		io.send_data<uint32_t>(height, ZMQ_SNDMORE);
+		io.send_data_noout(mouse, ZMQ_SNDMORE);
+
+		if (!encoded)
+		{
+			io.send_data<int32_t>(format);
+		}
+		else
+		{
+			io.send_data<int32_t>(format, ZMQ_SNDMORE);
+
+			// Request an encoded reply
+			io.send_data<uint8_t>(static_cast<uint8_t>(codec), ZMQ_SNDMORE);
 
-	impl_->io.send_string(id, ZMQ_SNDMORE);
-	impl_->io.send_data<int32_t>(act_frame, ZMQ_SNDMORE);
-	impl_->io.send_data<uint32_t>(width, ZMQ_SNDMORE);
-	impl_->io.send_data<uint32_t>(height, ZMQ_SNDMORE);
-	impl_->io.send_data_noout(mouse, ZMQ_SNDMORE);
-	impl_->io.send_data<int32_t>(format);
-	
-	impl_->io.recv_wait();
+			if (impl_->ring)
+			{
+				io.send_data(base_sequence, ZMQ_SNDMORE);
+				io.send_string(impl_->ring->name());
+			}
+			else
+			{
+				io.send_data(base_sequence);
+			}
+		}
+	}, [impl = impl_, id, encoded, codec, base_sequence](net::message_reader &reader) {
+		core::image result;
+		impl->reuse_frame(result);
 
-	auto status(impl_->io.recv_string());
+		// Get frame timing
+		reader.recv_data(result.frame_timing);
 
-	if (status.compare("ERROR") == 0)
+		// Get contents
+		if (!encoded)
+			reader.recv_data_noout(result);
+		else
+			impl->recv_encoded(id, codec, base_sequence, reader, result);
+
+		impl->keep_frame(result);
+
+		return result;
+	});
+}
+
+core::image net_host::render_sound(const std::string &id, uint64_t start, uint32_t count, float rate)
+{
+	impl_->log->info("render_sound id: {} start: {} count: {} rate: {}", id, start, count, rate);
+
+	if (impl_->binary(net::opcode::render_sound))
 	{
-		throw std::runtime_error(impl_->io.recv_string());
+		net::binary_writer args;
+		args.write(start);
+		args.write(count);
+		args.write(rate);
+
+		return impl_->request_binary(net::opcode::render_sound, id, args,
+									 [](const std::string &, net::binary_reader &, net::message_reader &reader) {
+			core::image result;
+			reader.recv_data_noout(result);
+			return result;
+		}).get();
 	}
 
-	core::image result;
+	return impl_->request([&](net::io &io) {
+		io.send_string("render_sound", ZMQ_SNDMORE);
+		io.send_string(id, ZMQ_SNDMORE);
+		io.send_data(start, ZMQ_SNDMORE);
+		io.send_data(count, ZMQ_SNDMORE);
+		io.send_data(rate);
+	}, [](net::message_reader &reader) {
+		core::image result;
+		reader.recv_data_noout(result);
+		return result;
+	}).get();
+}
 
-	// Get frame timing
-	impl_->io.recv_data(result.frame_timing);
+core::export_summary net_host::export_frames(const std::string &id, int first, uint32_t count, size_t width,
+											size_t height, const std::string &path, core::export_format format)
+{
+	impl_->take_ahead();
 
-	// Get contents
-	impl_->io.recv_data_noout(result);
+	impl_->log->info("export id: {} first: {} count: {} width: {} height: {} path: {}", id, first, count, width,
+					 height, path);
+
+	if (impl_->binary(net::opcode::export_frames))
+	{
+		net::binary_writer args;
+		args.write<int32_t>(first);
+		args.write(count);
+		args.write<uint32_t>(width);
+		args.write<uint32_t>(height);
+		args.write(static_cast<uint8_t>(format));
+		args.write_string(path);
 
-	return result;
+		return impl_->request_binary(net::opcode::export_frames, id, args,
+									 [](const std::string &, net::binary_reader &reply, net::message_reader &) {
+			core::export_summary summary;
+			summary.frames = reply.read<uint32_t>();
+			summary.bytes = reply.read<uint64_t>();
+			summary.seconds = reply.read<double>();
+			return summary;
+		}).get();
+	}
+
+	return impl_->request([&](net::io &io) {
+		io.send_string("export", ZMQ_SNDMORE);
+		io.send_string(id, ZMQ_SNDMORE);
+		io.send_data<int32_t>(first, ZMQ_SNDMORE);
+		io.send_data(count, ZMQ_SNDMORE);
+		io.send_data<uint32_t>(width, ZMQ_SNDMORE);
+		io.send_data<uint32_t>(height, ZMQ_SNDMORE);
+		io.send_data(static_cast<uint8_t>(format), ZMQ_SNDMORE);
+		io.send_string(path);
+	}, [](net::message_reader &reader) {
+		core::export_summary summary;
+		summary.frames = reader.recv_data<uint32_t>();
+		summary.bytes = reader.recv_data<uint64_t>();
+		summary.seconds = reader.recv_data<double>();
+		return summary;
+	}).get();
 }
 
 void net_host::reset(const std::string &id)
 {
-	impl_->log->info("reset id: {}", id);
+	impl_->take_ahead();
 
-	impl_->io.send_string("reset", ZMQ_SNDMORE);
-	impl_->io.send_string(id);
-
-	impl_->io.recv_wait();
-
-	auto status(impl_->io.recv_string());
+	impl_->log->info("reset id: {}", id);
 
-	if (status.compare("ERROR") == 0)
+	if (impl_->binary())
 	{
-		throw std::runtime_error(impl_->io.recv_string());
+		impl_->request_binary(net::opcode::reset, id, net::binary_writer(),
+							  [](const std::string &, net::binary_reader &, net::message_reader &) {
+		}).get();
+		return;
 	}
+
+	impl_->request([&](net::io &io) {
+		io.send_string("reset", ZMQ_SNDMORE);
+		io.send_string(id);
+	}, [](net::message_reader &) {
+	}).get();
 }
 
 std::string net_host::create_local(const std::vector<std::pair<std::string, std::string>> &bufferSources)
 {
-	impl_->log->info("create_local sources: {}", bufferSources.size());
+	return create_local_async(bufferSources).get();
+}
 
-	impl_->io.send_string("create_local", ZMQ_SNDMORE);
-	impl_->io.send_data<uint32_t>(bufferSources.size(), ZMQ_SNDMORE);
+std::future<std::string> net_host::create_local_async(const std::vector<std::pair<std::string, std::string>> &bufferSources)
+{
+	impl_->log->info("create_local sources: {}", bufferSources.size());
 
-	for (auto pair : bufferSources)
+	if (impl_->binary())
 	{
-		impl_->io.send_string(pair.first, ZMQ_SNDMORE);
-		impl_->io.send_string(pair.second, ZMQ_SNDMORE);
+		net::binary_writer args;
+		args.write<uint32_t>(bufferSources.size());
+
+		std::vector<net_host_impl::blob_ref> blobs;
+
+		for (const auto &pair : bufferSources)
+		{
+			args.write_string(pair.first);
+
+			// Large sources are sent as blobs
+			if (impl_->blobs_enabled() && pair.second.size() >= net_host_impl::blob_threshold)
+			{
+				net_host_impl::blob_ref blob;
+				blob.digest = net::sha256::hash(pair.second.data(), pair.second.size());
+				blob.bytes = std::make_shared<std::vector<char>>(pair.second.begin(), pair.second.end());
+
+				args.write<uint8_t>(1);
+				args.write_string(blob.digest);
+
+				blobs.push_back(std::move(blob));
+			}
+			else
+			{
+				// Version 1 has no by_digest byte
+				if (impl_->protocol_version >= 2)
+					args.write<uint8_t>(0);
+
+				args.write_string(pair.second);
+			}
+		}
+
+		return impl_->request_binary(net::opcode::create_local, std::string(), args,
+									 [](const std::string &reply_id, net::binary_reader &, net::message_reader &) {
+			// The created context id is in the id field of the reply
+			return reply_id;
+		}, {}, blobs);
 	}
 
-	impl_->io.send_empty();
+	return impl_->request([&](net::io &io) {
+		io.send_string("create_local", ZMQ_SNDMORE);
+		io.send_data<uint32_t>(bufferSources.size(), ZMQ_SNDMORE);
+
+		for (auto pair : bufferSources)
+		{
+			io.send_string(pair.first, ZMQ_SNDMORE);
+			io.send_string(pair.second, ZMQ_SNDMORE);
+		}
 
-	impl_->io.recv_wait();
+		io.send_empty();
+	}, [](net::message_reader &reader) {
+		return reader.recv_string();
+	});
+}
 
-	auto status(impl_->io.recv_string());
-	auto extra(impl_->io.recv_string());
+std::shared_ptr<core::basic_context> net_host::get_context(const std::string &id)
+{
+	// The context may be changed by the caller, so the frame rendered ahead
+	// would be stale
+	impl_->take_ahead();
 
-	if (status.compare("OK") == 0)
+	if (impl_->binary())
 	{
-		return extra;
+		impl_->request_binary(net::opcode::get_context, id, net::binary_writer(),
+							  [](const std::string &, net::binary_reader &, net::message_reader &) {
+		}).get();
+
+		return std::make_shared<net_context>(id, impl_);
 	}
+
+	impl_->request([&](net::io &io) {
+		io.send_string("get_context", ZMQ_SNDMORE);
+		io.send_string(id);
+	}, [](net::message_reader &) {
+	}).get();
+
+	return std::make_shared<net_context>(id, impl_);
+}
+
+void net_host::render_ahead(const std::string &id, bool enable)
+{
+	impl_->take_ahead();
+
+	std::lock_guard<std::mutex> guard(impl_->ahead_mutex);
+	if (enable)
+		impl_->render_ahead_ids.insert(id);
 	else
+		impl_->render_ahead_ids.erase(id);
+}
+
+void net_host::prefetch(const std::vector<std::string> &ids)
+{
+	impl_->log->info("prefetch ids: {}", ids.size());
+
+	// Send all the requests before waiting for the first reply
+	std::vector<std::future<void>> replies;
+
+	for (const auto &id : ids)
+	{
+		if (impl_->binary(net::opcode::prefetch))
+		{
+			replies.emplace_back(impl_->request_binary(net::opcode::prefetch, id, net::binary_writer(),
+													   [](const std::string &, net::binary_reader &, net::message_reader &) {
+			}));
+		}
+		else
+		{
+			replies.emplace_back(impl_->request([&](net::io &io) {
+				io.send_string("prefetch", ZMQ_SNDMORE);
+				io.send_string(id);
+			}, [](net::message_reader &) {
+			}));
+		}
+	}
+
+	for (auto &reply : replies)
 	{
-		throw std::runtime_error(extra);
+		try
+		{
+			reply.get();
+		}
+		catch (std::runtime_error &ex)
+		{
+			// Prefetching is only a hint, older servers do not support it
+			impl_->log->warn("Could not prefetch: {}", ex.what());
+		}
 	}
 }
 
-std::shared_ptr<core::basic_context> net_host::get_context(const std::string &id)
+std::vector<core::image> net_host::execute_batch(const std::vector<core::batch_op> &ops)
 {
-	impl_->io.send_string("get_context", ZMQ_SNDMORE);
-	impl_->io.send_string(id);
+	impl_->take_ahead();
+
+	if (!impl_->binary())
+		return basic_host::execute_batch(ops);
 
-	impl_->io.recv_wait();
+	impl_->log->info("execute_batch operations: {}", ops.size());
 
-	auto status(impl_->io.recv_string());
+	std::vector<core::image> results;
 
-	if (status.compare("ERROR") == 0)
+	auto begin = ops.begin();
+	while (begin != ops.end())
 	{
-		throw std::runtime_error(impl_->io.recv_string());
+		auto end = std::next(begin);
+		while (end != ops.end() && end->id.compare(begin->id) == 0)
+			++end;
+
+		// Runs are executed one after the other, so a failed run stops the batch
+		std::vector<core::image> run_results;
+
+		try
+		{
+			run_results = impl_->execute_run(begin, end);
+		}
+		catch (core::batch_error &ex)
+		{
+			std::move(ex.results().begin(), ex.results().end(), std::back_inserter(results));
+			throw core::batch_error((begin - ops.begin()) + ex.index(), ex.message(), std::move(results));
+		}
+		catch (const std::exception &ex)
+		{
+			// Servers before version 6 of the protocol do not tell which
+			// operation of the run failed
+			throw core::batch_error(begin - ops.begin(), ex.what(), std::move(results));
+		}
+
+		std::move(run_results.begin(), run_results.end(), std::back_inserter(results));
+
+		begin = end;
 	}
 
-	return std::make_shared<net_context>(id, impl_);
+	return results;
 }
 
+std::string net_host::subscribe(const std::string &id, size_t width, size_t height, const std::array<float, 4> &mouse,
+								GLenum format, float rate, uint32_t frames, const frame_callback &callback)
+{
+	impl_->log->info("subscribe id: {} width: {} height: {} rate: {}", id, width, height, rate);
+
+	auto reply(impl_->request([&](net::io &io) {
+		io.send_string("subscribe", ZMQ_SNDMORE);
+
+		io.send_string(id, ZMQ_SNDMORE);
+		io.send_data<uint32_t>(width, ZMQ_SNDMORE);
+		io.send_data<uint32_t>(height, ZMQ_SNDMORE);
+		io.send_data_noout(mouse, ZMQ_SNDMORE);
+		io.send_data<int32_t>(format, ZMQ_SNDMORE);
+		io.send_data(rate, ZMQ_SNDMORE);
+		io.send_data(frames, ZMQ_SNDMORE);
+		io.send_data<uint8_t>(static_cast<uint8_t>(net::codec_without_delta(impl_->codec)));
+	}, [](net::message_reader &reader) {
+		auto stream_id(reader.recv_string());
+		auto endpoint(reader.recv_string());
+
+		// Older servers do not expire streams
+		std::chrono::milliseconds lease(reader.more() ? reader.recv_data<uint32_t>() : 0);
+		return std::make_tuple(stream_id, endpoint, lease);
+	}).get());
+
+	auto &stream_id(std::get<0>(reply));
+	auto lease(std::get<2>(reply));
+
+	// Topics are NUL-terminated stream ids
+	std::string topic(stream_id);
+	topic.push_back('\0');
+
+	{
+		std::lock_guard<std::mutex> guard(impl_->subscription_mutex);
+		impl_->subscriptions[stream_id] = net_host_impl::subscription{
+			id, topic, callback, lease, std::chrono::steady_clock::now() + lease / 3
+		};
+	}
+
+	impl_->send_control(true, impl_->resolve_publisher(std::get<1>(reply)), topic);
+
+	return stream_id;
+}
+
+void net_host::unsubscribe(const std::string &stream)
+{
+	impl_->log->info("unsubscribe stream: {}", stream);
+
+	net_host_impl::subscription sub;
+
+	{
+		std::lock_guard<std::mutex> guard(impl_->subscription_mutex);
+		auto it = impl_->subscriptions.find(stream);
+		if (it == impl_->subscriptions.end())
+		{
+			std::stringstream ss;
+			ss << "Unknown stream " << stream;
+			throw std::runtime_error(ss.str());
+		}
+
+		sub = it->second;
+		impl_->subscriptions.erase(it);
+	}
+
+	impl_->send_control(false, std::string(), sub.topic);
+
+	impl_->request([&](net::io &io) {
+		io.send_string("unsubscribe", ZMQ_SNDMORE);
+		io.send_string(sub.context_id, ZMQ_SNDMORE);
+		io.send_string(stream);
+	}, [](net::message_reader &) {
+	}).get();
+}
@@ -1,3 +1,4 @@
+#include "stc/core/basic_context.hpp"
 #include "stc/core/basic_host.hpp"
 
 using namespace stc::core;
@@ -10,3 +11,52 @@ basic_host::~basic_host()
 {
 }
 
+void basic_host::prefetch(const std::vector<std::string> &ids)
+{
+}
+
+void basic_host::render_ahead(const std::string &id, bool enable)
+{
+}
+
+std::vector<image> basic_host::execute_batch(const std::vector<batch_op> &ops)
+{
+	std::vector<image> results;
+
+	for (size_t i = 0; i < ops.size(); ++i)
+	{
+		const auto &op(ops[i]);
+
+		try
+		{
+			switch (op.kind)
+			{
+			case batch_kind::set_input:
+				get_context(op.id)->set_input(op.buffer, op.channel, op.input);
+				break;
+
+			case batch_kind::set_input_filter:
+				get_context(op.id)->set_input_filter(op.buffer, op.channel, op.min_filter);
+				break;
+
+			case batch_kind::reset_input:
+				get_context(op.id)->reset_input(op.buffer, op.channel);
+				break;
+
+			case batch_kind::render:
+				results.emplace_back(render(op.id, op.frame, op.width, op.height, op.mouse, op.format));
+				break;
+
+			case batch_kind::reset:
+				reset(op.id);
+				break;
+			}
+		}
+		catch (const std::exception &ex)
+		{
+			throw batch_error(i, ex.what(), std::move(results));
+		}
+	}
+
+	return results;
+}
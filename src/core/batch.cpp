@@ -0,0 +1,91 @@
+#include <sstream>
+
+#include "stc/core/batch.hpp"
+
+using namespace stc::core;
+
+batch_op::batch_op()
+	: kind(batch_kind::reset),
+	id(),
+	buffer(),
+	channel(0),
+	input(),
+	min_filter(GL_LINEAR),
+	frame(),
+	width(0),
+	height(0),
+	mouse{ 0.f, 0.f, 0.f, 0.f },
+	format(GL_RGBA)
+{
+}
+
+batch_op batch_op::make_set_input(const std::string &id, const std::string &buffer, size_t channel,
+								  const boost::variant<std::string, std::shared_ptr<image>> &input)
+{
+	batch_op op;
+	op.kind = batch_kind::set_input;
+	op.id = id;
+	op.buffer = buffer;
+	op.channel = channel;
+	op.input = input;
+	return op;
+}
+
+batch_op batch_op::make_set_input_filter(const std::string &id, const std::string &buffer, size_t channel,
+										 GLint min_filter)
+{
+	batch_op op;
+	op.kind = batch_kind::set_input_filter;
+	op.id = id;
+	op.buffer = buffer;
+	op.channel = channel;
+	op.min_filter = min_filter;
+	return op;
+}
+
+batch_op batch_op::make_reset_input(const std::string &id, const std::string &buffer, size_t channel)
+{
+	batch_op op;
+	op.kind = batch_kind::reset_input;
+	op.id = id;
+	op.buffer = buffer;
+	op.channel = channel;
+	return op;
+}
+
+batch_op batch_op::make_render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
+							   const std::array<float, 4> &mouse, GLenum format)
+{
+	batch_op op;
+	op.kind = batch_kind::render;
+	op.id = id;
+	op.frame = frame;
+	op.width = width;
+	op.height = height;
+	op.mouse = mouse;
+	op.format = format;
+	return op;
+}
+
+batch_op batch_op::make_reset(const std::string &id)
+{
+	batch_op op;
+	op.kind = batch_kind::reset;
+	op.id = id;
+	return op;
+}
+
+static std::string batch_error_message(size_t index, const std::string &message)
+{
+	std::stringstream ss;
+	ss << "Batch operation " << index + 1 << " failed: " << message;
+	return ss.str();
+}
+
+batch_error::batch_error(size_t index, const std::string &message, std::vector<image> results)
+	: std::runtime_error(batch_error_message(index, message)),
+	index_(index),
+	message_(message),
+	results_(std::move(results))
+{
+}
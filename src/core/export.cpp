@@ -0,0 +1,72 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <sstream>
+#include <stdexcept>
+
+#include "stc/core/export.hpp"
+
+using namespace stc::core;
+
+export_format stc::core::parse_export_format(const std::string &name, const std::string &path)
+{
+	std::string format(name);
+
+	if (format.empty())
+	{
+		auto dot = path.find_last_of('.');
+		if (dot != std::string::npos && path.find('/', dot) == std::string::npos)
+			format = path.substr(dot + 1);
+	}
+
+	std::transform(format.begin(), format.end(), format.begin(), ::tolower);
+
+	if (format.compare("y4m") == 0)
+		return export_format::y4m;
+	else if (format.compare("rgba") == 0 || format.compare("raw") == 0)
+		return export_format::rgba;
+	else if (format.compare("png") == 0)
+		return export_format::png;
+	else if (format.compare("npy") == 0)
+		return export_format::npy;
+
+	std::stringstream ss;
+	ss << "Invalid export format '" << (name.empty() ? path : name) << "'";
+	throw std::runtime_error(ss.str());
+}
+
+std::string stc::core::export_frame_path(const std::string &path, export_format format, uint32_t frame)
+{
+	if (format != export_format::png)
+		return path;
+
+	std::string pattern(path);
+	auto percent = pattern.find('%');
+
+	if (percent == std::string::npos)
+	{
+		auto dot = pattern.find_last_of('.');
+		if (dot == std::string::npos || pattern.find('/', dot) != std::string::npos)
+			dot = pattern.size();
+
+		pattern.insert(dot, "_%05d");
+		percent = dot + 1;
+	}
+
+	// Only allow a single integer conversion, the pattern is given by the caller
+	auto conversion = pattern.find_first_not_of("0123456789", percent + 1);
+	if (conversion == std::string::npos || pattern[conversion] != 'd' ||
+		pattern.find('%', conversion) != std::string::npos)
+	{
+		std::stringstream ss;
+		ss << "Invalid frame number pattern in " << path;
+		throw std::runtime_error(ss.str());
+	}
+
+	int size = std::snprintf(nullptr, 0, pattern.c_str(), static_cast<int>(frame));
+	std::string result(size + 1, '\0');
+	std::snprintf(&result[0], result.size(), pattern.c_str(), static_cast<int>(frame));
+	result.resize(size);
+
+	return result;
+}
@@ -1,4 +1,11 @@
+#include <cstring>
+
+#ifndef _WIN32
+#include <alloca.h>
+#endif
+
 #include "stc/core/image.hpp"
+#include "stc/core/image_pool.hpp"
 
 using namespace stc::core;
 
@@ -13,8 +20,27 @@ void image::alloc()
 	for (auto dim : dims)
 		b *= dim;
 
+	// Recycled buffers are not cleared, callers overwrite the whole image
 	if (!data || data->size() != b)
 	{
-		data = std::make_shared<std::vector<float>>(b);
+		data = image_pool::global().acquire(b);
+	}
+}
+
+void image::vflip()
+{
+	stc::core::vflip(data->data(), dims[0], static_cast<size_t>(dims[1]) * dims[2]);
+}
+
+void stc::core::vflip(float *pixels, size_t height, size_t stride)
+{
+	size_t stride_size = sizeof(float) * stride;
+	float *row = static_cast<float *>(alloca(stride_size));
+
+	for (size_t i = 0; i < height / 2; ++i)
+	{
+		memcpy(row, &pixels[i * stride], stride_size);
+		memcpy(&pixels[i * stride], &pixels[(height - i - 1) * stride], stride_size);
+		memcpy(&pixels[(height - i - 1) * stride], row, stride_size);
 	}
 }
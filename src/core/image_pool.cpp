@@ -0,0 +1,149 @@
+#include <cstdint>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <string>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include "stc/core/image_pool.hpp"
+
+using namespace stc::core;
+
+namespace
+{
+
+/// Smallest size class, in floats
+constexpr size_t min_class = 1024;
+
+/// Buffers of this size or more are backed by huge pages, where supported
+constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+/**
+ * Advises the kernel to back the pages of a buffer which were not touched yet
+ * with transparent huge pages. Only the huge pages fully inside the buffer
+ * are affected, the allocator may use the rest.
+ */
+void advise_huge_pages(void *ptr, size_t bytes)
+{
+#if !defined(_WIN32) && defined(MADV_HUGEPAGE)
+	if (bytes < huge_page_size)
+		return;
+
+	uintptr_t begin = (reinterpret_cast<uintptr_t>(ptr) + huge_page_size - 1) & ~(huge_page_size - 1);
+	uintptr_t end = (reinterpret_cast<uintptr_t>(ptr) + bytes) & ~(huge_page_size - 1);
+
+	// This is only a hint, failures are ignored
+	if (end > begin)
+		madvise(reinterpret_cast<void *>(begin), end - begin, MADV_HUGEPAGE);
+#endif
+}
+}
+
+struct image_pool::state
+{
+	const size_t budget;
+
+	std::mutex mutex;
+
+	/// Free buffers, by capacity
+	std::multimap<size_t, std::unique_ptr<image_data>> free;
+
+	/// Size of the free buffers, in bytes
+	size_t free_size;
+
+	state(size_t budget) : budget(budget), mutex(), free(), free_size(0) {}
+
+	void release(image_data *buffer)
+	{
+		std::unique_ptr<image_data> owned(buffer);
+		size_t bytes = sizeof(float) * buffer->capacity();
+
+		std::lock_guard<std::mutex> guard(mutex);
+
+		if (free_size + bytes <= budget)
+		{
+			free.emplace(buffer->capacity(), std::move(owned));
+			free_size += bytes;
+		}
+	}
+};
+
+image_pool::image_pool(size_t budget) : state_(std::make_shared<state>(budget)) {}
+
+image_pool &image_pool::global()
+{
+	static image_pool pool([]() {
+		const char *env = std::getenv("STC_IMAGE_POOL");
+		return (env && *env ? std::stoull(env) : 256) * 1024 * 1024;
+	}());
+
+	return pool;
+}
+
+std::shared_ptr<image_data> image_pool::acquire(size_t size)
+{
+	size_t capacity = size_class(size);
+	std::unique_ptr<image_data> buffer;
+
+	{
+		std::lock_guard<std::mutex> guard(state_->mutex);
+
+		auto it = state_->free.find(capacity);
+		if (it != state_->free.end())
+		{
+			buffer = std::move(it->second);
+			state_->free.erase(it);
+			state_->free_size -= sizeof(float) * capacity;
+		}
+	}
+
+	if (!buffer)
+	{
+		// Reserving does not touch the pages, so they can still be advised
+		buffer = std::make_unique<image_data>();
+		buffer->reserve(capacity);
+		advise_huge_pages(buffer->data(), sizeof(float) * capacity);
+	}
+
+	// Within the capacity, so this never reallocates, and the elements
+	// beyond the previous size are not initialized
+	buffer->resize(size);
+
+	// The deleter holds the pool state, so buffers can outlive the pool
+	auto pool_state(state_);
+	return std::shared_ptr<image_data>(buffer.release(),
+											   [pool_state](image_data *released) {
+												   pool_state->release(released);
+											   });
+}
+
+void image_pool::clear()
+{
+	std::lock_guard<std::mutex> guard(state_->mutex);
+
+	state_->free.clear();
+	state_->free_size = 0;
+}
+
+size_t image_pool::free_size() const
+{
+	std::lock_guard<std::mutex> guard(state_->mutex);
+	return state_->free_size;
+}
+
+size_t image_pool::size_class(size_t size)
+{
+	if (size <= min_class)
+		return min_class;
+
+	// Largest power of two not above size, split in four steps
+	size_t step = size;
+	while (step & (step - 1))
+		step &= step - 1;
+	step /= 4;
+
+	return (size + step - 1) / step * step;
+}
@@ -0,0 +1,210 @@
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "stc/core/mapped_frames.hpp"
+
+using namespace stc::core;
+
+namespace
+{
+
+[[noreturn]] void mapping_error(const std::string &path, const char *what)
+{
+	std::stringstream ss;
+	ss << what << " " << path << ": " << strerror(errno);
+	throw std::runtime_error(ss.str());
+}
+
+/**
+ * Builds a version 1.0 .npy header for a little-endian float array. Its size
+ * is padded to a multiple of 64 bytes, so the frames are aligned.
+ */
+std::string npy_header(uint32_t frames, uint32_t height, uint32_t width, uint32_t depth)
+{
+	std::stringstream dict;
+	dict << "{'descr': '<f4', 'fortran_order': False, 'shape': (" << frames << ", " << height << ", " << width
+		 << ", " << depth << "), }";
+
+	// Magic, version and header length
+	const size_t prefix = 10;
+
+	std::string header(dict.str());
+	header.append(63 - (prefix + header.size()) % 64, ' ');
+	header.push_back('\n');
+
+	uint16_t length = header.size();
+	std::string result("\x93NUMPY\x01\x00", 8);
+	result.push_back(static_cast<char>(length & 0xff));
+	result.push_back(static_cast<char>(length >> 8));
+
+	return result + header;
+}
+}
+
+#ifndef _WIN32
+
+mapped_frames::mapped_frames(const std::string &path, uint32_t frames, uint32_t height, uint32_t width,
+							 uint32_t depth, bool keep)
+	: path_(path),
+	frames_(frames),
+	frame_size_(sizeof(float) * height * width * depth),
+	fd_(-1),
+	map_(nullptr),
+	map_size_(0),
+	header_size_(0),
+	kept_(false),
+	start_(std::chrono::steady_clock::now())
+{
+	auto header(npy_header(frames, height, width, depth));
+	header_size_ = header.size();
+	map_size_ = header_size_ + frame_size_ * frames_;
+
+	int fd = -1;
+	if (keep && (fd = open(path_.c_str(), O_RDWR)) >= 0)
+	{
+		// Only keep a file holding the same array
+		struct stat st;
+		std::string existing(header_size_, '\0');
+
+		if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) != map_size_ ||
+			pread(fd, &existing[0], header_size_, 0) != static_cast<ssize_t>(header_size_) || existing != header)
+		{
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	kept_ = fd >= 0;
+
+	if (fd < 0)
+		fd = open(path_.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+	if (fd < 0)
+		mapping_error(path_, "Could not create");
+
+	if (ftruncate(fd, map_size_) != 0)
+	{
+		int err = errno;
+		close(fd);
+		errno = err;
+		mapping_error(path_, "Could not resize");
+	}
+
+	// Writing a sparse file through the mapping raises SIGBUS once the disk is
+	// full, so reserve all the blocks now
+	int err = posix_fallocate(fd, 0, map_size_);
+	if (err != 0)
+	{
+		close(fd);
+		errno = err;
+		mapping_error(path_, "Could not allocate");
+	}
+
+	map_ = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+	if (map_ == MAP_FAILED)
+	{
+		err = errno;
+		close(fd);
+		map_ = nullptr;
+		errno = err;
+		mapping_error(path_, "Could not map");
+	}
+
+	// Kept open to start the writeback of frames
+	fd_ = fd;
+
+	madvise(map_, map_size_, MADV_SEQUENTIAL);
+	memcpy(map_, header.data(), header_size_);
+}
+
+mapped_frames::~mapped_frames()
+{
+	if (map_)
+		munmap(map_, map_size_);
+
+	if (fd_ >= 0)
+		close(fd_);
+}
+
+void mapped_frames::done(uint32_t index)
+{
+#ifdef __linux__
+	// msync(MS_ASYNC) does not start the writeback on Linux. This only starts
+	// it, errors are reported by finish.
+	sync_file_range(fd_, header_size_ + frame_size_ * index, frame_size_, SYNC_FILE_RANGE_WRITE);
+#else
+	(void)index;
+#endif
+}
+
+export_summary mapped_frames::finish()
+{
+	// Surfaces the I/O errors of the writeback
+	if (msync(map_, map_size_, MS_SYNC) != 0)
+		mapping_error(path_, "Could not write");
+
+	if (munmap(map_, map_size_) != 0)
+		mapping_error(path_, "Could not unmap");
+
+	map_ = nullptr;
+
+	close(fd_);
+	fd_ = -1;
+
+	std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - start_);
+	return export_summary{ frames_, map_size_, elapsed.count() };
+}
+
+#else
+
+mapped_frames::mapped_frames(const std::string &path, uint32_t frames, uint32_t height, uint32_t width,
+							 uint32_t depth, bool)
+	: path_(path),
+	frames_(frames),
+	frame_size_(0),
+	fd_(-1),
+	map_(nullptr),
+	map_size_(0),
+	header_size_(0),
+	kept_(false),
+	start_()
+{
+	throw std::runtime_error("Memory mapped exports are not supported on this platform");
+}
+
+mapped_frames::~mapped_frames()
+{
+}
+
+void mapped_frames::done(uint32_t)
+{
+}
+
+export_summary mapped_frames::finish()
+{
+	return export_summary{ 0, 0, 0. };
+}
+
+#endif
+
+float *mapped_frames::frame(uint32_t index)
+{
+	if (index >= frames_)
+	{
+		std::stringstream ss;
+		ss << "Frame " << index << " is out of the range of " << path_;
+		throw std::runtime_error(ss.str());
+	}
+
+	return reinterpret_cast<float *>(static_cast<char *>(map_) + header_size_ + frame_size_ * index);
+}
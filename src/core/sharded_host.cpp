@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <iterator>
+#include <sstream>
+#include <stdexcept>
+
+#include "stc/core/sharded_host.hpp"
+
+using namespace stc::core;
+
+namespace
+{
+
+/// FNV-1a hash, so the placement of contexts does not depend on the standard library
+uint64_t fnv1a(const std::string &str)
+{
+	uint64_t hash = 14695981039346656037ull;
+
+	for (unsigned char c : str)
+	{
+		hash ^= c;
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+}
+
+sharded_host::sharded_host(const std::vector<std::string> &names, std::vector<std::unique_ptr<basic_host>> &&backends)
+	: basic_host(),
+	backends_(std::move(backends)),
+	load_(backends_.size(), 0),
+	ring_(),
+	placement_(),
+	placement_mutex_()
+{
+	if (backends_.empty() || names.size() != backends_.size())
+		throw std::runtime_error("Invalid backend list for sharded host");
+
+	for (size_t i = 0; i < names.size(); ++i)
+	{
+		for (size_t j = 0; j < virtual_nodes; ++j)
+		{
+			std::stringstream ss;
+			ss << names[i] << "#" << j;
+			ring_.emplace(fnv1a(ss.str()), i);
+		}
+	}
+}
+
+basic_host &sharded_host::backend(const std::string &id)
+{
+	std::lock_guard<std::mutex> guard(placement_mutex_);
+
+	auto it = placement_.find(id);
+	if (it != placement_.end())
+		return *backends_[it->second];
+
+	// Unknown contexts are remote ones, the ring always places them on the
+	// same backend so they are not recorded
+	auto point = ring_.lower_bound(fnv1a(id));
+	if (point == ring_.end())
+		point = ring_.begin();
+
+	return *backends_[point->second];
+}
+
+void sharded_host::release(const std::string &id)
+{
+	std::lock_guard<std::mutex> guard(placement_mutex_);
+
+	auto it = placement_.find(id);
+	if (it == placement_.end())
+		return;
+
+	load_[it->second]--;
+	placement_.erase(it);
+}
+
+void sharded_host::allocate()
+{
+	for (auto &host : backends_)
+		host->allocate();
+}
+
+image sharded_host::render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
+						   const std::array<float, 4> &mouse, GLenum format)
+{
+	return backend(id).render(id, frame, width, height, mouse, format);
+}
+
+image sharded_host::render_sound(const std::string &id, uint64_t start, uint32_t count, float rate)
+{
+	return backend(id).render_sound(id, start, count, rate);
+}
+
+export_summary sharded_host::export_frames(const std::string &id, int first, uint32_t count, size_t width,
+										   size_t height, const std::string &path, export_format format)
+{
+	return backend(id).export_frames(id, first, count, width, height, path, format);
+}
+
+void sharded_host::reset(const std::string &id)
+{
+	backend(id).reset(id);
+	release(id);
+}
+
+std::string sharded_host::create_local(const std::vector<std::pair<std::string, std::string>> &bufferSources)
+{
+	size_t index;
+
+	{
+		std::lock_guard<std::mutex> guard(placement_mutex_);
+		index = std::min_element(load_.begin(), load_.end()) - load_.begin();
+	}
+
+	auto id(backends_[index]->create_local(bufferSources));
+
+	std::lock_guard<std::mutex> guard(placement_mutex_);
+	if (!placement_.emplace(id, index).second)
+	{
+		std::stringstream ss;
+		ss << "Context id " << id << " is used by several backends";
+		throw std::runtime_error(ss.str());
+	}
+
+	load_[index]++;
+
+	return id;
+}
+
+std::shared_ptr<basic_context> sharded_host::get_context(const std::string &id)
+{
+	return backend(id).get_context(id);
+}
+
+void sharded_host::prefetch(const std::vector<std::string> &ids)
+{
+	std::map<basic_host *, std::vector<std::string>> backend_ids;
+
+	for (const auto &id : ids)
+		backend_ids[&backend(id)].push_back(id);
+
+	for (auto &pair : backend_ids)
+		pair.first->prefetch(pair.second);
+}
+
+void sharded_host::render_ahead(const std::string &id, bool enable)
+{
+	backend(id).render_ahead(id, enable);
+}
+
+std::vector<image> sharded_host::execute_batch(const std::vector<batch_op> &ops)
+{
+	std::vector<image> results;
+
+	auto begin = ops.begin();
+	while (begin != ops.end())
+	{
+		auto &host(backend(begin->id));
+
+		auto end = std::next(begin);
+		while (end != ops.end() && &backend(end->id) == &host)
+			++end;
+
+		std::vector<image> run_results;
+
+		try
+		{
+			run_results = host.execute_batch(std::vector<batch_op>(begin, end));
+		}
+		catch (batch_error &ex)
+		{
+			// Resets which completed before the error still moved their context
+			for (auto it = begin; it != begin + ex.index(); ++it)
+			{
+				if (it->kind == batch_kind::reset)
+					release(it->id);
+			}
+
+			std::move(ex.results().begin(), ex.results().end(), std::back_inserter(results));
+			throw batch_error((begin - ops.begin()) + ex.index(), ex.message(), std::move(results));
+		}
+		catch (const std::exception &ex)
+		{
+			// The backend failed before running any operation of this run
+			throw batch_error(begin - ops.begin(), ex.what(), std::move(results));
+		}
+
+		std::move(run_results.begin(), run_results.end(), std::back_inserter(results));
+
+		for (auto it = begin; it != end; ++it)
+		{
+			if (it->kind == batch_kind::reset)
+				release(it->id);
+		}
+
+		begin = end;
+	}
+
+	return results;
+}
@@ -2,22 +2,20 @@
 #include "stc/gl/local.hpp"
 #include "stc/gl/remote.hpp"
 
-#ifndef _WIN32
-#include <alloca.h>
-#endif
-
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 using namespace stc;
 using namespace stc::gl;
 
-context::context(const std::string &shaderId, size_t width, size_t height)
-: core::basic_context(shaderId), render_size_(width, height), context_(), chain_(), frame_count_(0)
+context::context(const std::string &shaderId, const remote_shader &shader, texture_cache &textures, size_t width,
+				 size_t height)
+: core::basic_context(shaderId), render_size_(width, height), context_(), chain_(), frame_count_(0),
+  spare_data_(), sound_source_(remote_sound_source(shader)), sound_()
 {
 	initialize(shaderId, width, height);
 
 	// Load the shader from the remote source
-	load_remote(shaderId, "fdnKWn", context_, chain_, render_size_);
+	load_remote(shaderId, shader, textures, context_, chain_, render_size_);
 
 	create_context();
 }
@@ -25,10 +23,15 @@ context::context(const std::string &shaderId, size_t width, size_t height)
 context::context(const std::string &shaderId,
 				 const std::vector<std::pair<std::string, std::string>> &bufferSources,
 				 size_t width, size_t height)
-: core::basic_context(shaderId), render_size_(width, height), context_(), chain_(), frame_count_(0)
+: core::basic_context(shaderId), render_size_(width, height), context_(), chain_(), frame_count_(0),
+  spare_data_(), sound_source_(), sound_()
 {
 	initialize(shaderId, width, height);
 
+	for (const auto &pair : bufferSources)
+		if (pair.first == "sound")
+			sound_source_ = pair.second;
+
 	// Load the shader from a locally created file
 	load_local(shaderId, bufferSources, context_, chain_, render_size_);
 
@@ -38,25 +41,59 @@ context::context(const std::string &shaderId,
 void context::perform_render(int frameCount, size_t width, size_t height,
 							 const std::array<float, 4> &mouse, GLenum format)
 {
-	// Ensure we are working at the right size
+	// Ensure the image has the right size
 	GLint depth = format_depth(format);
-	if (width != render_size_.width || height != render_size_.height || depth != static_cast<GLint>(current_image_.dims[2]))
+	if (width != current_image_.dims[1] || height != current_image_.dims[0] || depth != static_cast<GLint>(current_image_.dims[2]))
 	{
-		if (width != render_size_.width || height != render_size_.height)
-		{
-			render_size_.width = width;
-			render_size_.height = height;
-			context_.allocate_textures(chain_);
-		}
-
 		current_image_.dims[0] = height;
 		current_image_.dims[1] = width;
 		current_image_.dims[2] = depth;
 		current_image_.alloc();
 	}
 
-	// Poll events
-	glfwPollEvents();
+	render_frame(frameCount, width, height, mouse);
+
+	// Do not overwrite a previous frame which is still referenced, for example
+	// by a zero-copy network message which has not been sent yet, or by the
+	// caller while the next frame is rendered ahead. Alternate between two
+	// buffers, so this does not allocate in steady state.
+	if (current_image_.data.use_count() > 1)
+	{
+		std::swap(current_image_.data, spare_data_);
+
+		if (current_image_.data.use_count() > 1)
+			current_image_.data.reset();
+
+		current_image_.alloc();
+	}
+
+	// Read the current texture, in a suitably sized array
+	read_output(format, current_image_.data->data());
+
+	// Vertical flip
+	current_image_.vflip();
+
+	current_image_.frame_timing = std::static_pointer_cast<shadertoy::members::buffer_member>(chain_.current())->buffer()->elapsed_time();
+}
+
+void context::perform_render(int frameCount, size_t width, size_t height,
+							 const std::array<float, 4> &mouse, GLenum format, float *dst)
+{
+	render_frame(frameCount, width, height, mouse);
+
+	read_output(format, dst);
+	core::vflip(dst, height, width * format_depth(format));
+}
+
+void context::render_frame(int frameCount, size_t width, size_t height, const std::array<float, 4> &mouse)
+{
+	// Ensure we are working at the right size
+	if (width != render_size_.width || height != render_size_.height)
+	{
+		render_size_.width = width;
+		render_size_.height = height;
+		context_.allocate_textures(chain_);
+	}
 
 	// Update uniforms
 	//  iFrameRate, iTime, iFrame
@@ -77,30 +114,32 @@ void context::perform_render(int frameCount, size_t width, size_t height,
 	// Render to texture
 	context_.render(chain_);
 
-	// Read the current texture
-	auto tex(chain_.current()->output().front());
+	// Advance the frame counter
+	frame_count_ = frameCount + 1;
+}
 
-	// Store it in a suitably sized array
+void context::read_output(GLenum format, float *dst)
+{
+	auto tex(chain_.current()->output().front());
 
 	// float textures
-	std::shared_ptr<std::vector<float>> texData = current_image_.data;
-	std::get<1>(tex)->get_image(0, format, GL_FLOAT, sizeof(float) * width * height * depth, texData->data());
+	size_t bytes = sizeof(float) * render_size_.width * render_size_.height * format_depth(format);
+	std::get<1>(tex)->get_image(0, format, GL_FLOAT, bytes, dst);
+}
 
-	// Vertical flip
-	size_t stride_size = sizeof(float) * width * depth;
-	float *stride = static_cast<float *>(alloca(stride_size));
-	for (size_t i = 0; i < height / 2; ++i)
+core::image context::render_sound(uint64_t start, uint32_t count, float rate)
+{
+	if (sound_source_.empty())
 	{
-		memcpy(stride, &(*texData)[i * stride_size / sizeof(float)], stride_size);
-		memcpy(&(*texData)[i * stride_size / sizeof(float)],
-			   &(*texData)[(height - i - 1) * stride_size / sizeof(float)], stride_size);
-		memcpy(&(*texData)[(height - i - 1) * stride_size / sizeof(float)], stride, stride_size);
+		std::stringstream ss;
+		ss << "Context " << id() << " has no sound pass";
+		throw std::runtime_error(ss.str());
 	}
 
-	current_image_.frame_timing = std::static_pointer_cast<shadertoy::members::buffer_member>(chain_.current())->buffer()->elapsed_time();
+	if (!sound_)
+		sound_ = std::make_unique<sound_renderer>(sound_source_);
 
-	// Advance the frame counter
-	frame_count_ = frameCount + 1;
+	return sound_->render(start, count, rate);
 }
 
 void context::set_input(const std::string &buffer, size_t channel,
@@ -202,6 +241,26 @@ void context::reset_input(const std::string &buffer, size_t channel)
 	}
 }
 
+bool context::has_history()
+{
+	// Other buffers are only useful to keep state between frames
+	if (chain_.find_if<shadertoy::members::buffer_member>(
+		[](const auto &member) { return member->buffer()->id() != "image"; }))
+		return true;
+
+	for (auto &input : getBuffer("image")->inputs())
+	{
+		if (std::dynamic_pointer_cast<shadertoy::inputs::buffer_input>(input.input()))
+			return true;
+
+		if (auto ov_input = std::dynamic_pointer_cast<override_input>(input.input()))
+			if (ov_input->reads_buffer())
+				return true;
+	}
+
+	return false;
+}
+
 void context::initialize(const std::string &shaderId, size_t width, size_t height)
 {
 	current_image_.dims[0] = height;
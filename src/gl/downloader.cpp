@@ -0,0 +1,291 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#include "stc/core/getpid.h"
+
+#include "stc/gl/downloader.hpp"
+
+using namespace stc::gl;
+
+namespace
+{
+
+/// Number of temporary files created by this process
+std::atomic<uint64_t> part_counter(0);
+
+size_t write_stream(char *buffer, size_t size, size_t nmemb, void *userp)
+{
+	std::ostream &os = *static_cast<std::ostream *>(userp);
+	size_t sz = size * nmemb;
+	os.write(buffer, sz);
+	return os ? sz : 0;
+}
+
+size_t read_header(char *buffer, size_t size, size_t nmemb, void *userp)
+{
+	auto &res = *static_cast<downloader::response *>(userp);
+	size_t sz = size * nmemb;
+
+	std::string line(buffer, sz);
+	auto colon = line.find(':');
+
+	if (line.compare(0, 5, "HTTP/") == 0)
+	{
+		// Status line of a new response, after a redirect
+		res.etag.clear();
+		res.last_modified.clear();
+	}
+	else if (colon != std::string::npos)
+	{
+		std::string name(line.substr(0, colon));
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+
+		auto begin = line.find_first_not_of(" \t", colon + 1);
+		auto end = line.find_last_not_of(" \t\r\n");
+		std::string value(begin == std::string::npos || end < begin ? "" : line.substr(begin, end - begin + 1));
+
+		if (name == "etag")
+			res.etag = value;
+		else if (name == "last-modified")
+			res.last_modified = value;
+	}
+
+	return sz;
+}
+
+std::string transfer_error(const std::string &url, CURLcode res)
+{
+	std::stringstream ss;
+	ss << "Failed to download " << url << ": " << curl_easy_strerror(res);
+	return ss.str();
+}
+}
+
+downloader::downloader()
+	: share_(curl_share_init()),
+	share_locks_(),
+	pool_(),
+	pool_mutex_()
+{
+	if (!share_)
+		throw std::runtime_error("Failed to initialize curl share handle");
+
+	curl_share_setopt(share_, CURLSHOPT_LOCKFUNC, lock_share);
+	curl_share_setopt(share_, CURLSHOPT_UNLOCKFUNC, unlock_share);
+	curl_share_setopt(share_, CURLSHOPT_USERDATA, this);
+
+	curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	curl_share_setopt(share_, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+}
+
+downloader::~downloader()
+{
+	for (auto curl : pool_)
+		curl_easy_cleanup(curl);
+
+	curl_share_cleanup(share_);
+}
+
+void downloader::lock_share(CURL *, curl_lock_data data, curl_lock_access, void *userptr)
+{
+	static_cast<downloader *>(userptr)->share_locks_[data].lock();
+}
+
+void downloader::unlock_share(CURL *, curl_lock_data data, void *userptr)
+{
+	static_cast<downloader *>(userptr)->share_locks_[data].unlock();
+}
+
+CURL *downloader::acquire()
+{
+	CURL *curl = nullptr;
+
+	{
+		std::lock_guard<std::mutex> guard(pool_mutex_);
+		if (!pool_.empty())
+		{
+			curl = pool_.back();
+			pool_.pop_back();
+		}
+	}
+
+	if (!curl)
+	{
+		curl = curl_easy_init();
+		if (!curl)
+			throw std::runtime_error("Failed to initialize curl");
+	}
+
+	curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_stream);
+
+	return curl;
+}
+
+void downloader::release(CURL *curl)
+{
+	// Reset options, but keep the handle and its connections for later
+	curl_easy_reset(curl);
+
+	std::lock_guard<std::mutex> guard(pool_mutex_);
+	pool_.push_back(curl);
+}
+
+std::string downloader::get(const std::string &url)
+{
+	return get(url, {}).body;
+}
+
+downloader::response downloader::get(const std::string &url, const std::vector<std::string> &headers)
+{
+	response result{ 0, std::string(), std::string(), std::string() };
+	std::stringstream ss;
+	CURL *curl = acquire();
+
+	curl_slist *header_list = nullptr;
+	for (const auto &header : headers)
+		header_list = curl_slist_append(header_list, header.c_str());
+
+	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, static_cast<std::ostream *>(&ss));
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, read_header);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &result);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+
+	CURLcode res = curl_easy_perform(curl);
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status);
+	release(curl);
+
+	curl_slist_free_all(header_list);
+
+	if (res != CURLE_OK)
+		throw std::runtime_error(transfer_error(url, res));
+
+	result.body = ss.str();
+	return result;
+}
+
+void downloader::fetch_all(const std::vector<download> &downloads)
+{
+	if (downloads.empty())
+		return;
+
+	struct transfer
+	{
+		const download *target;
+		std::string part_path;
+		std::ofstream out;
+		CURL *curl;
+		CURLcode result;
+	};
+
+	CURLM *multi = curl_multi_init();
+	if (!multi)
+		throw std::runtime_error("Failed to initialize curl multi handle");
+
+	curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, max_host_connections);
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+	std::vector<std::unique_ptr<transfer>> transfers;
+	std::string error;
+
+	for (const auto &dl : downloads)
+	{
+		auto t(std::make_unique<transfer>());
+		t->target = &dl;
+		t->part_path = part_path(dl.path);
+		t->out.open(t->part_path, std::ios::out | std::ios::binary);
+		t->curl = nullptr;
+		t->result = CURLE_OK;
+
+		if (!t->out)
+		{
+			error = std::string("Could not write ") + t->part_path;
+			break;
+		}
+
+		t->curl = acquire();
+		curl_easy_setopt(t->curl, CURLOPT_URL, dl.url.c_str());
+		curl_easy_setopt(t->curl, CURLOPT_WRITEDATA, static_cast<std::ostream *>(&t->out));
+		curl_easy_setopt(t->curl, CURLOPT_PRIVATE, t.get());
+		curl_multi_add_handle(multi, t->curl);
+
+		transfers.emplace_back(std::move(t));
+	}
+
+	if (error.empty())
+	{
+		int running = 0;
+		do
+		{
+			CURLMcode mc = curl_multi_perform(multi, &running);
+			if (mc != CURLM_OK)
+			{
+				error = curl_multi_strerror(mc);
+				break;
+			}
+
+			if (running)
+				curl_multi_wait(multi, nullptr, 0, 1000, nullptr);
+
+			int queued;
+			while (CURLMsg *msg = curl_multi_info_read(multi, &queued))
+			{
+				if (msg->msg != CURLMSG_DONE)
+					continue;
+
+				transfer *t;
+				curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char **>(&t));
+				t->result = msg->data.result;
+			}
+		}
+		while (running);
+	}
+
+	// Transfers did not all run if the multi handle failed
+	bool aborted = !error.empty();
+
+	for (auto &t : transfers)
+	{
+		curl_multi_remove_handle(multi, t->curl);
+		release(t->curl);
+
+		t->out.close();
+
+		if (!aborted && t->result == CURLE_OK)
+		{
+			// Complete files replace their destination at once
+			std::remove(t->target->path.c_str());
+			if (std::rename(t->part_path.c_str(), t->target->path.c_str()) != 0 && error.empty())
+				error = std::string("Could not write ") + t->target->path;
+		}
+		else
+		{
+			std::remove(t->part_path.c_str());
+
+			if (error.empty())
+				error = transfer_error(t->target->url, t->result);
+		}
+	}
+
+	curl_multi_cleanup(multi);
+
+	if (!error.empty())
+		throw std::runtime_error(error);
+}
+
+std::string stc::gl::part_path(const std::string &path)
+{
+	std::stringstream ss;
+	ss << path << "." << getpid() << "-" << part_counter++ << ".part";
+	return ss.str();
+}
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include <sys/stat.h>
+
+#if SHADERTOY_CONNECTOR_HAS_PNG
+#include <png.h>
+#endif
+
+#include "stc/gl/frame_writer.hpp"
+
+using namespace stc;
+using namespace stc::gl;
+
+namespace
+{
+
+inline uint8_t to_byte(float value)
+{
+	return static_cast<uint8_t>(std::min(std::max(value, 0.f), 1.f) * 255.f + 0.5f);
+}
+
+/// Converts RGBA float pixels to RGBA8
+void convert_rgba(const float *src, size_t pixels, uint8_t *dst)
+{
+	for (size_t i = 0; i < 4 * pixels; ++i)
+		dst[i] = to_byte(src[i]);
+}
+
+/// Converts RGBA float pixels to planar 4:4:4 Y'CbCr, BT.601 limited range
+void convert_yuv444(const float *src, size_t pixels, uint8_t *dst)
+{
+	uint8_t *y = dst, *cb = dst + pixels, *cr = dst + 2 * pixels;
+
+	for (size_t i = 0; i < pixels; ++i)
+	{
+		float r = std::min(std::max(src[4 * i], 0.f), 1.f);
+		float g = std::min(std::max(src[4 * i + 1], 0.f), 1.f);
+		float b = std::min(std::max(src[4 * i + 2], 0.f), 1.f);
+
+		y[i] = static_cast<uint8_t>(16.f + 65.481f * r + 128.553f * g + 24.966f * b + 0.5f);
+		cb[i] = static_cast<uint8_t>(128.f - 37.797f * r - 74.203f * g + 112.f * b + 0.5f);
+		cr[i] = static_cast<uint8_t>(128.f + 112.f * r - 93.786f * g - 18.214f * b + 0.5f);
+	}
+}
+
+/// Header of single file exports
+std::string stream_header(core::export_format format, uint32_t width, uint32_t height)
+{
+	if (format != core::export_format::y4m)
+		return std::string();
+
+	// The frame rate matches the iTime step of the contexts
+	std::stringstream ss;
+	ss << "YUV4MPEG2 W" << width << " H" << height << " F60:1 Ip A1:1 C444\n";
+	return ss.str();
+}
+
+/// Size of a frame of single file exports, in bytes
+uint64_t frame_bytes(core::export_format format, uint32_t width, uint32_t height)
+{
+	uint64_t pixels = static_cast<uint64_t>(width) * height;
+
+	if (format == core::export_format::y4m)
+		return 6 + 3 * pixels;
+	else if (format == core::export_format::rgba)
+		return 4 * pixels;
+
+	return 0;
+}
+
+/// Seeks in files larger than 2 GiB
+int seek(FILE *file, uint64_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(file, offset, SEEK_SET);
+#else
+	return fseeko(file, offset, SEEK_SET);
+#endif
+}
+
+[[noreturn]] void export_error(const std::string &path, const std::string &message)
+{
+	std::stringstream ss;
+	ss << "Could not export to " << path << ": " << message;
+	throw std::runtime_error(ss.str());
+}
+}
+
+frame_writer::frame_writer(const std::string &path, core::export_format format, uint32_t width, uint32_t height)
+	: frame_writer(path, format, width, height, 0, false)
+{
+}
+
+frame_writer::frame_writer(const std::string &path, core::export_format format, uint32_t width, uint32_t height,
+						   uint32_t first)
+	: frame_writer(path, format, width, height, first, true)
+{
+}
+
+frame_writer::frame_writer(const std::string &path, core::export_format format, uint32_t width, uint32_t height,
+						   uint32_t first, bool part)
+	: path_(path),
+	format_(format),
+	width_(width),
+	height_(height),
+	first_(first),
+	file_(nullptr, fclose),
+	queue_(),
+	closed_(false),
+	error_(),
+	mutex_(),
+	cv_(),
+	frames_(0),
+	bytes_(0),
+	start_(std::chrono::steady_clock::now()),
+	buffer_(),
+	thread_()
+{
+	if (format_ == core::export_format::npy)
+	{
+		// Float arrays are not encoded, see core::mapped_frames
+		export_error(path_, "NumPy arrays are not encoded by frame_writer");
+	}
+	else if (format_ == core::export_format::png)
+	{
+#if !SHADERTOY_CONNECTOR_HAS_PNG
+		export_error(path_, "PNG support is not enabled");
+#else
+		// Check the pattern before rendering anything
+		core::export_frame_path(path_, format_, first_);
+#endif
+	}
+	else if (part)
+	{
+		// Parts are written in place, the header is written by allocate
+		file_.reset(fopen(path_.c_str(), "r+b"));
+		if (!file_)
+			export_error(path_, strerror(errno));
+
+		uint64_t offset = stream_header(format_, width_, height_).size() + frame_bytes(format_, width_, height_) * first_;
+		if (seek(file_.get(), offset) != 0)
+			export_error(path_, strerror(errno));
+	}
+	else
+	{
+		file_.reset(fopen(path_.c_str(), "wb"));
+		if (!file_)
+			export_error(path_, strerror(errno));
+
+		auto header(stream_header(format_, width_, height_));
+		write(header.data(), header.size());
+	}
+
+	thread_ = std::thread([this]() { run(); });
+}
+
+bool frame_writer::allocate(const std::string &path, core::export_format format, uint32_t width, uint32_t height,
+							uint32_t count, bool keep)
+{
+	// Each frame is its own file, they are checked by the caller
+	if (format == core::export_format::png)
+		return true;
+
+	if (format == core::export_format::npy)
+		export_error(path, "NumPy arrays are not encoded by frame_writer");
+
+	auto header(stream_header(format, width, height));
+	uint64_t size = header.size() + frame_bytes(format, width, height) * count;
+
+	struct stat st;
+	if (keep && stat(path.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) == size)
+	{
+		// Only keep a file holding frames of the same size
+		std::unique_ptr<FILE, int (*)(FILE *)> existing(fopen(path.c_str(), "rb"), fclose);
+		std::string existing_header(header.size(), '\0');
+
+		if (existing && fread(&existing_header[0], 1, header.size(), existing.get()) == header.size() &&
+			existing_header == header)
+			return true;
+	}
+
+	std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path.c_str(), "wb"), fclose);
+	if (!file)
+		export_error(path, strerror(errno));
+
+	// The frames are left as a hole until they are written
+	if (fwrite(header.data(), 1, header.size(), file.get()) != header.size() ||
+		(size > header.size() && (seek(file.get(), size - 1) != 0 || fputc(0, file.get()) == EOF)) ||
+		fclose(file.release()) != 0)
+		export_error(path, strerror(errno));
+
+	return false;
+}
+
+frame_writer::~frame_writer()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		closed_ = true;
+		queue_.clear();
+	}
+
+	cv_.notify_all();
+
+	if (thread_.joinable())
+		thread_.join();
+}
+
+void frame_writer::push(const core::image &frame)
+{
+	if (frame.dims[0] != height_ || frame.dims[1] != width_ || frame.dims[2] != 4)
+		export_error(path_, "frame size mismatch");
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	cv_.wait(lock, [this]() { return queue_.size() < queue_depth || error_; });
+
+	if (error_)
+		std::rethrow_exception(error_);
+
+	queue_.push_back(frame);
+	cv_.notify_all();
+}
+
+core::export_summary frame_writer::finish()
+{
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		closed_ = true;
+	}
+
+	cv_.notify_all();
+	thread_.join();
+
+	if (error_)
+		std::rethrow_exception(error_);
+
+	if (file_ && fclose(file_.release()) != 0)
+		export_error(path_, strerror(errno));
+
+	std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - start_);
+	return core::export_summary{ frames_, bytes_, elapsed.count() };
+}
+
+void frame_writer::run()
+{
+	while (true)
+	{
+		core::image frame;
+
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			cv_.wait(lock, [this]() { return !queue_.empty() || closed_; });
+
+			if (queue_.empty())
+				return;
+
+			frame = queue_.front();
+		}
+
+		try
+		{
+			write_frame(frame);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> guard(mutex_);
+			error_ = std::current_exception();
+			queue_.clear();
+			cv_.notify_all();
+			return;
+		}
+
+		// Only make room once the frame is encoded, so its storage is not
+		// reused while it is being read
+		std::lock_guard<std::mutex> guard(mutex_);
+		if (!queue_.empty())
+			queue_.pop_front();
+		cv_.notify_all();
+	}
+}
+
+void frame_writer::write_frame(const core::image &frame)
+{
+	size_t pixels = static_cast<size_t>(width_) * height_;
+
+	switch (format_)
+	{
+	case core::export_format::y4m:
+	{
+		buffer_.resize(3 * pixels);
+		convert_yuv444(frame.data->data(), pixels, buffer_.data());
+
+		const char marker[] = "FRAME\n";
+		write(marker, sizeof(marker) - 1);
+		write(buffer_.data(), buffer_.size());
+		break;
+	}
+
+	case core::export_format::rgba:
+		buffer_.resize(4 * pixels);
+		convert_rgba(frame.data->data(), pixels, buffer_.data());
+		write(buffer_.data(), buffer_.size());
+		break;
+
+	case core::export_format::png:
+	{
+#if SHADERTOY_CONNECTOR_HAS_PNG
+		buffer_.resize(4 * pixels);
+		convert_rgba(frame.data->data(), pixels, buffer_.data());
+
+		auto frame_path(core::export_frame_path(path_, format_, first_ + frames_));
+
+		png_image image;
+		memset(&image, 0, sizeof(image));
+		image.version = PNG_IMAGE_VERSION;
+		image.width = width_;
+		image.height = height_;
+		image.format = PNG_FORMAT_RGBA;
+
+		if (!png_image_write_to_file(&image, frame_path.c_str(), 0, buffer_.data(), 0, nullptr))
+			export_error(frame_path, image.message);
+
+		struct stat st;
+		if (stat(frame_path.c_str(), &st) == 0)
+			bytes_ += st.st_size;
+#endif
+		break;
+	}
+
+	case core::export_format::npy:
+		break;
+	}
+
+	frames_++;
+}
+
+void frame_writer::write(const void *data, size_t size)
+{
+	if (fwrite(data, 1, size, file_.get()) != size)
+		export_error(path_, strerror(errno));
+
+	bytes_ += size;
+}
@@ -1,27 +1,77 @@
+#include <atomic>
+#include <cstdlib>
+#include <iomanip>
+#include <mutex>
+#include <random>
 #include <sstream>
 #include <stdexcept>
 
 #include "stc/core/getpid.h"
+#include "stc/core/mapped_frames.hpp"
 
 #include "stc/gl/context.hpp"
+#include "stc/gl/frame_writer.hpp"
 #include "stc/gl/host.hpp"
 #include "stc/gl/remote.hpp"
 
 using namespace stc;
 using namespace stc::gl;
 
-host::host() : basic_host(), st_window(nullptr), local_counter(0), st_contexts() {}
+/// Number of allocated local contexts, shared by all hosts so ids are unique per process
+static std::atomic<int> local_counter(0);
+
+/// Random token of this process, so local context ids differ between servers
+/// which have the same pid, as they do in separate containers
+static const std::string &process_token()
+{
+	static const std::string token([]() {
+		std::random_device rd;
+		std::stringstream ss;
+		ss << std::hex << std::setfill('0') << std::setw(8) << rd() << std::setw(8) << rd();
+		return ss.str();
+	}());
+
+	return token;
+}
+
+/// Number of hosts which initialized GLFW, so it is only terminated by the last one
+static int glfw_users = 0;
+static std::mutex glfw_mutex;
+
+/// Key of the Shadertoy API
+static const char remote_api_key[] = "fdnKWn";
+
+/// Budget of the texture cache, set in MiB by STC_TEXTURE_CACHE
+static size_t texture_cache_budget()
+{
+	const char *env = std::getenv("STC_TEXTURE_CACHE");
+	return (env && *env ? std::stoull(env) : 256) * 1024 * 1024;
+}
+
+host::host()
+	: basic_host(), st_window(nullptr), default_width_(640), default_height_(360), main_thread_(),
+	st_contexts(), textures_(texture_cache_budget()), loading_(), load_timeout_(), render_ahead_ids_(), ahead_(),
+	m_remoteInit(false), m_glfwInit(false)
+{
+}
 
 host::~host()
 {
+	// Wait for the frame rendered ahead, which uses the OpenGL context
+	finish_ahead();
+
+	// Wait for the pending fetches, which use the remote loading state
+	loading_.clear();
+
 	if (st_window)
 	{
 		// We first need to delete all the StContexts or else GL destructors will
 		// fail because there is no current OpenGL context
 		glfwMakeContextCurrent(st_window);
 
-		// Destroy contexts
+		// Destroy contexts, then the textures they shared
 		st_contexts.clear();
+		textures_.clear();
 
 		// Destroy window
 		glfwDestroyWindow(st_window);
@@ -30,7 +80,9 @@ host::~host()
 
 	if (m_glfwInit)
 	{
-		glfwTerminate();
+		std::lock_guard<std::mutex> guard(glfw_mutex);
+		if (--glfw_users == 0)
+			glfwTerminate();
 		m_glfwInit = false;
 	}
 
@@ -57,9 +109,11 @@ void host::allocate()
 	glfwSetErrorCallback(st_glfwErrorCallback);
 
 	// Initialize GLFW
+	std::lock_guard<std::mutex> guard(glfw_mutex);
 	if (glfwInit())
 	{
 		m_glfwInit = true;
+		glfw_users++;
 
 		// Create the rendering context
 		glfwWindowHint(GLFW_VISIBLE, 0);
@@ -68,6 +122,8 @@ void host::allocate()
 		if (st_window)
 		{
 			glfwMakeContextCurrent(st_window);
+			glfwGetFramebufferSize(st_window, &default_width_, &default_height_);
+			main_thread_ = std::this_thread::get_id();
 
 			// ok
 			return;
@@ -83,11 +139,42 @@ void host::allocate()
 	}
 }
 
+void host::release()
+{
+	discard_ahead();
+
+	glfwMakeContextCurrent(nullptr);
+}
+
 core::image host::render(const std::string &id, boost::optional<int> frame, size_t width, size_t height,
 					 const std::array<float, 4> &mouse, GLenum format)
 {
+	if (auto ahead = finish_ahead())
+	{
+		if (ahead->ctx->id() == id && (!frame || *frame == ahead->frame) && ahead->width == width &&
+			ahead->height == height && ahead->mouse == mouse && ahead->format == format)
+		{
+			try
+			{
+				auto image(ahead->result.get());
+				start_ahead(ahead->ctx, ahead->frame + 1, width, height, mouse, format);
+				return image;
+			}
+			catch (std::exception &)
+			{
+				// Render it again below, to report the error
+			}
+		}
+
+		ahead->ctx->frame_count(ahead->frame);
+	}
+
 	auto context(get_gl_context(id));
 
+	// Events may only be polled from the thread which created the window
+	if (std::this_thread::get_id() == main_thread_)
+		glfwPollEvents();
+
 	// Default value for frame is the current frame count of the context
 	if (!frame)
 		frame = context->frame_count();
@@ -95,12 +182,66 @@ core::image host::render(const std::string &id, boost::optional<int> frame, size
 	// Render the next frame
 	context->perform_render(*frame, width, height, mouse, format);
 
-	// Return the image
-	return context->current_image();
+	// Keep the image before the next frame is rendered ahead into the context
+	auto image(context->current_image());
+
+	// Discarding a frame rendered ahead only rewinds the frame count, so
+	// contexts which keep state in their buffers are rendered on demand
+	if (render_ahead_ids_.count(id) && !context->has_history())
+		start_ahead(context, *frame + 1, width, height, mouse, format);
+
+	return image;
+}
+
+core::image host::render_sound(const std::string &id, uint64_t start, uint32_t count, float rate)
+{
+	return get_gl_context(id)->render_sound(start, count, rate);
+}
+
+core::export_summary host::export_frames(const std::string &id, int first, uint32_t count, size_t width,
+										 size_t height, const std::string &path, core::export_format format)
+{
+	auto context(get_gl_context(id));
+	const std::array<float, 4> mouse{ 0.f, 0.f, 0.f, 0.f };
+
+	if (format == core::export_format::npy)
+	{
+		// Frames are read back straight into the pages of the file
+		core::mapped_frames output(path, count, height, width, 4);
+
+		for (uint32_t i = 0; i < count; ++i)
+		{
+			if (std::this_thread::get_id() == main_thread_)
+				glfwPollEvents();
+
+			context->perform_render(first + static_cast<int>(i), width, height, mouse, GL_RGBA, output.frame(i));
+			output.done(i);
+		}
+
+		return output.finish();
+	}
+
+	frame_writer writer(path, format, width, height);
+
+	for (uint32_t i = 0; i < count; ++i)
+	{
+		if (std::this_thread::get_id() == main_thread_)
+			glfwPollEvents();
+
+		context->perform_render(first + static_cast<int>(i), width, height, mouse, GL_RGBA);
+
+		// The writer holds a reference to the frame until it is encoded, so the
+		// next one is rendered into another buffer meanwhile
+		writer.push(context->current_image());
+	}
+
+	return writer.finish();
 }
 
 void host::reset(const std::string &id)
 {
+	discard_ahead();
+
 	// Ensure we are in the right context
 	glfwMakeContextCurrent(st_window);
 
@@ -115,12 +256,14 @@ void host::reset(const std::string &id)
 
 std::string host::create_local(const std::vector<std::pair<std::string, std::string>> &bufferSources)
 {
+	discard_ahead();
+
 	// Ensure we are in the right context
 	glfwMakeContextCurrent(st_window);
 
 	// Generate unique name
 	std::stringstream name;
-	name << "localshader-" << getpid() << "-" << local_counter++;
+	name << "localshader-" << getpid() << "-" << process_token() << "-" << local_counter++;
 	std::string shaderId(name.str());
 
 	// Create local context
@@ -136,14 +279,102 @@ std::shared_ptr<core::basic_context> host::get_context(const std::string &id)
 
 std::shared_ptr<context> host::get_gl_context(const std::string &id)
 {
+	// The context may be changed by the caller, so the frame rendered ahead
+	// would be stale
+	discard_ahead();
+
 	// Ensure we are in the right context
 	glfwMakeContextCurrent(st_window);
 
 	auto it = st_contexts.find(id);
-	if (it == st_contexts.end())
+	if (it != st_contexts.end())
+		return it->second;
+
+	auto load(fetch(id));
+
+	if (load_timeout_ && load.wait_for(*load_timeout_) != std::future_status::ready)
 	{
-		return new_context(id);
+		std::stringstream ss;
+		ss << "Context " << id << " is still loading";
+		throw std::runtime_error(ss.str());
+	}
+
+	// Failed fetches are retried by the next call
+	loading_.erase(id);
+
+	return new_context(id, *load.get(), textures_);
+}
+
+void host::prefetch(const std::vector<std::string> &ids)
+{
+	const char local[] = "localshader-";
+
+	for (const auto &id : ids)
+	{
+		if (strncmp(id.c_str(), local, sizeof(local) - 1) != 0 && st_contexts.find(id) == st_contexts.end())
+			fetch(id);
+	}
+}
+
+std::shared_future<std::shared_ptr<const remote_shader>> host::fetch(const std::string &id)
+{
+	auto it = loading_.find(id);
+	if (it == loading_.end())
+	{
+		auto load(std::async(std::launch::async, fetch_remote, id, std::string(remote_api_key)));
+		it = loading_.emplace(id, load.share()).first;
 	}
 
 	return it->second;
 }
+
+void host::render_ahead(const std::string &id, bool enable)
+{
+	discard_ahead();
+
+	if (enable)
+		render_ahead_ids_.insert(id);
+	else
+		render_ahead_ids_.erase(id);
+}
+
+void host::start_ahead(std::shared_ptr<context> ctx, int frame, size_t width, size_t height,
+					   const std::array<float, 4> &mouse, GLenum format)
+{
+	// An OpenGL context can only be current on one thread at a time
+	glfwMakeContextCurrent(nullptr);
+
+	auto render = [this, ctx, frame, width, height, mouse, format]() {
+		glfwMakeContextCurrent(st_window);
+
+		try
+		{
+			ctx->perform_render(frame, width, height, mouse, format);
+		}
+		catch (...)
+		{
+			glfwMakeContextCurrent(nullptr);
+			throw;
+		}
+
+		glfwMakeContextCurrent(nullptr);
+		return ctx->current_image();
+	};
+
+	ahead_ = std::make_unique<ahead_frame>(
+	ahead_frame{ ctx, frame, width, height, mouse, format, std::async(std::launch::async, render) });
+}
+
+std::unique_ptr<host::ahead_frame> host::finish_ahead()
+{
+	if (ahead_)
+		ahead_->result.wait();
+
+	return std::move(ahead_);
+}
+
+void host::discard_ahead()
+{
+	if (auto ahead = finish_ahead())
+		ahead->ctx->frame_count(ahead->frame);
+}
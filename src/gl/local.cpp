@@ -78,8 +78,9 @@ void stc::gl::load_local(const std::string &shaderId, const std::vector<std::pai
 		// Add all auxiliary buffers
 		for (auto it = bufferSources.begin(); it != bufferSources.end(); ++it)
 		{
+			// The sound pass is compiled by the context, on first use
 			bool is_override = it->first.find(":") != std::string::npos;
-			if (!is_override)
+			if (!is_override && it->first != "sound")
 			{
 				auto buffer(get_buffer(shaderId, *it));
 				chain.emplace_back(buffer, shadertoy::make_size_ref(render_size));
@@ -1,5 +1,9 @@
+#include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <regex>
 #include <sstream>
 #include <stdexcept>
@@ -17,81 +21,75 @@
 
 #include "stc/core/getpid.h"
 
+#include "stc/gl/downloader.hpp"
 #include "stc/gl/remote.hpp"
+#include "stc/gl/remote_cache.hpp"
 
 namespace fs = boost::filesystem;
 
-static std::shared_ptr<spdlog::logger> connector_api_logger;
-
 std::shared_ptr<spdlog::logger> remote_logger()
 {
-	if (!connector_api_logger)
-	{
-		connector_api_logger = spdlog::stderr_color_mt("shadertoy-api");
-	}
-
+	// Shaders are fetched from several threads
+	static std::shared_ptr<spdlog::logger> connector_api_logger(spdlog::stderr_color_mt("shadertoy-api"));
 	return connector_api_logger;
 }
 
-void stc::gl::init_remote()
+struct stc::gl::remote_shader
 {
-	// Init CURL
-	curl_global_init(CURL_GLOBAL_DEFAULT);
-}
+	/// Shader spec returned by the API
+	Json::Value spec;
 
-void stc::gl::free_remote()
-{
-	// Cleanup CURL
-	curl_global_cleanup();
-}
+	/// Local paths of the input files, by source path on the API server
+	std::map<std::string, fs::path> files;
+};
 
-size_t curl_write_data(char *buffer, size_t size, size_t nmemb, void *userp)
-{
-	std::ostream &ss = *static_cast<std::ostream *>(userp);
-	size_t sz = size * nmemb;
-	ss.write(buffer, sz);
-	return sz;
-}
+/// Downloader shared by all hosts, so they reuse each other's connections
+static std::unique_ptr<stc::gl::downloader> remote_downloader;
+static std::unique_ptr<stc::gl::remote_cache> remote_files;
+static int remote_users = 0;
+static std::mutex remote_mutex;
 
-void file_get(CURL *curl, const std::string &url, const fs::path &dst)
+void stc::gl::init_remote()
 {
-	std::ofstream ofs(dst.string(), std::ios::out | std::ios::binary);
-
-	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_data);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ofs);
+	std::lock_guard<std::mutex> guard(remote_mutex);
 
-	CURLcode res = curl_easy_perform(curl);
-	if (res != CURLE_OK)
+	if (remote_users++ == 0)
 	{
-		throw std::runtime_error(curl_easy_strerror(res));
+		// Init CURL
+		curl_global_init(CURL_GLOBAL_DEFAULT);
+		remote_downloader = std::make_unique<downloader>();
+		remote_files = remote_cache::from_environment();
 	}
-
-	ofs.close();
 }
 
-std::stringstream curl_get(CURL *curl, const std::string &url)
+void stc::gl::free_remote()
 {
-	std::stringstream ss;
+	std::lock_guard<std::mutex> guard(remote_mutex);
 
-	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curl_write_data);
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ss);
-
-	CURLcode res = curl_easy_perform(curl);
-	if (res != CURLE_OK)
+	if (--remote_users == 0)
 	{
-		throw std::runtime_error(curl_easy_strerror(res));
+		// Cleanup CURL
+		remote_files.reset();
+		remote_downloader.reset();
+		curl_global_cleanup();
 	}
+}
 
-	return ss;
+std::string stc::gl::api_base_url()
+{
+	const char *env = std::getenv("STC_API_URL");
+	std::string url(env && *env ? env : "https://www.shadertoy.com");
+
+	while (!url.empty() && url.back() == '/')
+		url.pop_back();
+
+	return url;
 }
 
-Json::Value json_get(CURL *curl, const std::string &url)
+/// Returns true for inputs loaded from a file served by the API
+bool is_file_input(const Json::Value &input)
 {
-	Json::Value result;
-	curl_get(curl, url) >> result;
-	return result;
+	return input["ctype"].compare("texture") == 0 || input["ctype"].compare("cubemap") == 0;
 }
 
 std::string to_buffer_name(const Json::Value &pass)
@@ -135,27 +133,15 @@ void apply_sampler_options(std::shared_ptr<shadertoy::inputs::basic_input> &buff
 }
 
 void load_nonbuffer_input(std::shared_ptr<shadertoy::inputs::basic_input> &buffer_input,
-						  const Json::Value &input, CURL *curl, const fs::path &tmpdir, int i)
+						  const Json::Value &input, const stc::gl::remote_shader &shader,
+						  stc::gl::texture_cache &textures, int i)
 {
 	auto &sampler(input["sampler"]);
 
-	if (input["ctype"].compare("texture") == 0 || input["ctype"].compare("cubemap") == 0)
+	if (is_file_input(input))
 	{
-		fs::path srcpath(input["src"].asString());
-		std::string url = std::string("https://www.shadertoy.com") + input["src"].asString();
-		fs::path dstpath(tmpdir / srcpath.filename());
-
-		if (!fs::exists(dstpath))
-		{
-			remote_logger()->info("Downloading {}", url);
-			file_get(curl, url, dstpath);
-		}
-		else
-		{
-			remote_logger()->info("Using cache for {}", url);
-		}
-
-		shadertoy::utils::input_loader loader;
+		// The file was downloaded beforehand
+		fs::path dstpath(shader.files.at(input["src"].asString()));
 
 		auto uri(dstpath.string());
 		std::transform(uri.begin(), uri.end(), uri.begin(), [](char cc) {
@@ -164,10 +150,8 @@ void load_nonbuffer_input(std::shared_ptr<shadertoy::inputs::basic_input> &buffe
 			return cc;
 		});
 
-		buffer_input = loader.create("file:///" + uri);
-
-		if (buffer_input)
-			std::static_pointer_cast<shadertoy::inputs::file_input>(buffer_input)->vflip(sampler["vflip"].compare("true") == 0);
+		// Contexts using the same file share its texture
+		buffer_input = textures.acquire("file:///" + uri, sampler["vflip"].compare("true") == 0);
 
 		apply_sampler_options(buffer_input, sampler);
 	}
@@ -203,34 +187,115 @@ void load_buffer_input(std::shared_ptr<shadertoy::inputs::basic_input> &buffer_i
 	}
 }
 
-void stc::gl::load_remote(const std::string &shaderId, const std::string &shaderApiKey, shadertoy::render_context &context,
-						  shadertoy::swap_chain &chain, const shadertoy::rsize &render_size)
+std::shared_ptr<const stc::gl::remote_shader> stc::gl::fetch_remote(const std::string &shaderId,
+																	 const std::string &shaderApiKey)
 {
-	CURL *curl = curl_easy_init();
+	if (!remote_downloader)
+		throw std::runtime_error("Remote loading is not initialized");
 
-	// Put everything in tmp
-	fs::path basedir(fs::temp_directory_path());
+	auto &dl(*remote_downloader);
+	auto &cache(*remote_files);
+	auto base_url(api_base_url());
 
-	if (!curl)
-	{
-		throw std::runtime_error("Failed to initialize curl");
-	}
+	auto result(std::make_shared<remote_shader>());
 
 	try
 	{
-		std::string endpoint = std::string("https://www.shadertoy.com/api/v1/shaders/") + shaderId +
-							   std::string("?key=") + shaderApiKey;
-		Json::Value shaderSpec = json_get(curl, endpoint);
+		// Errors from ShaderToy are thrown by the cache
+		bool fetched;
+		Json::Value shaderSpec = cache.load_shader(dl, base_url, shaderId, shaderApiKey, fetched);
+
+		if (!fetched)
+			remote_logger()->info("Using cache for shader {}", shaderId);
 
-		// Check errors from ShaderToy
-		if (!shaderSpec["Error"].isNull())
+		// Download all the missing input files at once
+		std::vector<downloader::download> downloads;
+		std::vector<fs::path> used_files{ cache.shader_path(shaderId) };
+
+		for (const auto &pass : shaderSpec["Shader"]["renderpass"])
 		{
-			throw std::runtime_error(shaderSpec["Error"].asString().c_str());
+			for (const auto &input : pass["inputs"])
+			{
+				if (!is_file_input(input))
+					continue;
+
+				std::string url = base_url + input["src"].asString();
+				fs::path dstpath(cache.media_path(input["src"].asString()));
+
+				if (std::find(used_files.begin(), used_files.end(), dstpath) != used_files.end())
+					continue;
+
+				used_files.push_back(dstpath);
+				result->files.emplace(input["src"].asString(), dstpath);
+
+				if (fs::exists(dstpath))
+				{
+					remote_logger()->info("Using cache for {}", url);
+				}
+				else if (cache.offline())
+				{
+					std::stringstream ss;
+					ss << "Input " << url << " is not in the cache (offline mode)";
+					throw std::runtime_error(ss.str());
+				}
+				else
+				{
+					remote_logger()->info("Downloading {}", url);
+					fs::create_directories(dstpath.parent_path());
+					downloads.push_back(downloader::download{ url, dstpath.string() });
+				}
+			}
 		}
 
-		std::ofstream dump((basedir / fs::path(shaderId + std::string(".json"))).string());
-		dump << shaderSpec;
-		dump.close();
+		dl.fetch_all(downloads);
+
+		cache.touch(used_files);
+
+		// Only make room once this shader is in the cache
+		if (fetched || !downloads.empty())
+			cache.evict(used_files);
+
+		result->spec = shaderSpec;
+	}
+	catch (std::exception &ex)
+	{
+		// Rethrow
+		throw std::runtime_error(ex.what());
+	}
+
+	return result;
+}
+
+std::string stc::gl::remote_sound_source(const remote_shader &shader)
+{
+	std::string common, sound;
+
+	for (const auto &pass : shader.spec["Shader"]["renderpass"])
+	{
+		auto type(pass["type"].asString());
+
+		if (type.compare("common") == 0)
+			common += pass["code"].asString() + "\n";
+		else if (type.compare("sound") == 0)
+			sound = pass["code"].asString();
+	}
+
+	if (sound.empty())
+		return sound;
+
+	return common + sound;
+}
+
+void stc::gl::load_remote(const std::string &shaderId, const remote_shader &shader, texture_cache &textures,
+						  shadertoy::render_context &context, shadertoy::swap_chain &chain,
+						  const shadertoy::rsize &render_size)
+{
+	// Generated sources go in tmp
+	fs::path basedir(fs::temp_directory_path());
+
+	try
+	{
+		const Json::Value &shaderSpec(shader.spec);
 
 		std::map<std::string, std::shared_ptr<shadertoy::members::buffer_member>> known_buffers;
 
@@ -244,12 +309,9 @@ void stc::gl::load_remote(const std::string &shaderId, const std::string &shader
 			// Find buffer name
 			auto name(to_buffer_name(pass));
 
-			// Skip if sound buffer
+			// Sound passes are not part of the swap chain, see remote_sound_source
 			if (pass["type"].asString().compare("sound") == 0)
-			{
-				remote_logger()->warn("Skipping unsupported sound shader.");
 				continue;
-			}
 
 			// Create buffer
 			auto buffer(std::make_shared<shadertoy::buffers::toy_buffer>(name));
@@ -283,7 +345,7 @@ void stc::gl::load_remote(const std::string &shaderId, const std::string &shader
 				auto &input(pass["inputs"][static_cast<int>(j)]);
 				auto channel_id(input["channel"].asInt());
 
-				load_nonbuffer_input(buffer->inputs()[channel_id].input(), input, curl, basedir, i);
+				load_nonbuffer_input(buffer->inputs()[channel_id].input(), input, shader, textures, i);
 			}
 
 			auto member(shadertoy::members::make_buffer(buffer, shadertoy::make_size_ref(render_size), chain.internal_format(), chain.swap_policy()));
@@ -327,13 +389,7 @@ void stc::gl::load_remote(const std::string &shaderId, const std::string &shader
 	}
 	catch (std::exception &ex)
 	{
-		// Free CURL
-		curl_easy_cleanup(curl);
-
 		// Rethrow
 		throw std::runtime_error(ex.what());
 	}
-
-	// Free CURL
-	curl_easy_cleanup(curl);
 }
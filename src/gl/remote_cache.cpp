@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "stc/gl/remote_cache.hpp"
+
+namespace fs = boost::filesystem;
+
+using namespace stc::gl;
+
+namespace
+{
+
+std::string env_or(const char *name, const std::string &fallback)
+{
+	const char *value = std::getenv(name);
+	return value && *value ? std::string(value) : fallback;
+}
+
+fs::path default_cache_dir()
+{
+	if (const char *xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg)
+		return fs::path(xdg) / "shadertoy-connector";
+
+	if (const char *home = std::getenv("HOME"); home && *home)
+		return fs::path(home) / ".cache" / "shadertoy-connector";
+
+	return fs::temp_directory_path() / "shadertoy-connector";
+}
+
+bool is_part_file(const fs::path &path)
+{
+	return path.extension() == ".part";
+}
+
+/// Writes a file next to its destination, then moves it there
+void write_file(const fs::path &path, const std::string &contents)
+{
+	fs::path part(part_path(path.string()));
+
+	std::ofstream ofs(part.string(), std::ios::out | std::ios::binary);
+	ofs << contents;
+	ofs.close();
+
+	if (!ofs)
+	{
+		fs::remove(part);
+		throw std::runtime_error(std::string("Could not write ") + path.string());
+	}
+
+	fs::rename(part, path);
+}
+
+Json::Value parse_json(const std::string &contents)
+{
+	Json::Value result;
+	std::stringstream ss(contents);
+	ss >> result;
+	return result;
+}
+}
+
+remote_cache::remote_cache(const fs::path &root, uint64_t capacity, std::chrono::seconds max_age, bool offline)
+	: root_(root),
+	capacity_(capacity),
+	max_age_(max_age),
+	offline_(offline),
+	evict_mutex_()
+{
+	fs::create_directories(root_ / "shaders");
+	fs::create_directories(root_ / "media");
+}
+
+std::unique_ptr<remote_cache> remote_cache::from_environment()
+{
+	fs::path root(env_or("STC_CACHE_DIR", default_cache_dir().string()));
+	uint64_t capacity(std::stoull(env_or("STC_CACHE_SIZE", "1024")) * 1024 * 1024);
+	std::chrono::seconds max_age(std::stoll(env_or("STC_CACHE_TTL", "3600")));
+	bool offline(env_or("STC_OFFLINE", "0") != "0");
+
+	return std::make_unique<remote_cache>(root, capacity, max_age, offline);
+}
+
+fs::path remote_cache::shader_path(const std::string &shader_id) const
+{
+	// Ids are used as file names
+	if (shader_id.empty() || !std::all_of(shader_id.begin(), shader_id.end(), [](char c) {
+			return std::isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-';
+		}))
+	{
+		std::stringstream ss;
+		ss << "Invalid shader id " << shader_id;
+		throw std::runtime_error(ss.str());
+	}
+
+	return root_ / "shaders" / (shader_id + ".json");
+}
+
+fs::path remote_cache::media_path(const std::string &src) const
+{
+	// Keep the directory structure of the server, so files with the same
+	// name do not collide
+	fs::path result(root_ / "media");
+
+	for (const auto &part : fs::path(src))
+	{
+		if (part.empty() || part == "/" || part == "." || part == "..")
+			continue;
+
+		result /= part;
+	}
+
+	return result;
+}
+
+Json::Value remote_cache::load_shader(downloader &dl, const std::string &base_url, const std::string &shader_id,
+									  const std::string &shader_key, bool &fetched)
+{
+	fs::path path(shader_path(shader_id));
+	Json::Value entry;
+
+	fetched = false;
+
+	if (fs::exists(path))
+	{
+		std::ifstream ifs(path.string());
+		ifs >> entry;
+
+		auto age(std::chrono::seconds(std::time(nullptr) - entry["validated"].asInt64()));
+		if (offline_ || age < max_age_)
+			return entry["spec"];
+	}
+	else if (offline_)
+	{
+		std::stringstream ss;
+		ss << "Shader " << shader_id << " is not in the cache at " << root_.string() << " (offline mode)";
+		throw std::runtime_error(ss.str());
+	}
+
+	// Revalidate the cached spec, or fetch it
+	std::vector<std::string> headers;
+	if (!entry["etag"].asString().empty())
+		headers.push_back("If-None-Match: " + entry["etag"].asString());
+	if (!entry["last_modified"].asString().empty())
+		headers.push_back("If-Modified-Since: " + entry["last_modified"].asString());
+
+	std::string endpoint = base_url + std::string("/api/v1/shaders/") + shader_id + std::string("?key=") + shader_key;
+	downloader::response res;
+
+	try
+	{
+		res = dl.get(endpoint, headers);
+	}
+	catch (std::runtime_error &)
+	{
+		// A stale spec is better than none when the API is unreachable
+		if (!entry["spec"].isNull())
+			return entry["spec"];
+
+		throw;
+	}
+
+	if (res.status == 304 && !entry["spec"].isNull())
+	{
+		entry["validated"] = Json::Int64(std::time(nullptr));
+	}
+	else
+	{
+		Json::Value spec(parse_json(res.body));
+
+		// Errors are not cached, so they are retried next time
+		if (!spec["Error"].isNull())
+			throw std::runtime_error(spec["Error"].asString().c_str());
+
+		entry = Json::Value(Json::objectValue);
+		entry["validated"] = Json::Int64(std::time(nullptr));
+		entry["etag"] = res.etag;
+		entry["last_modified"] = res.last_modified;
+		entry["spec"] = spec;
+	}
+
+	std::stringstream ss;
+	ss << entry;
+	write_file(path, ss.str());
+	fetched = true;
+
+	return entry["spec"];
+}
+
+void remote_cache::touch(const std::vector<fs::path> &paths)
+{
+	std::time_t now(std::time(nullptr));
+	boost::system::error_code ec;
+
+	// The modification time orders files by last use. Errors are ignored,
+	// another process may have evicted the file.
+	for (const auto &path : paths)
+		fs::last_write_time(path, now, ec);
+}
+
+void remote_cache::evict(const std::vector<fs::path> &keep)
+{
+	std::lock_guard<std::mutex> guard(evict_mutex_);
+
+	struct cached_file
+	{
+		fs::path path;
+		uint64_t size;
+		std::time_t last_use;
+	};
+
+	std::vector<cached_file> files;
+	uint64_t total_size = 0;
+	boost::system::error_code ec;
+
+	for (fs::recursive_directory_iterator it(root_, ec), end; !ec && it != end; it.increment(ec))
+	{
+		if (!fs::is_regular_file(it->status()) || is_part_file(it->path()))
+			continue;
+
+		boost::system::error_code file_ec;
+		cached_file file{ it->path(), fs::file_size(it->path(), file_ec), fs::last_write_time(it->path(), file_ec) };
+		if (file_ec)
+			continue;
+
+		total_size += file.size;
+
+		if (std::find(keep.begin(), keep.end(), file.path) == keep.end())
+			files.push_back(file);
+	}
+
+	if (total_size <= capacity_)
+		return;
+
+	std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) { return a.last_use < b.last_use; });
+
+	for (const auto &file : files)
+	{
+		if (total_size <= capacity_)
+			break;
+
+		boost::system::error_code file_ec;
+		if (fs::remove(file.path, file_ec))
+			total_size -= file.size;
+	}
+}
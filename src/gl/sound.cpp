@@ -0,0 +1,242 @@
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <regex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "stc/gl/sound.hpp"
+
+using namespace stc;
+using namespace stc::gl;
+
+namespace
+{
+
+const char vertex_source[] = R"GLSL(#version 330
+void main()
+{
+	// Full screen triangle
+	vec2 pos = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
+)GLSL";
+
+const char fragment_header[] = R"GLSL(#version 330
+uniform float iSampleRate;
+uniform float iBlockOffset;
+uniform int iSampleOffset;
+uniform int iBlockWidth;
+uniform vec4 iDate;
+uniform float iChannelTime[4];
+uniform vec3 iChannelResolution[4];
+uniform sampler2D iChannel0;
+uniform sampler2D iChannel1;
+uniform sampler2D iChannel2;
+uniform sampler2D iChannel3;
+layout(location = 0) out vec4 stc_Sample;
+)GLSL";
+
+GLuint compile_shader(GLenum type, const std::vector<const char *> &sources)
+{
+	GLuint shader = glCreateShader(type);
+	glShaderSource(shader, sources.size(), sources.data(), nullptr);
+	glCompileShader(shader);
+
+	GLint status;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+
+	if (status != GL_TRUE)
+	{
+		GLint length = 0;
+		glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &length);
+
+		std::string log(std::max(length, 1), '\0');
+		glGetShaderInfoLog(shader, length, nullptr, &log[0]);
+		glDeleteShader(shader);
+
+		std::stringstream ss;
+		ss << "Sound shader compilation error: " << log.c_str();
+		throw std::runtime_error(ss.str());
+	}
+
+	return shader;
+}
+
+/// Saves the GL state changed by sound rendering, and restores it
+class state_guard
+{
+	GLint framebuffer_, program_, vertex_array_;
+	std::array<GLint, 4> viewport_;
+
+public:
+	state_guard()
+	{
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer_);
+		glGetIntegerv(GL_CURRENT_PROGRAM, &program_);
+		glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertex_array_);
+		glGetIntegerv(GL_VIEWPORT, viewport_.data());
+	}
+
+	~state_guard()
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+		glUseProgram(program_);
+		glBindVertexArray(vertex_array_);
+		glViewport(viewport_[0], viewport_[1], viewport_[2], viewport_[3]);
+	}
+};
+}
+
+sound_renderer::sound_renderer(const std::string &source)
+	: program_(0),
+	vertex_array_(0),
+	texture_(0),
+	framebuffer_(0)
+{
+	// Older sound shaders only take the time as an argument
+	std::regex rgx_sample_arg("mainSound\\s*\\(\\s*int\\b");
+	bool sample_arg = std::regex_search(source, rgx_sample_arg);
+
+	std::string main_source(R"GLSL(
+void main()
+{
+	int samp = int(gl_FragCoord.y) * iBlockWidth + int(gl_FragCoord.x);
+	float time = iBlockOffset + float(samp) / iSampleRate;
+)GLSL");
+	main_source += sample_arg ? "\tstc_Sample = vec4(mainSound(iSampleOffset + samp, time), 0.0, 1.0);\n"
+							  : "\tstc_Sample = vec4(mainSound(time), 0.0, 1.0);\n";
+	main_source += "}\n";
+
+	// #line keeps error messages relative to the sound pass source
+	GLuint vs = compile_shader(GL_VERTEX_SHADER, { vertex_source });
+	GLuint fs;
+
+	try
+	{
+		fs = compile_shader(GL_FRAGMENT_SHADER, { fragment_header, "#line 1\n", source.c_str(), main_source.c_str() });
+	}
+	catch (...)
+	{
+		glDeleteShader(vs);
+		throw;
+	}
+
+	program_ = glCreateProgram();
+	glAttachShader(program_, vs);
+	glAttachShader(program_, fs);
+	glLinkProgram(program_);
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	GLint status;
+	glGetProgramiv(program_, GL_LINK_STATUS, &status);
+
+	if (status != GL_TRUE)
+	{
+		GLint length = 0;
+		glGetProgramiv(program_, GL_INFO_LOG_LENGTH, &length);
+
+		std::string log(std::max(length, 1), '\0');
+		glGetProgramInfoLog(program_, length, nullptr, &log[0]);
+		glDeleteProgram(program_);
+
+		std::stringstream ss;
+		ss << "Sound program link error: " << log.c_str();
+		throw std::runtime_error(ss.str());
+	}
+
+	sample_rate_location_ = glGetUniformLocation(program_, "iSampleRate");
+	sample_offset_location_ = glGetUniformLocation(program_, "iSampleOffset");
+	time_offset_location_ = glGetUniformLocation(program_, "iBlockOffset");
+	block_width_location_ = glGetUniformLocation(program_, "iBlockWidth");
+
+	// Render target for a block of stereo samples
+	glGenVertexArrays(1, &vertex_array_);
+
+	glGenTextures(1, &texture_);
+	glBindTexture(GL_TEXTURE_2D, texture_);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, block_width, block_height, 0, GL_RG, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	state_guard guard;
+
+	glGenFramebuffers(1, &framebuffer_);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture_, 0);
+
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+	{
+		glDeleteFramebuffers(1, &framebuffer_);
+		glDeleteTextures(1, &texture_);
+		glDeleteVertexArrays(1, &vertex_array_);
+		glDeleteProgram(program_);
+		throw std::runtime_error("Sound render target is not supported");
+	}
+}
+
+sound_renderer::~sound_renderer()
+{
+	glDeleteFramebuffers(1, &framebuffer_);
+	glDeleteTextures(1, &texture_);
+	glDeleteVertexArrays(1, &vertex_array_);
+	glDeleteProgram(program_);
+}
+
+core::image sound_renderer::render(uint64_t start, uint32_t count, float rate)
+{
+	if (rate <= 0.f)
+		throw std::runtime_error("Invalid sample rate");
+
+	core::image result;
+	result.dims[0] = count;
+	result.dims[1] = 2;
+	result.dims[2] = 1;
+	result.alloc();
+
+	state_guard guard;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+	glUseProgram(program_);
+	glBindVertexArray(vertex_array_);
+
+	glUniform1f(sample_rate_location_, rate);
+	glUniform1i(block_width_location_, block_width);
+
+	// Rows of the last, partial block
+	std::vector<float> partial;
+	const uint32_t block_size = block_width * block_height;
+
+	for (uint32_t done = 0; done < count; done += block_size)
+	{
+		uint32_t samples = std::min(block_size, count - done);
+		GLsizei rows = (samples + block_width - 1) / block_width;
+
+		// The time offset is computed in double precision, so it stays exact
+		// far into the sound
+		uint64_t offset = start + done;
+		glUniform1i(sample_offset_location_, static_cast<GLint>(offset));
+		glUniform1f(time_offset_location_, static_cast<float>(offset / static_cast<double>(rate)));
+
+		glViewport(0, 0, block_width, rows);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		float *dst = result.data->data() + 2 * static_cast<size_t>(done);
+
+		if (samples == static_cast<uint32_t>(rows * block_width))
+		{
+			glReadPixels(0, 0, block_width, rows, GL_RG, GL_FLOAT, dst);
+		}
+		else
+		{
+			partial.resize(2 * static_cast<size_t>(rows) * block_width);
+			glReadPixels(0, 0, block_width, rows, GL_RG, GL_FLOAT, partial.data());
+			memcpy(dst, partial.data(), 2 * sizeof(float) * samples);
+		}
+	}
+
+	return result;
+}
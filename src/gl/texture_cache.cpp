@@ -0,0 +1,209 @@
+#include <algorithm>
+#include <future>
+
+#include <epoxy/gl.h>
+
+#include "stc/gl/texture_cache.hpp"
+#include "stc/gl/texture_decoder.hpp"
+
+using namespace stc::gl;
+
+namespace
+{
+
+/// Returns the path of a local file URI
+std::string uri_path(const std::string &uri)
+{
+	const std::string scheme("file:///");
+	if (uri.compare(0, scheme.size(), scheme) == 0)
+		return uri.substr(scheme.size());
+	return uri;
+}
+}
+
+struct texture_cache::entry
+{
+	/// Texels decoded in the background, until uploaded
+	std::shared_future<decoded_texture> decoded;
+
+	/// Input which loads the texture file, when it was not decoded beforehand
+	std::shared_ptr<shadertoy::inputs::basic_input> source;
+
+	/// Texture uploaded from the decoded texels
+	std::shared_ptr<shadertoy::gl::texture> uploaded;
+
+	/// Loaded texture, null until the first use
+	shadertoy::gl::texture *texture;
+
+	/// Size of the texture and its mipmaps, in bytes
+	size_t size;
+
+	/// Uploads the decoded texels, waiting for them if needed
+	void upload()
+	{
+		try
+		{
+			const auto &texels(decoded.get());
+
+			uploaded = std::make_shared<shadertoy::gl::texture>(GL_TEXTURE_2D);
+			uploaded->image_2d(GL_TEXTURE_2D, 0, GL_RGBA8, texels.width, texels.height, 0, GL_RGBA,
+							   GL_UNSIGNED_BYTE, texels.texels.data());
+			uploaded->generate_mipmap();
+
+			texture = uploaded.get();
+
+			// RGBA8 texels, and a third more for the mipmaps
+			size = static_cast<size_t>(texels.width) * texels.height * 4 * 4 / 3;
+		}
+		catch (std::runtime_error &)
+		{
+			// Leave it to the input loader, which may support this file
+		}
+
+		decoded = std::shared_future<decoded_texture>();
+	}
+
+	shadertoy::gl::texture *load(const std::string &uri, bool vflip)
+	{
+		if (!texture && decoded.valid())
+			upload();
+
+		if (!texture && !source)
+		{
+			shadertoy::utils::input_loader loader;
+			source = loader.create(uri);
+
+			if (auto file = std::dynamic_pointer_cast<shadertoy::inputs::file_input>(source))
+				file->vflip(vflip);
+		}
+
+		if (!texture && source)
+		{
+			// Mipmaps are always generated, so any filter can sample them
+			source->min_filter(GL_LINEAR_MIPMAP_LINEAR);
+			source->load();
+			texture = source->use();
+
+			if (texture)
+			{
+				texture->generate_mipmap();
+
+				GLint width = 0, height = 0;
+				glGetTextureLevelParameteriv(*texture, 0, GL_TEXTURE_WIDTH, &width);
+				glGetTextureLevelParameteriv(*texture, 0, GL_TEXTURE_HEIGHT, &height);
+
+				size = static_cast<size_t>(width) * height * 4 * 4 / 3;
+			}
+		}
+
+		return texture;
+	}
+};
+
+/// Input using a texture of the cache
+class texture_cache::shared_input : public shadertoy::inputs::basic_input
+{
+	std::shared_ptr<entry> entry_;
+	const key key_;
+
+protected:
+	void load_input() override
+	{
+		entry_->load(key_.first, key_.second);
+	}
+
+	void reset_input() override
+	{
+		// Other contexts still use the texture
+	}
+
+	shadertoy::gl::texture *use_input() override
+	{
+		return entry_->load(key_.first, key_.second);
+	}
+
+public:
+	shared_input(std::shared_ptr<entry> entry, const key &k)
+		: entry_(std::move(entry)),
+		key_(k)
+	{
+	}
+};
+
+texture_cache::texture_cache(size_t budget)
+	: budget_(budget),
+	entries_(),
+	retained_()
+{
+}
+
+std::shared_ptr<shadertoy::inputs::basic_input> texture_cache::acquire(const std::string &uri, bool vflip)
+{
+	key k(uri, vflip);
+	auto ptr(entries_[k].lock());
+
+	if (!ptr)
+	{
+		ptr = std::make_shared<entry>(entry{ std::shared_future<decoded_texture>(), nullptr, nullptr, nullptr, 0 });
+
+		auto path(uri_path(uri));
+		if (can_decode_texture(path))
+		{
+			// Decode in the background, while the rest of the context loads
+			ptr->decoded = std::async(std::launch::async, decode_texture, path, vflip).share();
+		}
+		else
+		{
+			shadertoy::utils::input_loader loader;
+			ptr->source = loader.create(uri);
+
+			if (!ptr->source)
+			{
+				entries_.erase(k);
+				return std::shared_ptr<shadertoy::inputs::basic_input>();
+			}
+
+			if (auto file = std::dynamic_pointer_cast<shadertoy::inputs::file_input>(ptr->source))
+				file->vflip(vflip);
+		}
+
+		entries_[k] = ptr;
+	}
+
+	// Mark as most recently used
+	retained_.remove(ptr);
+	retained_.push_front(ptr);
+	trim();
+
+	return std::make_shared<shared_input>(ptr, k);
+}
+
+void texture_cache::trim()
+{
+	size_t size = 0;
+	auto it = retained_.begin();
+
+	for (; it != retained_.end(); ++it)
+	{
+		size += (*it)->size;
+		if (size > budget_ && it != retained_.begin())
+			break;
+	}
+
+	retained_.erase(it, retained_.end());
+
+	// Forget the textures which were freed
+	for (auto eit = entries_.begin(); eit != entries_.end();)
+	{
+		if (eit->second.expired())
+			eit = entries_.erase(eit);
+		else
+			++eit;
+	}
+}
+
+void texture_cache::clear()
+{
+	retained_.clear();
+	entries_.clear();
+}
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#if SHADERTOY_CONNECTOR_HAS_PNG
+#include <png.h>
+#endif
+
+#if SHADERTOY_CONNECTOR_HAS_JPEG
+#include <csetjmp>
+#include <jpeglib.h>
+#endif
+
+#include "stc/gl/texture_decoder.hpp"
+
+using namespace stc::gl;
+
+namespace
+{
+
+std::string extension(const std::string &path)
+{
+	auto dot = path.find_last_of('.');
+	if (dot == std::string::npos)
+		return std::string();
+
+	std::string ext(path.substr(dot + 1));
+	std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+	return ext;
+}
+
+[[noreturn]] void decode_error(const std::string &path, const std::string &message)
+{
+	std::stringstream ss;
+	ss << "Could not decode " << path << ": " << message;
+	throw std::runtime_error(ss.str());
+}
+
+void flip_rows(decoded_texture &texture)
+{
+	size_t stride = static_cast<size_t>(texture.width) * 4;
+	std::vector<uint8_t> row(stride);
+
+	for (uint32_t y = 0; y < texture.height / 2; ++y)
+	{
+		uint8_t *top = texture.texels.data() + y * stride;
+		uint8_t *bottom = texture.texels.data() + (texture.height - 1 - y) * stride;
+
+		memcpy(row.data(), top, stride);
+		memcpy(top, bottom, stride);
+		memcpy(bottom, row.data(), stride);
+	}
+}
+
+#if SHADERTOY_CONNECTOR_HAS_PNG
+decoded_texture decode_png(const std::string &path)
+{
+	png_image image;
+	memset(&image, 0, sizeof(image));
+	image.version = PNG_IMAGE_VERSION;
+
+	if (!png_image_begin_read_from_file(&image, path.c_str()))
+		decode_error(path, image.message);
+
+	image.format = PNG_FORMAT_RGBA;
+
+	decoded_texture result{ image.width, image.height, std::vector<uint8_t>(PNG_IMAGE_SIZE(image)) };
+
+	if (!png_image_finish_read(&image, nullptr, result.texels.data(), 0, nullptr))
+	{
+		std::string message(image.message);
+		png_image_free(&image);
+		decode_error(path, message);
+	}
+
+	return result;
+}
+#endif
+
+#if SHADERTOY_CONNECTOR_HAS_JPEG
+struct jpeg_error_handler
+{
+	jpeg_error_mgr mgr;
+	std::jmp_buf jump;
+	char message[JMSG_LENGTH_MAX];
+};
+
+void jpeg_error_exit(j_common_ptr cinfo)
+{
+	auto handler = reinterpret_cast<jpeg_error_handler *>(cinfo->err);
+	(*cinfo->err->format_message)(cinfo, handler->message);
+	std::longjmp(handler->jump, 1);
+}
+
+decoded_texture decode_jpeg(const std::string &path)
+{
+	std::unique_ptr<FILE, int (*)(FILE *)> file(fopen(path.c_str(), "rb"), fclose);
+	if (!file)
+		decode_error(path, "could not open file");
+
+	jpeg_decompress_struct cinfo;
+	jpeg_error_handler handler;
+
+	cinfo.err = jpeg_std_error(&handler.mgr);
+	handler.mgr.error_exit = jpeg_error_exit;
+
+	// Declared before setjmp, so a decoding error does not skip their destructors
+	decoded_texture result{ 0, 0, std::vector<uint8_t>() };
+	std::vector<uint8_t> row;
+
+	if (setjmp(handler.jump))
+	{
+		jpeg_destroy_decompress(&cinfo);
+		decode_error(path, handler.message);
+	}
+
+	jpeg_create_decompress(&cinfo);
+	jpeg_stdio_src(&cinfo, file.get());
+	jpeg_read_header(&cinfo, TRUE);
+
+	cinfo.out_color_space = JCS_RGB;
+	jpeg_start_decompress(&cinfo);
+
+	result.width = cinfo.output_width;
+	result.height = cinfo.output_height;
+	result.texels.resize(static_cast<size_t>(result.width) * result.height * 4);
+	row.resize(static_cast<size_t>(result.width) * 3);
+
+	while (cinfo.output_scanline < cinfo.output_height)
+	{
+		uint8_t *dst = result.texels.data() + static_cast<size_t>(cinfo.output_scanline) * result.width * 4;
+		JSAMPROW rows[1] = { row.data() };
+		jpeg_read_scanlines(&cinfo, rows, 1);
+
+		// Expand to RGBA
+		for (uint32_t x = 0; x < result.width; ++x)
+		{
+			dst[4 * x] = row[3 * x];
+			dst[4 * x + 1] = row[3 * x + 1];
+			dst[4 * x + 2] = row[3 * x + 2];
+			dst[4 * x + 3] = 255;
+		}
+	}
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+
+	return result;
+}
+#endif
+}
+
+bool stc::gl::can_decode_texture(const std::string &path)
+{
+	auto ext(extension(path));
+
+#if SHADERTOY_CONNECTOR_HAS_PNG
+	if (ext == "png")
+		return true;
+#endif
+
+#if SHADERTOY_CONNECTOR_HAS_JPEG
+	if (ext == "jpg" || ext == "jpeg")
+		return true;
+#endif
+
+	return false;
+}
+
+decoded_texture stc::gl::decode_texture(const std::string &path, bool vflip)
+{
+	auto ext(extension(path));
+	decoded_texture result{ 0, 0, std::vector<uint8_t>() };
+
+	if (false)
+	{
+	}
+#if SHADERTOY_CONNECTOR_HAS_PNG
+	else if (ext == "png")
+	{
+		result = decode_png(path);
+	}
+#endif
+#if SHADERTOY_CONNECTOR_HAS_JPEG
+	else if (ext == "jpg" || ext == "jpeg")
+	{
+		result = decode_jpeg(path);
+	}
+#endif
+	else
+	{
+		decode_error(path, "unsupported format");
+	}
+
+	if (vflip)
+		flip_rows(result);
+
+	return result;
+}
@@ -2,6 +2,7 @@
 
 #include "stc/host_manager.hpp"
 
+#include "stc/core/sharded_host.hpp"
 #include "stc/gl/host.hpp"
 
 #if SHADERTOY_CONNECTOR_HAS_ZMQ
@@ -16,29 +17,45 @@ host_manager::host_manager()
 {
 }
 
-core::basic_host &host_manager::current()
+std::unique_ptr<core::basic_host> host_manager::make_host(const std::string &identifier)
 {
-	auto it = known_hosts_.find(current_);
-	if (it == known_hosts_.end())
+	if (identifier.find(',') != std::string::npos)
 	{
-		std::unique_ptr<core::basic_host> new_host;
+		// Comma-separated list of renderers, spread contexts over all of them
+		std::vector<std::string> names;
+		std::vector<std::unique_ptr<core::basic_host>> backends;
 
-		if (current_.compare("local") == 0)
+		std::stringstream ss(identifier);
+		std::string name;
+		while (std::getline(ss, name, ','))
 		{
-			new_host = std::make_unique<gl::host>();
+			backends.emplace_back(make_host(name));
+			names.push_back(name);
 		}
-		else
-		{
+
+		return std::make_unique<core::sharded_host>(names, std::move(backends));
+	}
+
+	if (identifier.compare("local") == 0)
+	{
+		return std::make_unique<gl::host>();
+	}
+
 #if SHADERTOY_CONNECTOR_HAS_ZMQ
-			new_host = std::make_unique<client::net_host>(current_);
+	return std::make_unique<client::net_host>(identifier);
 #else
-			std::stringstream ss;
-			ss << "Cannot create host object for " << current_ << " because libzmq support is not enabled";
-			throw std::runtime_error(ss.str());
+	std::stringstream ss;
+	ss << "Cannot create host object for " << identifier << " because libzmq support is not enabled";
+	throw std::runtime_error(ss.str());
 #endif /* SHADERTOY_CONNECTOR_HAS_ZMQ */
-		}
+}
 
-		known_hosts_.emplace(current_, std::move(new_host));
+core::basic_host &host_manager::current()
+{
+	auto it = known_hosts_.find(current_);
+	if (it == known_hosts_.end())
+	{
+		known_hosts_.emplace(current_, make_host(current_));
 
 		it = known_hosts_.find(current_);
 		it->second->allocate();
@@ -9,6 +9,15 @@
 :Evaluate: Mouse       = Symbol["Mouse"];
 :Evaluate: FrameTiming = Symbol["FrameTiming"];
 
+:Evaluate: RenderShadertoySound::usage = "RenderShadertoySound[id, Start -> 0, Samples -> 44100, SampleRate -> 44100] renders the sound pass of a Shadertoy as a list of { left, right } samples";
+:Evaluate: Options[RenderShadertoySound] = { Start -> 0, Samples -> 44100, SampleRate -> 44100 };
+
+:Evaluate: Start      = Symbol["Start"];
+:Evaluate: Samples    = Symbol["Samples"];
+:Evaluate: SampleRate = Symbol["SampleRate"];
+
+:Evaluate: ExportShadertoy::usage = "ExportShadertoy[id, frames, size, path, format] renders frames 0 to frames-1 (or { first, last }) of a Shadertoy at size { width, height }, and writes them to path as a Y4M video, raw RGBA frames, a sequence of PNG files or a NumPy array. It returns { frames, bytes, seconds }";
+
 :Evaluate: ResetShadertoy::usage = "ResetShadertoy[id] resets the rendering context of a Shadertoy";
 
 :Evaluate: CompileShadertoy::usage = "CompileShadertoy[source, \"a\" -> sourceA] compiles source as a Shadertoy and returns its id";
@@ -25,6 +34,12 @@
 
 :Evaluate: SetShadertoyInput::usage = "ResetShadertoyInput[id, input, image] sets the input 'input' of the Shadertoy context 'id' to what was used by the shadertoy beforehand";
 
+:Evaluate: BatchShadertoy::usage = "BatchShadertoy[id, \"image.0\" -> image, \"filter:image.0\" -> Linear, \"render\" -> { frame, width, height }, ...] runs several operations on the Shadertoy context 'id' at once and returns the list of rendered images";
+
+:Evaluate: PrefetchShadertoy::usage = "PrefetchShadertoy[id1, id2, ...] starts loading the Shadertoy contexts 'id1', 'id2', ... in the background";
+
+:Evaluate: SetShadertoyRenderAhead::usage = "SetShadertoyRenderAhead[id, enable] renders the next frame of the Shadertoy context 'id' in the background while the current one is processed";
+
 :Evaluate: Begin["`Private`"]
 
 void st_set_renderer P(( ));
@@ -47,6 +62,26 @@ void st_render P(( ));
 :ReturnType:     Manual
 :End:
 
+void st_render_sound P(( ));
+
+:Begin:
+:Function:       st_render_sound
+:Pattern:        RenderShadertoySound[id_String, OptionsPattern[]]
+:Arguments:      { id, OptionValue[Start], OptionValue[Samples], OptionValue[SampleRate] }
+:ArgumentTypes:  { Manual }
+:ReturnType:     Manual
+:End:
+
+void st_export P(( ));
+
+:Begin:
+:Function:       st_export
+:Pattern:        ExportShadertoy[id_String, frames_, size_, path_String, format_String:""]
+:Arguments:      { id, N[Flatten[{ frames }]], N[Flatten[{ size }]], path, format }
+:ArgumentTypes:  { Manual }
+:ReturnType:     Manual
+:End:
+
 void st_reset P(( ));
 
 :Begin:
@@ -97,6 +132,36 @@ void st_reset_input P(( ));
 :ReturnType:    Manual
 :End:
 
+void st_batch P(( ));
+
+:Begin:
+:Function:      st_batch
+:Pattern:       BatchShadertoy[id_String, ops__Rule]
+:Arguments:     { id, Map[{#[[1]], Which[StringQ[#[[2]]], #[[2]], ImageQ[#[[2]]], ImageData[#[[2]]], Head[#[[2]]] === Symbol, SymbolName[#[[2]]], True, {N[Flatten[{#[[2]]}]]}]} &, List[ops]] }
+:ArgumentTypes: { Manual }
+:ReturnType:    Manual
+:End:
+
+void st_prefetch P(( ));
+
+:Begin:
+:Function:      st_prefetch
+:Pattern:       PrefetchShadertoy[ids__String]
+:Arguments:     { List[ids] }
+:ArgumentTypes: { Manual }
+:ReturnType:    Manual
+:End:
+
+void st_set_render_ahead P(( ));
+
+:Begin:
+:Function:      st_set_render_ahead
+:Pattern:       SetShadertoyRenderAhead[id_String, enable_:True]
+:Arguments:     { id, enable }
+:ArgumentTypes: { Manual }
+:ReturnType:    Manual
+:End:
+
 :Evaluate: End[]
 
 :Evaluate: EndPackage[]
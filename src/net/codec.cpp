@@ -0,0 +1,243 @@
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include "stc/net/codec.hpp"
+
+#if SHADERTOY_CONNECTOR_HAS_LZ4
+#include <lz4.h>
+#endif
+
+#if SHADERTOY_CONNECTOR_HAS_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace stc;
+using namespace stc::net;
+
+namespace
+{
+
+/// Zstandard compression level, favoring speed over ratio
+const int zstd_level = 3;
+
+/// XORs the 32-bit words of a frame with a base frame
+void xor_frames(const core::image_data &a, const core::image_data &b, std::vector<uint32_t> &out)
+{
+	if (a.size() != b.size())
+		throw std::runtime_error("Delta base frame size mismatch");
+
+	out.resize(a.size());
+
+	const uint32_t *pa = reinterpret_cast<const uint32_t *>(a.data());
+	const uint32_t *pb = reinterpret_cast<const uint32_t *>(b.data());
+
+	for (size_t i = 0; i < out.size(); ++i)
+		out[i] = pa[i] ^ pb[i];
+}
+
+void compress(codec c, const void *src, size_t size, std::vector<char> &out)
+{
+	switch (c)
+	{
+#if SHADERTOY_CONNECTOR_HAS_LZ4
+	case codec::lz4:
+	{
+		if (size > LZ4_MAX_INPUT_SIZE)
+			throw std::runtime_error("Frame too large for LZ4");
+
+		out.resize(LZ4_compressBound(static_cast<int>(size)));
+		int written = LZ4_compress_default(static_cast<const char *>(src), out.data(),
+										   static_cast<int>(size), static_cast<int>(out.size()));
+		if (written <= 0)
+			throw std::runtime_error("LZ4 compression failed");
+
+		out.resize(written);
+		break;
+	}
+#endif
+#if SHADERTOY_CONNECTOR_HAS_ZSTD
+	case codec::zstd:
+	{
+		out.resize(ZSTD_compressBound(size));
+		size_t written = ZSTD_compress(out.data(), out.size(), src, size, zstd_level);
+		if (ZSTD_isError(written))
+		{
+			std::stringstream ss;
+			ss << "Zstandard compression failed: " << ZSTD_getErrorName(written);
+			throw std::runtime_error(ss.str());
+		}
+
+		out.resize(written);
+		break;
+	}
+#endif
+	case codec::none:
+		out.resize(size);
+		memcpy(out.data(), src, size);
+		break;
+	default:
+	{
+		std::stringstream ss;
+		ss << "Unsupported codec " << codec_name(c);
+		throw std::runtime_error(ss.str());
+	}
+	}
+}
+
+void decompress(codec c, const void *src, size_t size, void *dst, size_t dst_size)
+{
+	switch (c)
+	{
+#if SHADERTOY_CONNECTOR_HAS_LZ4
+	case codec::lz4:
+	{
+		int read = LZ4_decompress_safe(static_cast<const char *>(src), static_cast<char *>(dst),
+									   static_cast<int>(size), static_cast<int>(dst_size));
+		if (read < 0 || static_cast<size_t>(read) != dst_size)
+			throw std::runtime_error("LZ4 decompression failed");
+		break;
+	}
+#endif
+#if SHADERTOY_CONNECTOR_HAS_ZSTD
+	case codec::zstd:
+	{
+		size_t read = ZSTD_decompress(dst, dst_size, src, size);
+		if (ZSTD_isError(read))
+		{
+			std::stringstream ss;
+			ss << "Zstandard decompression failed: " << ZSTD_getErrorName(read);
+			throw std::runtime_error(ss.str());
+		}
+
+		if (read != dst_size)
+			throw std::runtime_error("Unexpected decompressed frame size");
+		break;
+	}
+#endif
+	case codec::none:
+		if (size != dst_size)
+			throw std::runtime_error("Unexpected buffer size in reply");
+		memcpy(dst, src, size);
+		break;
+	default:
+	{
+		std::stringstream ss;
+		ss << "Unsupported codec " << codec_name(c);
+		throw std::runtime_error(ss.str());
+	}
+	}
+}
+}
+
+codec net::parse_codec(const std::string &name)
+{
+	for (auto c : { codec::none, codec::lz4, codec::zstd, codec::delta_lz4, codec::delta_zstd })
+		if (name.compare(codec_name(c)) == 0)
+			return c;
+
+	std::stringstream ss;
+	ss << "Unknown codec '" << name << "'";
+	throw std::runtime_error(ss.str());
+}
+
+const char *net::codec_name(codec c)
+{
+	switch (c)
+	{
+	case codec::none:
+		return "none";
+	case codec::lz4:
+		return "lz4";
+	case codec::zstd:
+		return "zstd";
+	case codec::delta_lz4:
+		return "delta-lz4";
+	case codec::delta_zstd:
+		return "delta-zstd";
+	}
+
+	return "unknown";
+}
+
+bool net::codec_supported(codec c)
+{
+	switch (codec_without_delta(c))
+	{
+	case codec::none:
+		return true;
+	case codec::lz4:
+		return SHADERTOY_CONNECTOR_HAS_LZ4;
+	case codec::zstd:
+		return SHADERTOY_CONNECTOR_HAS_ZSTD;
+	default:
+		return false;
+	}
+}
+
+bool net::codec_is_delta(codec c)
+{
+	return c == codec::delta_lz4 || c == codec::delta_zstd;
+}
+
+codec net::codec_without_delta(codec c)
+{
+	switch (c)
+	{
+	case codec::delta_lz4:
+		return codec::lz4;
+	case codec::delta_zstd:
+		return codec::zstd;
+	default:
+		return c;
+	}
+}
+
+void net::encode_frame(codec c, const core::image_data &data, const core::image_data *base,
+					   std::vector<char> &out)
+{
+	if (codec_is_delta(c))
+	{
+		if (!base)
+			throw std::runtime_error("Delta codec requires a base frame");
+
+		std::vector<uint32_t> delta;
+		xor_frames(data, *base, delta);
+		compress(codec_without_delta(c), delta.data(), delta.size() * sizeof(uint32_t), out);
+	}
+	else
+	{
+		compress(c, data.data(), data.size() * sizeof(float), out);
+	}
+}
+
+void net::decode_frame(codec c, const void *src, size_t size, const core::image_data *base,
+					   core::image_data &data)
+{
+	decompress(codec_without_delta(c), src, size, data.data(), data.size() * sizeof(float));
+
+	if (codec_is_delta(c))
+	{
+		if (!base || base->size() != data.size())
+			throw std::runtime_error("Missing delta base frame");
+
+		uint32_t *pd = reinterpret_cast<uint32_t *>(data.data());
+		const uint32_t *pb = reinterpret_cast<const uint32_t *>(base->data());
+
+		for (size_t i = 0; i < data.size(); ++i)
+			pd[i] ^= pb[i];
+	}
+}
+
+uint64_t net::first_sequence()
+{
+	std::random_device rd;
+
+	uint32_t epoch;
+	do
+		epoch = rd();
+	while (epoch == 0);
+
+	return static_cast<uint64_t>(epoch) << 32;
+}
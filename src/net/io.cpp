@@ -17,6 +17,12 @@ void io::send_empty(int flags)
 	socket_.send(msg, flags);
 }
 
+void io::send_message(zmq::message_t &msg, int flags)
+{
+	log_->debug("send({}): <output suppressed>", msg.size());
+	socket_.send(msg, flags);
+}
+
 void io::send_string(const std::string &str, int flags)
 {
 	log_->debug("send({}): '{}'", str.size(), str);
@@ -48,6 +54,14 @@ bool io::recv_wait(int timeout)
 	return false;
 }
 
+bool io::recv_more()
+{
+	int more;
+	size_t opt = sizeof(int);
+	socket_.getsockopt(ZMQ_RCVMORE, &more, &opt);
+	return more != 0;
+}
+
 void io::recv_empty(int flags)
 {
 	zmq::message_t msg;
@@ -75,8 +89,8 @@ void io::send_data_noout<core::image>(const core::image &img, int flags)
 	// Send image dimensions
 	send_data_noout(img.dims, ZMQ_SNDMORE | flags);
 
-	// Send buffer
-	send_buf(*img.data, flags);
+	// Send buffer, without copying it
+	send_shared_buf(img.data, flags);
 }
 
 template <>
@@ -85,9 +99,63 @@ void io::recv_data_noout<core::image>(core::image &img, int flags)
 	// Get image dimensions
 	recv_data_noout(img.dims, flags);
 
+	// Allocate storage, reusing the current buffer if it has the right size
+	img.alloc();
+
+	// Get data, straight into the image storage
+	recv_buf(*img.data, flags);
+}
+
+message_reader::message_reader(std::shared_ptr<spdlog::logger> &log, std::vector<zmq::message_t> &&parts)
+	: log_(log),
+	parts_(std::move(parts)),
+	next_(0)
+{
+}
+
+zmq::message_t &message_reader::next_part()
+{
+	if (next_ >= parts_.size())
+		throw std::runtime_error("Unexpected end of reply");
+
+	return parts_[next_++];
+}
+
+const zmq::message_t &message_reader::recv_message()
+{
+	auto &part(next_part());
+	log_->debug("recv({}): <output suppressed>", part.size());
+	return part;
+}
+
+void message_reader::recv_empty()
+{
+	auto &part(next_part());
+	assert(part.size() == 0);
+	log_->debug("recv(0)");
+}
+
+std::string message_reader::recv_string()
+{
+	auto &part(next_part());
+
+	std::string result(reinterpret_cast<char*>(part.data()),
+					   reinterpret_cast<char*>(part.data()) + part.size());
+
+	log_->debug("recv({}): '{}'", result.size(), result);
+
+	return result;
+}
+
+template <>
+void message_reader::recv_data_noout<core::image>(core::image &img)
+{
+	// Get image dimensions
+	recv_data_noout(img.dims);
+
 	// Allocate storage
 	img.alloc();
 
 	// Get data
-	recv_buf(*img.data, flags);
+	recv_buf(*img.data);
 }
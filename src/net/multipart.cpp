@@ -0,0 +1,109 @@
+#include "stc/net/multipart.hpp"
+#include "stc/net/protocol.hpp"
+
+using namespace stc;
+using namespace stc::net;
+
+bool net::recv_multipart(zmq::socket_t &socket, std::vector<zmq::message_t> &parts)
+{
+	int more;
+	do
+	{
+		parts.emplace_back();
+		if (!socket.recv(&parts.back()))
+			return false;
+
+		size_t opt = sizeof(int);
+		socket.getsockopt(ZMQ_RCVMORE, &more, &opt);
+	}
+	while (more);
+
+	return true;
+}
+
+void net::send_multipart(zmq::socket_t &socket, std::vector<zmq::message_t> &parts, size_t first)
+{
+	for (size_t i = first; i < parts.size(); ++i)
+		socket.send(parts[i], i + 1 < parts.size() ? ZMQ_SNDMORE : 0);
+}
+
+std::string net::part_string(const zmq::message_t &part)
+{
+	return std::string(static_cast<const char *>(part.data()), part.size());
+}
+
+size_t net::find_delimiter(const std::vector<zmq::message_t> &parts, size_t first)
+{
+	size_t delimiter = first;
+	while (delimiter < parts.size() && parts[delimiter].size() != 0)
+		delimiter++;
+
+	return delimiter;
+}
+
+bool net::parse_route_key(const std::vector<zmq::message_t> &parts, route_key &key, size_t first)
+{
+	key.delimiter = find_delimiter(parts, first);
+
+	if (key.delimiter + 1 >= parts.size())
+		return false;
+
+	if (is_binary_frame(parts[key.delimiter + 1]))
+	{
+		// Binary requests hold both in their first frame
+		frame_header header;
+
+		try
+		{
+			parse_binary_frame(parts[key.delimiter + 1], header, key.id);
+		}
+		catch (std::runtime_error &)
+		{
+			return false;
+		}
+
+		key.request = opcode_name(static_cast<opcode>(header.opcode));
+		return true;
+	}
+
+	key.request = part_string(parts[key.delimiter + 1]);
+	key.id.clear();
+
+	if (key.delimiter + 2 < parts.size())
+		key.id = part_string(parts[key.delimiter + 2]);
+
+	return true;
+}
+
+bool net::parse_reply_status(const std::vector<zmq::message_t> &parts, std::string &value, size_t first)
+{
+	auto delimiter(find_delimiter(parts, first));
+	value.clear();
+
+	if (delimiter + 1 >= parts.size())
+		return false;
+
+	if (is_binary_frame(parts[delimiter + 1]))
+	{
+		frame_header header;
+
+		try
+		{
+			parse_binary_frame(parts[delimiter + 1], header, value);
+		}
+		catch (std::runtime_error &)
+		{
+			return false;
+		}
+
+		return (header.flags & flag_error) == 0;
+	}
+
+	if (part_string(parts[delimiter + 1]).compare("OK") != 0)
+		return false;
+
+	if (delimiter + 2 < parts.size())
+		value = part_string(parts[delimiter + 2]);
+
+	return true;
+}
@@ -0,0 +1,140 @@
+#include <sstream>
+
+#include "stc/net/protocol.hpp"
+
+using namespace stc;
+using namespace stc::net;
+
+const char *net::opcode_name(opcode op)
+{
+	switch (op)
+	{
+	case opcode::ping:
+		return "ping";
+	case opcode::render:
+		return "render";
+	case opcode::reset:
+		return "reset";
+	case opcode::create_local:
+		return "create_local";
+	case opcode::get_context:
+		return "get_context";
+	case opcode::set_input:
+		return "set_input";
+	case opcode::set_input_filter:
+		return "set_input_filter";
+	case opcode::reset_input:
+		return "reset_input";
+	case opcode::batch:
+		return "batch";
+	case opcode::prefetch:
+		return "prefetch";
+	case opcode::render_sound:
+		return "render_sound";
+	case opcode::export_frames:
+		return "export";
+	}
+
+	return "unknown";
+}
+
+uint8_t net::opcode_version(opcode op)
+{
+	switch (op)
+	{
+	case opcode::prefetch:
+		return 3;
+	case opcode::render_sound:
+		return 4;
+	case opcode::export_frames:
+		return 5;
+	default:
+		return 1;
+	}
+}
+
+bool net::is_binary_frame(const zmq::message_t &part)
+{
+	uint32_t magic;
+	if (part.size() < sizeof(frame_header))
+		return false;
+
+	memcpy(&magic, part.data(), sizeof(magic));
+	return magic == binary_magic;
+}
+
+void binary_writer::write_string(const std::string &str)
+{
+	write<uint32_t>(str.size());
+
+	auto offset(buf_.size());
+	buf_.resize(offset + str.size());
+	memcpy(buf_.data() + offset, str.data(), str.size());
+}
+
+binary_reader::binary_reader(const void *data, size_t size)
+	: ptr_(static_cast<const char *>(data)),
+	end_(static_cast<const char *>(data) + size)
+{
+}
+
+void binary_reader::check(size_t size) const
+{
+	if (static_cast<size_t>(end_ - ptr_) < size)
+		throw std::runtime_error("Unexpected end of binary message");
+}
+
+std::string binary_reader::read_string()
+{
+	auto size(read<uint32_t>());
+	check(size);
+
+	std::string result(ptr_, size);
+	ptr_ += size;
+	return result;
+}
+
+zmq::message_t net::make_binary_frame(opcode op, uint16_t flags, uint64_t request_id, const std::string &id,
+									  const binary_writer &args, uint8_t version)
+{
+	frame_header header;
+	header.magic = binary_magic;
+	header.version = version;
+	header.opcode = static_cast<uint8_t>(op);
+	header.flags = flags;
+	header.request_id = request_id;
+	header.id_size = id.size();
+	header.args_size = args.data().size();
+
+	zmq::message_t part(sizeof(header) + id.size() + args.data().size());
+	char *ptr = static_cast<char *>(part.data());
+
+	memcpy(ptr, &header, sizeof(header));
+	memcpy(ptr + sizeof(header), id.data(), id.size());
+	memcpy(ptr + sizeof(header) + id.size(), args.data().data(), args.data().size());
+
+	return part;
+}
+
+binary_reader net::parse_binary_frame(const zmq::message_t &part, frame_header &header, std::string &id)
+{
+	if (!is_binary_frame(part))
+		throw std::runtime_error("Not a binary protocol frame");
+
+	memcpy(&header, part.data(), sizeof(header));
+
+	if (header.version < binary_min_version || header.version > binary_version)
+	{
+		std::stringstream ss;
+		ss << "Unsupported binary protocol version " << static_cast<int>(header.version);
+		throw std::runtime_error(ss.str());
+	}
+
+	if (sizeof(header) + static_cast<size_t>(header.id_size) + header.args_size != part.size())
+		throw std::runtime_error("Binary frame size mismatch");
+
+	const char *ptr = static_cast<const char *>(part.data()) + sizeof(header);
+	id.assign(ptr, header.id_size);
+
+	return binary_reader(ptr + header.id_size, header.args_size);
+}
@@ -0,0 +1,219 @@
+#include <atomic>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "stc/net/shm_ring.hpp"
+
+using namespace stc;
+using namespace stc::net;
+
+namespace stc
+{
+namespace net
+{
+
+/// Header at the start of the shared memory, followed by the data area
+struct alignas(64) shm_ring_header
+{
+	uint64_t magic;
+	uint64_t capacity;
+	/// Logical write position, incremented before payloads are written
+	std::atomic<uint64_t> head;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shm_ring requires lock-free 64-bit atomics");
+}
+}
+
+namespace
+{
+
+const uint64_t shm_ring_magic = 0x676e697274637473ull;
+
+#ifndef _WIN32
+std::string next_ring_name()
+{
+	static std::atomic<int> counter(0);
+
+	std::stringstream ss;
+	ss << "/stc-" << getpid() << "-" << counter++;
+	return ss.str();
+}
+
+std::string errno_message(const char *what, const std::string &name)
+{
+	std::stringstream ss;
+	ss << what << " " << name << ": " << strerror(errno);
+	return ss.str();
+}
+#endif
+}
+
+#ifndef _WIN32
+
+shm_ring::shm_ring(size_t capacity)
+	: name_(next_ring_name()),
+	map_(nullptr),
+	map_size_(sizeof(shm_ring_header) + capacity),
+	header_(nullptr),
+	data_(nullptr),
+	write_mutex_()
+{
+	if (capacity == 0)
+		throw std::runtime_error("Shared memory ring capacity must be positive");
+
+	int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+	if (fd < 0)
+		throw std::runtime_error(errno_message("Could not create shared memory", name_));
+
+	if (ftruncate(fd, map_size_) != 0)
+	{
+		auto msg(errno_message("Could not resize shared memory", name_));
+		close(fd);
+		shm_unlink(name_.c_str());
+		throw std::runtime_error(msg);
+	}
+
+	map_ = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map_ == MAP_FAILED)
+	{
+		shm_unlink(name_.c_str());
+		throw std::runtime_error(errno_message("Could not map shared memory", name_));
+	}
+
+	header_ = new (map_) shm_ring_header;
+	header_->magic = shm_ring_magic;
+	header_->capacity = capacity;
+	header_->head.store(0);
+
+	data_ = static_cast<char *>(map_) + sizeof(shm_ring_header);
+}
+
+shm_ring::shm_ring(const std::string &name)
+	: name_(name),
+	map_(nullptr),
+	map_size_(0),
+	header_(nullptr),
+	data_(nullptr),
+	write_mutex_()
+{
+	int fd = shm_open(name_.c_str(), O_RDWR, 0);
+	if (fd < 0)
+		throw std::runtime_error(errno_message("Could not open shared memory", name_));
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(shm_ring_header))
+	{
+		close(fd);
+		throw std::runtime_error(errno_message("Invalid shared memory", name_));
+	}
+
+	map_size_ = st.st_size;
+	map_ = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map_ == MAP_FAILED)
+		throw std::runtime_error(errno_message("Could not map shared memory", name_));
+
+	header_ = static_cast<shm_ring_header *>(map_);
+	if (header_->magic != shm_ring_magic || header_->capacity == 0 || header_->capacity + sizeof(shm_ring_header) > map_size_)
+	{
+		munmap(map_, map_size_);
+
+		std::stringstream ss;
+		ss << name_ << " is not a shared memory ring";
+		throw std::runtime_error(ss.str());
+	}
+
+	data_ = static_cast<char *>(map_) + sizeof(shm_ring_header);
+}
+
+shm_ring::~shm_ring()
+{
+	munmap(map_, map_size_);
+}
+
+void shm_ring::unlink()
+{
+	shm_unlink(name_.c_str());
+}
+
+#else
+
+shm_ring::shm_ring(size_t)
+{
+	throw std::runtime_error("Shared memory transport is not supported on this platform");
+}
+
+shm_ring::shm_ring(const std::string &)
+{
+	throw std::runtime_error("Shared memory transport is not supported on this platform");
+}
+
+shm_ring::~shm_ring()
+{
+}
+
+void shm_ring::unlink()
+{
+}
+
+#endif
+
+uint64_t shm_ring::capacity() const
+{
+	return header_->capacity;
+}
+
+bool shm_ring::write(const void *src, size_t size, shm_slot &slot)
+{
+	uint64_t capacity = header_->capacity;
+	if (size > capacity)
+		return false;
+
+	{
+		std::lock_guard<std::mutex> guard(write_mutex_);
+
+		// Skip the end of the data area if the payload does not fit
+		uint64_t position = header_->head.load(std::memory_order_relaxed);
+		if (position % capacity + size > capacity)
+			position += capacity - position % capacity;
+
+		slot.position = position;
+		slot.size = size;
+
+		// Publish the new head before overwriting older payloads, so readers
+		// of these payloads notice
+		header_->head.store(position + size, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+	}
+
+	memcpy(data_ + slot.position % capacity, src, size);
+	return true;
+}
+
+const void *shm_ring::data(const shm_slot &slot) const
+{
+	uint64_t capacity = header_->capacity;
+	if (slot.size > capacity || slot.position % capacity + slot.size > capacity)
+		throw std::runtime_error("Shared memory slot out of bounds");
+
+	return data_ + slot.position % capacity;
+}
+
+bool shm_ring::valid(const shm_slot &slot) const
+{
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return header_->head.load(std::memory_order_relaxed) <= slot.position + header_->capacity;
+}
@@ -0,0 +1,53 @@
+#include "stc/server/blob_store.hpp"
+
+using namespace stc::server;
+
+blob_store::blob_store(size_t capacity)
+	: capacity_(capacity),
+	size_(0),
+	usage_(),
+	blobs_(),
+	mutex_()
+{
+}
+
+void blob_store::put(const std::string &digest, blob data)
+{
+	if (data->size() > capacity_)
+		return;
+
+	std::lock_guard<std::mutex> guard(mutex_);
+
+	auto it = blobs_.find(digest);
+	if (it != blobs_.end())
+	{
+		usage_.splice(usage_.begin(), usage_, it->second.usage);
+		return;
+	}
+
+	// Evict the least recently used blobs. Requests still using them keep
+	// their contents alive.
+	while (size_ + data->size() > capacity_ && !usage_.empty())
+	{
+		auto victim = blobs_.find(usage_.back());
+		size_ -= victim->second.data->size();
+		blobs_.erase(victim);
+		usage_.pop_back();
+	}
+
+	usage_.push_front(digest);
+	size_ += data->size();
+	blobs_.emplace(digest, entry{ std::move(data), usage_.begin() });
+}
+
+blob blob_store::find(const std::string &digest)
+{
+	std::lock_guard<std::mutex> guard(mutex_);
+
+	auto it = blobs_.find(digest);
+	if (it == blobs_.end())
+		return blob();
+
+	usage_.splice(usage_.begin(), usage_, it->second.usage);
+	return it->second.data;
+}
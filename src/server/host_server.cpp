@@ -1,4 +1,13 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include <boost/variant.hpp>
 
@@ -11,10 +20,17 @@
 #include <signal.h>
 #endif
 
+#include "stc/server/blob_store.hpp"
 #include "stc/server/host_server.hpp"
 #include "stc/core/basic_context.hpp"
+#include "stc/core/batch.hpp"
 #include "stc/gl/host.hpp"
+#include "stc/net/codec.hpp"
 #include "stc/net/io.hpp"
+#include "stc/net/multipart.hpp"
+#include "stc/net/protocol.hpp"
+#include "stc/net/sha256.hpp"
+#include "stc/net/shm_ring.hpp"
 
 using namespace stc;
 using namespace stc::server;
@@ -24,10 +40,53 @@ namespace stc
 namespace server
 {
 
-class host_server_impl
+/// Number of stream frames queued on the way to each subscriber
+const int stream_hwm = 2;
+
+/**
+ * Shared memory rings attached by clients on the same host. Any worker may
+ * write frames to them, whichever worker processed the attach request.
+ */
+class shm_registry
 {
-	const std::string bind_address_;
-	zmq::context_t context_;
+	std::map<std::string, std::shared_ptr<net::shm_ring>> rings_;
+	std::mutex mutex_;
+
+public:
+	void attach(const std::string &name)
+	{
+		auto ring(std::make_shared<net::shm_ring>(name));
+
+		std::lock_guard<std::mutex> guard(mutex_);
+		rings_[name] = ring;
+	}
+
+	void detach(const std::string &name)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		rings_.erase(name);
+	}
+
+	std::shared_ptr<net::shm_ring> find(const std::string &name)
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+
+		auto it = rings_.find(name);
+		if (it == rings_.end())
+			return std::shared_ptr<net::shm_ring>();
+
+		return it->second;
+	}
+};
+
+/**
+ * Worker thread owning a rendering context. Requests are forwarded by the
+ * front end over an inproc socket, prefixed by the routing envelope of the
+ * client which is sent back verbatim before the reply.
+ */
+class host_worker
+{
+	const size_t index_;
 	zmq::socket_t socket_;
 
 	gl::host rendering_context_;
@@ -35,6 +94,68 @@ class host_server_impl
 
 	net::io io_;
 
+	/// Number of delta bases kept per context, so a client which did not
+	/// receive the latest frames, because it pipelined requests or dropped a
+	/// reply, still gets deltas against an older frame it has
+	static constexpr size_t max_delta_bases = 4;
+
+	/// Last frames sent to clients using a delta codec, by context id and
+	/// sequence number
+	std::map<std::string, std::map<uint64_t, std::shared_ptr<core::image_data>>> delta_bases_;
+
+	/// Sequence number of the last encoded frame sent by this worker, from a
+	/// random epoch, see net::first_sequence
+	uint64_t last_sequence_;
+
+	/// Socket frames of subscriptions are pushed to, and the endpoint clients
+	/// subscribe to
+	zmq::socket_t stream_socket_;
+	net::io stream_io_;
+	const std::string &publish_address_;
+
+	shm_registry &rings_;
+
+	/// Blobs shared by all workers
+	blob_store &blobs_;
+
+	/// Directory exports are written to, empty if exports are disabled
+	const std::string export_dir_;
+
+	/// Time streams run without being renewed, zero for no limit
+	const std::chrono::milliseconds stream_lease_;
+
+	/// Blobs attached to the current request, and the blobs it references
+	/// which could not be found
+	std::map<std::string, blob> attached_;
+	std::vector<std::string> missing_;
+
+	/// Context rendered continuously for a subscriber
+	struct stream
+	{
+		std::string context_id;
+		uint32_t width;
+		uint32_t height;
+		std::array<float, 4> mouse;
+		GLenum format;
+		net::codec codec;
+		/// Time between frames, zero to render as fast as possible
+		std::chrono::steady_clock::duration interval;
+		std::chrono::steady_clock::time_point next_frame;
+		/// Number of frames left to render, zero for unlimited
+		uint32_t frames_left;
+		/// Time the stream stops unless its client renews it
+		std::chrono::steady_clock::time_point lease_end;
+		uint64_t sequence;
+		uint64_t dropped;
+	};
+
+	/// Active streams, by stream id
+	std::map<std::string, stream> streams_;
+	uint64_t stream_counter_;
+
+	std::atomic<bool> &continue_;
+	std::thread thread_;
+
 	void handle_context_set_input(const std::shared_ptr<core::basic_context> &context)
 	{
 		// Get input specification
@@ -96,35 +217,457 @@ class host_server_impl
 		io_.send_string("OK");
 	}
 
+	/**
+	 * Picks the codec actually used for a frame, falling back to a keyframe
+	 * when the base the client has is not one of the last frames we sent it.
+	 */
+	net::codec select_codec(const std::string &id, const core::image &img, net::codec requested,
+							uint64_t base_sequence, const core::image_data *&base)
+	{
+		base = nullptr;
+
+		if (!net::codec_supported(requested))
+			return net::codec::none;
+
+		if (net::codec_is_delta(requested))
+		{
+			auto bases = delta_bases_.find(id);
+			if (bases != delta_bases_.end())
+			{
+				auto it = bases->second.find(base_sequence);
+				if (it != bases->second.end() && it->second->size() == img.data->size())
+				{
+					base = it->second.get();
+					return requested;
+				}
+			}
+
+			return net::codec_without_delta(requested);
+		}
+
+		return requested;
+	}
+
+	/// Parameters of a render request, in either protocol
+	struct render_args
+	{
+		std::string id;
+		int32_t frame;
+		uint32_t width;
+		uint32_t height;
+		std::array<float, 4> mouse;
+		int32_t format;
+		/// true if the client asked for encoding details in the reply
+		bool encoded;
+		net::codec codec;
+		uint64_t base_sequence;
+		/// Shared memory ring of clients on the same host, empty if none
+		std::string ring_name;
+	};
+
+	/// Frame rendered for a request, ready to be sent in either protocol
+	struct rendered_frame
+	{
+		core::image img;
+		net::codec codec;
+		uint64_t sequence;
+		/// Encoded payload, null if the frame is sent raw
+		std::shared_ptr<std::vector<char>> payload;
+		/// true if the payload was written to the client's shared memory ring
+		bool in_ring;
+		net::shm_slot slot;
+	};
+
+	/// Size of the payload of a frame, as sent
+	static size_t payload_size(const rendered_frame &frame)
+	{
+		return frame.payload ? frame.payload->size() : frame.img.data->size() * sizeof(float);
+	}
+
+	/**
+	 * Writes the payload of a frame to a shared memory ring.
+	 *
+	 * @return false if the frame is larger than the ring
+	 */
+	static bool write_to_ring(net::shm_ring &ring, rendered_frame &frame)
+	{
+		const void *bytes = frame.payload ? static_cast<const void *>(frame.payload->data())
+										  : frame.img.data->data();
+
+		frame.in_ring = ring.write(bytes, payload_size(frame), frame.slot);
+		return frame.in_ring;
+	}
+
+	/**
+	 * Writes the frames of a batch to a shared memory ring, as long as they
+	 * do not overwrite each other: the client reads them once the whole reply
+	 * arrives. The others are sent in the reply.
+	 */
+	void write_to_ring(const std::string &ring_name, std::vector<rendered_frame> &frames)
+	{
+		auto ring(rings_.find(ring_name));
+		if (!ring)
+			return;
+
+		// The frames span their total size, plus the end of the data area
+		// which is skipped at most once, when a frame does not fit there
+		uint64_t total = 0, largest = 0;
+
+		for (auto &frame : frames)
+		{
+			uint64_t size = payload_size(frame);
+			total += size;
+			largest = std::max(largest, size);
+
+			if (total + largest > ring->capacity() || !write_to_ring(*ring, frame))
+			{
+				log_->debug("Batch does not fit in shared memory {}, sending frames in the reply", ring_name);
+				break;
+			}
+		}
+	}
+
+	/**
+	 * Renders a frame and prepares its payload. Throws on errors, before
+	 * anything is sent.
+	 */
+	rendered_frame render_frame(const render_args &args)
+	{
+		boost::optional<int> frame_opt;
+		if (args.frame > std::numeric_limits<int>::min())
+			frame_opt = args.frame;
+
+		rendered_frame result;
+		result.img = rendering_context_.render(args.id, frame_opt, args.width, args.height, args.mouse, args.format);
+		result.codec = net::codec::none;
+		result.sequence = 0;
+		result.in_ring = false;
+
+		if (!args.encoded)
+			return result;
+
+		const core::image_data *base;
+		result.codec = select_codec(args.id, result.img, args.codec, args.base_sequence, base);
+
+		if (result.codec != net::codec::none)
+		{
+			result.payload = std::make_shared<std::vector<char>>();
+			net::encode_frame(result.codec, *result.img.data, base, *result.payload);
+			log_->debug("Encoded frame with {}: {} -> {} bytes", net::codec_name(result.codec),
+						result.img.data->size() * sizeof(float), result.payload->size());
+		}
+
+		result.sequence = ++last_sequence_;
+
+		if (!args.ring_name.empty())
+		{
+			// Frames larger than the ring are sent in the reply
+			if (auto ring = rings_.find(args.ring_name))
+				write_to_ring(*ring, result);
+		}
+
+		// Keep the frame as a base of the next deltas. Holding a reference
+		// makes the context render the next frame into new storage instead of
+		// overwriting this one.
+		if (net::codec_is_delta(args.codec))
+		{
+			auto &bases(delta_bases_[args.id]);
+			bases[result.sequence] = result.img.data;
+
+			while (bases.size() > max_delta_bases)
+				bases.erase(bases.begin());
+		}
+
+		log_->info("Rendered frame {} for {}", args.frame, args.id);
+		return result;
+	}
+
 	void handle_render()
+	{
+		render_args args;
+		args.id = io_.recv_string();
+		args.frame = io_.recv_data<int32_t>();
+		args.width = io_.recv_data<uint32_t>();
+		args.height = io_.recv_data<uint32_t>();
+		args.mouse = io_.recv_data_noout<std::array<float, 4>>();
+		args.format = io_.recv_data<int32_t>();
+
+		// Optional payload encoding, only sent by clients which support it
+		args.encoded = io_.recv_more();
+		args.codec = net::codec::none;
+		args.base_sequence = 0;
+
+		if (args.encoded)
+		{
+			args.codec = static_cast<net::codec>(io_.recv_data<uint8_t>());
+			args.base_sequence = io_.recv_data<uint64_t>();
+
+			if (io_.recv_more())
+				args.ring_name = io_.recv_string();
+		}
+
+		try
+		{
+			auto result(render_frame(args));
+
+			io_.send_string("OK", ZMQ_SNDMORE);
+
+			// Send frame timing
+			io_.send_data(result.img.frame_timing, ZMQ_SNDMORE);
+
+			if (args.encoded)
+			{
+				// Send encoding details
+				io_.send_data<uint8_t>(static_cast<uint8_t>(result.codec), ZMQ_SNDMORE);
+				io_.send_data(result.sequence, ZMQ_SNDMORE);
+				io_.send_data_noout(result.img.dims, ZMQ_SNDMORE);
+
+				if (!args.ring_name.empty())
+					io_.send_data<uint8_t>(result.in_ring ? 1 : 0, ZMQ_SNDMORE);
+
+				if (result.in_ring)
+					io_.send_data_noout(result.slot);
+				else if (result.payload)
+					io_.send_shared_buf(result.payload);
+				else
+					io_.send_shared_buf(result.img.data);
+			}
+			else
+			{
+				// Send image
+				io_.send_data_noout(result.img);
+			}
+		}
+		catch (std::exception &ex)
+		{
+			log_->warn("Could not render context {}: {}", args.id, ex.what());
+
+			io_.send_string("ERROR", ZMQ_SNDMORE);
+			io_.send_string(ex.what());
+		}
+	}
+
+	void handle_subscribe()
+	{
+		stream st;
+		st.context_id = io_.recv_string();
+		st.width = io_.recv_data<uint32_t>();
+		st.height = io_.recv_data<uint32_t>();
+		st.mouse = io_.recv_data_noout<std::array<float, 4>>();
+		st.format = io_.recv_data<int32_t>();
+		auto rate(io_.recv_data<float>());
+		st.frames_left = io_.recv_data<uint32_t>();
+		st.codec = net::codec_without_delta(static_cast<net::codec>(io_.recv_data<uint8_t>()));
+
+		// Published frames may be dropped, so they cannot be delta-encoded
+		if (!net::codec_supported(st.codec))
+			st.codec = net::codec::none;
+
+		st.interval = std::chrono::steady_clock::duration::zero();
+		if (rate > 0.f)
+			st.interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+				std::chrono::duration<double>(1.0 / rate));
+
+		st.next_frame = std::chrono::steady_clock::now();
+		st.lease_end = stream_lease_.count() > 0 ? st.next_frame + stream_lease_
+												 : std::chrono::steady_clock::time_point::max();
+		st.sequence = 0;
+		st.dropped = 0;
+
+		try
+		{
+			// Fail early if the context cannot be loaded
+			rendering_context_.get_context(st.context_id);
+
+			std::stringstream ss;
+			ss << "stream-" << index_ << "-" << ++stream_counter_;
+			auto stream_id(ss.str());
+
+			log_->info("Streaming {} as {} at {} fps", st.context_id, stream_id, rate);
+			streams_.emplace(stream_id, st);
+
+			// Clients which do not know about leases ignore the last frame
+			io_.send_string("OK", ZMQ_SNDMORE);
+			io_.send_string(stream_id, ZMQ_SNDMORE);
+			io_.send_string(publish_address_, ZMQ_SNDMORE);
+			io_.send_data<uint32_t>(stream_lease_.count());
+		}
+		catch (std::exception &ex)
+		{
+			log_->warn("Could not stream context {}: {}", st.context_id, ex.what());
+
+			io_.send_string("ERROR", ZMQ_SNDMORE);
+			io_.send_string(ex.what());
+		}
+	}
+
+	void handle_unsubscribe()
 	{
 		auto id(io_.recv_string());
-		auto frame(io_.recv_data<int32_t>());
-		auto width(io_.recv_data<uint32_t>());
-		auto height(io_.recv_data<uint32_t>());
-		auto mouse(io_.recv_data_noout<std::array<float, 4>>());
-		auto format(io_.recv_data<int32_t>());
+		auto stream_id(io_.recv_string());
+
+		auto it = streams_.find(stream_id);
+		if (it == streams_.end() || it->second.context_id.compare(id) != 0)
+		{
+			// The stream may have completed already
+			log_->info("Unsubscribe from unknown stream {}", stream_id);
+		}
+		else
+		{
+			log_->info("Stopping stream {} after {} frames, {} dropped", stream_id, it->second.sequence,
+					   it->second.dropped);
+			streams_.erase(it);
+		}
+
+		io_.send_string("OK");
+	}
+
+	void handle_renew()
+	{
+		auto id(io_.recv_string());
+		auto stream_id(io_.recv_string());
+
+		auto it = streams_.find(stream_id);
+		if (it == streams_.end() || it->second.context_id.compare(id) != 0)
+		{
+			// The stream completed, failed or expired
+			io_.send_string("ERROR", ZMQ_SNDMORE);
+			io_.send_string("Unknown stream " + stream_id);
+			return;
+		}
+
+		if (stream_lease_.count() > 0)
+			it->second.lease_end = std::chrono::steady_clock::now() + stream_lease_;
+
+		io_.send_string("OK");
+	}
+
+	void handle_attach_shm()
+	{
+		auto name(io_.recv_string());
 
 		try
 		{
-			boost::optional<int> frame_opt;
-			if (frame > std::numeric_limits<int>::min())
-				frame_opt = frame;
+			rings_.attach(name);
+
+			log_->info("Attached shared memory {}", name);
+			io_.send_string("OK");
+		}
+		catch (std::exception &ex)
+		{
+			log_->warn("Could not attach shared memory {}: {}", name, ex.what());
+
+			io_.send_string("ERROR", ZMQ_SNDMORE);
+			io_.send_string(ex.what());
+		}
+	}
+
+	void handle_detach_shm()
+	{
+		auto name(io_.recv_string());
+		rings_.detach(name);
+
+		log_->info("Detached shared memory {}", name);
+		io_.send_string("OK");
+	}
 
-			auto img(rendering_context_.render(id, frame_opt, width, height, mouse, format));
+	void handle_render_sound()
+	{
+		auto id(io_.recv_string());
+		auto start(io_.recv_data<uint64_t>());
+		auto count(io_.recv_data<uint32_t>());
+		auto rate(io_.recv_data<float>());
+
+		try
+		{
+			auto result(rendering_context_.render_sound(id, start, count, rate));
 
-			log_->info("Rendered frame {} for {}", frame, id);
+			log_->info("Rendered {} samples for {}", count, id);
 			io_.send_string("OK", ZMQ_SNDMORE);
+			io_.send_data_noout(result);
+		}
+		catch (std::exception &ex)
+		{
+			log_->warn("Could not render sound of context {}: {}", id, ex.what());
 
-			// Send frame timing
-			io_.send_data(img.frame_timing, ZMQ_SNDMORE);
+			io_.send_string("ERROR", ZMQ_SNDMORE);
+			io_.send_string(ex.what());
+		}
+	}
+
+	/**
+	 * Resolves the path of an export requested by a client. Clients only
+	 * write below the export directory of the server.
+	 *
+	 * @throws std::runtime_error if exports are disabled, or the path is
+	 *                            outside of the export directory
+	 */
+	std::string export_path(const std::string &path, core::export_format format)
+	{
+		if (export_dir_.empty())
+			throw std::runtime_error("Exports are disabled on this server");
+
+		bool escapes = path.empty() || path[0] == '/';
+		for (size_t start = 0; !escapes && start <= path.size();)
+		{
+			auto end = std::min(path.find('/', start), path.size());
+			escapes = path.compare(start, end - start, "..") == 0;
+			start = end + 1;
+		}
+
+		if (escapes)
+		{
+			std::stringstream ss;
+			ss << "Invalid export path " << path << ", it must be relative to the export directory";
+			throw std::runtime_error(ss.str());
+		}
+
+		// The directory is not part of the frame number pattern
+		std::string dir;
+		for (char c : export_dir_)
+			dir += c == '%' ? "%%" : std::string(1, c);
+
+		return (format == core::export_format::png ? dir : export_dir_) + "/" + path;
+	}
+
+	core::export_summary export_frames(const std::string &id, int first, uint32_t count, uint32_t width,
+									   uint32_t height, const std::string &path, core::export_format format)
+	{
+		if (format != core::export_format::y4m && format != core::export_format::rgba &&
+			format != core::export_format::png && format != core::export_format::npy)
+			throw std::runtime_error("Invalid export format");
 
-			// Send image
-			io_.send_data_noout(img);
+		auto summary(rendering_context_.export_frames(id, first, count, width, height, export_path(path, format),
+													  format));
+
+		log_->info("Exported {} frames of {} to {} ({} bytes in {}s)", summary.frames, id, path, summary.bytes,
+				   summary.seconds);
+		return summary;
+	}
+
+	void handle_export()
+	{
+		auto id(io_.recv_string());
+		auto first(io_.recv_data<int32_t>());
+		auto count(io_.recv_data<uint32_t>());
+		auto width(io_.recv_data<uint32_t>());
+		auto height(io_.recv_data<uint32_t>());
+		auto format(io_.recv_data<uint8_t>());
+		auto path(io_.recv_string());
+
+		try
+		{
+			auto summary(export_frames(id, first, count, width, height, path,
+									   static_cast<core::export_format>(format)));
+
+			io_.send_string("OK", ZMQ_SNDMORE);
+			io_.send_data(summary.frames, ZMQ_SNDMORE);
+			io_.send_data(summary.bytes, ZMQ_SNDMORE);
+			io_.send_data(summary.seconds);
 		}
 		catch (std::exception &ex)
 		{
-			log_->warn("Could not render context {}: {}", id, ex.what());
+			log_->warn("Could not export context {}: {}", id, ex.what());
 
 			io_.send_string("ERROR", ZMQ_SNDMORE);
 			io_.send_string(ex.what());
@@ -187,6 +730,17 @@ class host_server_impl
 		}
 	}
 
+	void handle_prefetch()
+	{
+		auto id(io_.recv_string());
+
+		// Load errors are reported to the requests using the context
+		rendering_context_.prefetch({ id });
+
+		log_->info("Prefetching context {}", id);
+		io_.send_string("OK");
+	}
+
 	void handle_get_context()
 	{
 		auto id(io_.recv_string());
@@ -243,120 +797,1081 @@ class host_server_impl
 			log_->warn("Exception occurred in handle_context, clearing messages");
 			log_->warn("Exception: {}", ex.what());
 
-			// Dump pending messages
-			int value;
-			do
-			{
-				size_t opt = sizeof(int);
-				socket_.getsockopt(ZMQ_RCVMORE, &value, &opt);
-
-				if (value)
-				{
-					zmq::message_t discard;
-					socket_.recv(&discard);
-				}
-			}
-			while (value);
+			discard_pending();
 
 			io_.send_string("ERROR", ZMQ_SNDMORE);
 			io_.send_string(ex.what());
 		}
 	}
 
-	// Signal handling
-	bool continue_;
-
-	static host_server_impl *current_server;
-
-	static void sigterm_handler(int)
+	void discard_pending()
 	{
-		if (current_server)
+		int value;
+		do
 		{
-			current_server->stop();
+			size_t opt = sizeof(int);
+			socket_.getsockopt(ZMQ_RCVMORE, &value, &opt);
+
+			if (value)
+			{
+				zmq::message_t discard;
+				socket_.recv(&discard);
+			}
 		}
+		while (value);
 	}
 
-	void stop()
+	/// Reads the arguments of a binary render request
+	static render_args read_render_args(const std::string &id, net::binary_reader &args)
 	{
-		continue_ = false;
+		render_args rargs;
+		rargs.id = id;
+		rargs.frame = args.read<int32_t>();
+		rargs.width = args.read<uint32_t>();
+		rargs.height = args.read<uint32_t>();
+		rargs.mouse = args.read<std::array<float, 4>>();
+		rargs.format = args.read<int32_t>();
+		rargs.encoded = true;
+		rargs.codec = static_cast<net::codec>(args.read<uint8_t>());
+		rargs.base_sequence = args.read<uint64_t>();
+		rargs.ring_name = args.read_string();
+		return rargs;
 	}
 
-public:
-	host_server_impl(const std::string bind_address)
-		: bind_address_(bind_address),
-		context_(1),
-		socket_(context_, ZMQ_REP),
-		rendering_context_(),
-		log_(spdlog::stderr_color_mt("shadertoy-server")),
-		io_(log_, socket_)
+	/// Writes the encoding details of a rendered frame to a binary reply
+	static void write_render_reply(net::binary_writer &reply, const rendered_frame &result)
 	{
+		reply.write(result.img.frame_timing);
+		reply.write<uint8_t>(static_cast<uint8_t>(result.codec));
+		reply.write(result.sequence);
+		reply.write(result.img.dims);
+		reply.write<uint8_t>(result.in_ring ? 1 : 0);
+
+		if (result.in_ring)
+			reply.write(result.slot);
 	}
 
-	void run()
+	/// Sends the payload frame of a rendered frame, unless it is in shared memory
+	void send_render_payload(const rendered_frame &result, int flags)
 	{
-		// Set current server ptr
-		current_server = this;
-		continue_ = true;
+		if (result.in_ring)
+			return;
 
-#ifndef _WIN32
-		struct sigaction previous_term_handler;
-		struct sigaction previous_int_handler;
+		if (result.payload)
+			io_.send_shared_buf(result.payload, flags);
+		else
+			io_.send_shared_buf(result.img.data, flags);
+	}
 
-		struct sigaction new_handler;
-		new_handler.sa_handler = host_server_impl::sigterm_handler;
-		new_handler.sa_flags = 0;
-		sigemptyset(&new_handler.sa_mask);
+	/**
+	 * Finds a blob referenced by a request, in the blobs attached to it or in
+	 * the blob store. Missing blobs are recorded, so the client can be asked
+	 * for all of them at once.
+	 */
+	blob resolve_blob(const std::string &digest)
+	{
+		auto it = attached_.find(digest);
+		if (it != attached_.end())
+			return it->second;
 
-		sigaction(SIGINT, &new_handler, &previous_int_handler);
-		sigaction(SIGTERM, &new_handler, &previous_term_handler);
-#endif
+		auto data(blobs_.find(digest));
+		if (!data)
+			missing_.push_back(digest);
 
-		log_->info("Creating OpenGL context");
-		rendering_context_.allocate();
+		return data;
+	}
+
+	/**
+	 * Reads the blobs attached to a binary request, which precede its other
+	 * payloads, and adds them to the blob store.
+	 */
+	void read_attached_blobs(std::vector<zmq::message_t> &payloads)
+	{
+		uint32_t count;
+		if (payloads.empty() || payloads[0].size() != sizeof(count))
+			throw std::runtime_error("Missing attached blob count");
 
-		log_->info("Binding to {}", bind_address_);
-		socket_.bind(bind_address_);
+		memcpy(&count, payloads[0].data(), sizeof(count));
+		if (payloads.size() < 1 + static_cast<size_t>(count))
+			throw std::runtime_error("Missing attached blobs");
 
-		while (continue_)
+		for (size_t i = 1; i <= count; ++i)
 		{
-			// Recv request
-			if (!io_.recv_wait(100))
-				continue;
+			const char *bytes = static_cast<const char *>(payloads[i].data());
+			auto data(std::make_shared<const std::vector<char>>(bytes, bytes + payloads[i].size()));
 
-			auto request_name(io_.recv_string());
+			// Blobs are shared with other clients, so their digest is not trusted
+			auto digest(net::sha256::hash(data->data(), data->size()));
 
-			log_->info("Got request header: '{}'", request_name);
+			log_->debug("Received blob {} ({} bytes)", net::sha256::hex(digest), data->size());
 
-			if (request_name.compare("render") == 0)
+			attached_[digest] = data;
+			blobs_.put(digest, data);
+		}
+
+		payloads.erase(payloads.begin(), payloads.begin() + 1 + count);
+	}
+
+	/// Replies to a request which references blobs the server does not have
+	void send_missing(const net::frame_header &header)
+	{
+		log_->info("Asking for {} missing blobs", missing_.size());
+
+		net::binary_writer reply;
+		reply.write<uint32_t>(missing_.size());
+
+		for (const auto &digest : missing_)
+			reply.write_string(digest);
+
+		auto frame(net::make_binary_frame(static_cast<net::opcode>(header.opcode), net::flag_missing,
+										  header.request_id, std::string(), reply, header.version));
+		io_.send_message(frame);
+	}
+
+	/**
+	 * Reads the value of a binary set_input request. Image data is taken
+	 * from the next payload frame, or from a blob from version 2 on. The
+	 * image is null if the blob is missing.
+	 */
+	boost::variant<std::string, std::shared_ptr<core::image>>
+	read_input(net::binary_reader &args, uint8_t version, const std::vector<zmq::message_t> &payloads,
+			   size_t &next_payload)
+	{
+		auto input_type(args.read<uint8_t>());
+
+		if (input_type == 0 || (input_type == 2 && version >= 2))
+		{
+			auto img(std::make_shared<core::image>());
+			img->dims = args.read<std::array<uint32_t, 3>>();
+
+			const void *src;
+			size_t size;
+			blob data;
+
+			if (input_type == 0)
+			{
+				if (next_payload >= payloads.size())
+					throw std::runtime_error("Missing image payload");
+
+				src = payloads[next_payload].data();
+				size = payloads[next_payload].size();
+				next_payload++;
+			}
+			else
+			{
+				data = resolve_blob(args.read_string());
+				if (!data)
+					return std::shared_ptr<core::image>();
+
+				src = data->data();
+				size = data->size();
+			}
+
+			img->alloc();
+
+			size_t bytes = img->data->size() * sizeof(float);
+			if (size != bytes)
+				throw std::runtime_error("Image payload size mismatch");
+
+			memcpy(img->data->data(), src, bytes);
+			return img;
+		}
+		else if (input_type == 1)
+		{
+			return args.read_string();
+		}
+
+		std::stringstream ss;
+		ss << "Unknown input type: " << static_cast<int>(input_type);
+		throw std::runtime_error(ss.str());
+	}
+
+	/// Operation of a batch request, read before any operation is executed
+	struct batch_item
+	{
+		core::batch_kind kind;
+		std::string buffer;
+		uint8_t channel;
+		boost::variant<std::string, std::shared_ptr<core::image>> input;
+		int32_t filter;
+		render_args render;
+	};
+
+	/**
+	 * Executes the operations of a batch request in order, stopping at the
+	 * first error, and sends the frames of its render operations. Nothing is
+	 * executed if the batch references missing blobs.
+	 *
+	 * Since version 6 of the protocol, errors are reported after the frames
+	 * rendered before them. Older clients get an error reply.
+	 */
+	void handle_batch(const net::frame_header &header, const std::string &id, net::binary_reader &args,
+					  const std::vector<zmq::message_t> &payloads)
+	{
+		auto op_count(args.read<uint32_t>());
+		size_t next_payload = 0;
+
+		std::vector<batch_item> items(op_count);
+
+		for (auto &item : items)
+		{
+			item.kind = static_cast<core::batch_kind>(args.read<uint8_t>());
+
+			switch (item.kind)
+			{
+			case core::batch_kind::render:
+				item.render = read_render_args(id, args);
+				break;
+			case core::batch_kind::reset:
+				break;
+			case core::batch_kind::set_input:
+			case core::batch_kind::set_input_filter:
+			case core::batch_kind::reset_input:
+				item.buffer = args.read_string();
+				item.channel = args.read<uint8_t>();
+
+				if (item.kind == core::batch_kind::set_input)
+					item.input = read_input(args, header.version, payloads, next_payload);
+				else if (item.kind == core::batch_kind::set_input_filter)
+					item.filter = args.read<int32_t>();
+				break;
+			default:
+				throw std::runtime_error("Unknown batch operation");
+			}
+		}
+
+		if (!missing_.empty())
+		{
+			send_missing(header);
+			return;
+		}
+
+		std::vector<rendered_frame> frames;
+		std::shared_ptr<core::basic_context> context;
+		std::string ring_name;
+
+		// Index and message of the operation which failed
+		boost::optional<std::pair<uint32_t, std::string>> failed;
+
+		for (uint32_t i = 0; i < items.size() && !failed; ++i)
+		{
+			const auto &item(items[i]);
+
+			try
+			{
+				if (item.kind == core::batch_kind::render)
+				{
+					// Frames are written to shared memory once they are all
+					// rendered, see write_to_ring
+					auto render(item.render);
+					ring_name = render.ring_name;
+					render.ring_name.clear();
+
+					frames.emplace_back(render_frame(render));
+				}
+				else if (item.kind == core::batch_kind::reset)
+				{
+					rendering_context_.reset(id);
+
+					// The context was replaced, later operations apply to the new one
+					context.reset();
+				}
+				else
+				{
+					if (!context)
+						context = rendering_context_.get_context(id);
+
+					if (item.kind == core::batch_kind::set_input)
+						context->set_input(item.buffer, item.channel, item.input);
+					else if (item.kind == core::batch_kind::set_input_filter)
+						context->set_input_filter(item.buffer, item.channel, item.filter);
+					else
+						context->reset_input(item.buffer, item.channel);
+				}
+			}
+			catch (const std::exception &ex)
+			{
+				if (header.version < 6)
+					throw;
+
+				log_->error("Batch operation {} on {} failed: {}", i, id, ex.what());
+				failed = std::make_pair(i, std::string(ex.what()));
+			}
+		}
+
+		if (!failed)
+			log_->info("Executed batch of {} operations on {}", op_count, id);
+
+		if (!ring_name.empty())
+			write_to_ring(ring_name, frames);
+
+		net::binary_writer reply;
+		reply.write<uint32_t>(frames.size());
+
+		size_t payload_count = 0;
+		for (const auto &frame : frames)
+		{
+			write_render_reply(reply, frame);
+			payload_count += frame.in_ring ? 0 : 1;
+		}
+
+		if (header.version >= 6)
+		{
+			reply.write<uint8_t>(failed ? 1 : 0);
+
+			if (failed)
+			{
+				reply.write<uint32_t>(failed->first);
+				reply.write_string(failed->second);
+			}
+		}
+
+		auto frame(net::make_binary_frame(net::opcode::batch, 0, header.request_id, id, reply, header.version));
+		io_.send_message(frame, payload_count > 0 ? ZMQ_SNDMORE : 0);
+
+		for (const auto &result : frames)
+		{
+			if (!result.in_ring)
+				send_render_payload(result, --payload_count > 0 ? ZMQ_SNDMORE : 0);
+		}
+	}
+
+	/**
+	 * Handles a binary protocol request. All its frames are read before
+	 * processing, so errors never leave pending frames behind.
+	 */
+	void handle_binary(const zmq::message_t &header_part)
+	{
+		std::vector<zmq::message_t> payloads;
+		while (io_.recv_more())
+		{
+			payloads.emplace_back();
+			socket_.recv(&payloads.back());
+		}
+
+		net::frame_header header;
+		header.version = net::binary_version;
+		header.opcode = 0;
+		header.request_id = 0;
+
+		attached_.clear();
+		missing_.clear();
+
+		try
+		{
+			std::string id;
+			auto args(net::parse_binary_frame(header_part, header, id));
+			auto op(static_cast<net::opcode>(header.opcode));
+
+			log_->info("Got binary request: '{}'", net::opcode_name(op));
+
+			if (header.version < net::opcode_version(op))
+			{
+				std::stringstream ss;
+				ss << "Operation " << net::opcode_name(op) << " requires binary protocol version "
+				   << static_cast<int>(net::opcode_version(op));
+				throw std::runtime_error(ss.str());
+			}
+
+			if (header.version >= 2 && (header.flags & net::flag_blobs))
+				read_attached_blobs(payloads);
+
+			net::binary_writer reply;
+			std::string reply_id(id);
+
+			switch (op)
+			{
+			case net::opcode::ping:
+				break;
+
+			case net::opcode::render:
+			{
+				auto result(render_frame(read_render_args(id, args)));
+				write_render_reply(reply, result);
+
+				auto frame(net::make_binary_frame(op, 0, header.request_id, reply_id, reply, header.version));
+				io_.send_message(frame, result.in_ring ? 0 : ZMQ_SNDMORE);
+				send_render_payload(result, 0);
+				return;
+			}
+
+			case net::opcode::render_sound:
+			{
+				auto start(args.read<uint64_t>());
+				auto count(args.read<uint32_t>());
+				auto rate(args.read<float>());
+
+				auto result(rendering_context_.render_sound(id, start, count, rate));
+				log_->info("Rendered {} samples for {}", count, id);
+
+				auto frame(net::make_binary_frame(op, 0, header.request_id, reply_id, reply, header.version));
+				io_.send_message(frame, ZMQ_SNDMORE);
+				io_.send_data_noout(result);
+				return;
+			}
+
+			case net::opcode::export_frames:
+			{
+				auto first(args.read<int32_t>());
+				auto count(args.read<uint32_t>());
+				auto width(args.read<uint32_t>());
+				auto height(args.read<uint32_t>());
+				auto format(static_cast<core::export_format>(args.read<uint8_t>()));
+				auto path(args.read_string());
+
+				auto summary(export_frames(id, first, count, width, height, path, format));
+				reply.write(summary.frames);
+				reply.write(summary.bytes);
+				reply.write(summary.seconds);
+				break;
+			}
+
+			case net::opcode::batch:
+				handle_batch(header, id, args, payloads);
+				return;
+
+			case net::opcode::reset:
+				rendering_context_.reset(id);
+				log_->info("Reset context {}", id);
+				break;
+
+			case net::opcode::create_local:
+			{
+				auto part_cnt(args.read<uint32_t>());
+				std::vector<std::pair<std::string, std::string>> buffer_sources;
+
+				for (auto i = 0u; i < part_cnt; ++i)
+				{
+					auto name(args.read_string());
+					auto by_digest(header.version >= 2 && args.read<uint8_t>() != 0);
+					auto source(args.read_string());
+
+					// Large sources are sent as blobs
+					if (by_digest)
+					{
+						auto data(resolve_blob(source));
+						source = data ? std::string(data->begin(), data->end()) : std::string();
+					}
+
+					buffer_sources.emplace_back(name, source);
+				}
+
+				if (!missing_.empty())
+				{
+					send_missing(header);
+					return;
+				}
+
+				// The created id travels in the id field of the reply
+				reply_id = rendering_context_.create_local(buffer_sources);
+				log_->info("Created local context {}", reply_id);
+				break;
+			}
+
+			case net::opcode::get_context:
+				rendering_context_.get_context(id);
+				break;
+
+			case net::opcode::prefetch:
+				rendering_context_.prefetch({ id });
+				log_->info("Prefetching context {}", id);
+				break;
+
+			case net::opcode::set_input:
+			{
+				auto context(rendering_context_.get_context(id));
+				auto buffer(args.read_string());
+				auto channel(args.read<uint8_t>());
+
+				size_t next_payload = 0;
+				auto value(read_input(args, header.version, payloads, next_payload));
+
+				if (!missing_.empty())
+				{
+					send_missing(header);
+					return;
+				}
+
+				context->set_input(buffer, channel, value);
+				break;
+			}
+
+			case net::opcode::set_input_filter:
+			{
+				auto context(rendering_context_.get_context(id));
+				auto buffer(args.read_string());
+				auto channel(args.read<uint8_t>());
+				auto filter(args.read<int32_t>());
+
+				context->set_input_filter(buffer, channel, filter);
+				break;
+			}
+
+			case net::opcode::reset_input:
+			{
+				auto context(rendering_context_.get_context(id));
+				auto buffer(args.read_string());
+				auto channel(args.read<uint8_t>());
+
+				context->reset_input(buffer, channel);
+				break;
+			}
+
+			default:
+				throw std::runtime_error("Unknown binary opcode");
+			}
+
+			auto frame(net::make_binary_frame(op, 0, header.request_id, reply_id, reply, header.version));
+			io_.send_message(frame);
+		}
+		catch (std::exception &ex)
+		{
+			log_->warn("Binary request failed: {}", ex.what());
+
+			net::binary_writer error;
+			error.write_string(ex.what());
+
+			auto frame(net::make_binary_frame(static_cast<net::opcode>(header.opcode), net::flag_error,
+											  header.request_id, std::string(), error, header.version));
+			io_.send_message(frame);
+		}
+
+		// Release the attached blobs which did not fit in the store
+		attached_.clear();
+	}
+
+	void handle_request()
+	{
+		// Forward the routing envelope up to and including the empty delimiter
+		while (true)
+		{
+			zmq::message_t part;
+			socket_.recv(&part);
+
+			bool delimiter = part.size() == 0;
+			socket_.send(part, ZMQ_SNDMORE);
+
+			if (delimiter)
+				break;
+		}
+
+		zmq::message_t header_part;
+		socket_.recv(&header_part);
+
+		if (net::is_binary_frame(header_part))
+		{
+			handle_binary(header_part);
+			return;
+		}
+
+		auto request_name(net::part_string(header_part));
+
+		log_->info("Got request header: '{}'", request_name);
+
+		if (request_name.compare("render") == 0)
+		{
+			handle_render();
+		}
+		else if (request_name.compare("render_sound") == 0)
+		{
+			handle_render_sound();
+		}
+		else if (request_name.compare("export") == 0)
+		{
+			handle_export();
+		}
+		else if (request_name.compare("reset") == 0)
+		{
+			handle_reset();
+		}
+		else if (request_name.compare("create_local") == 0)
+		{
+			handle_create_local();
+		}
+		else if (request_name.compare("get_context") == 0)
+		{
+			handle_get_context();
+		}
+		else if (request_name.compare("prefetch") == 0)
+		{
+			handle_prefetch();
+		}
+		else if (request_name.compare("context") == 0)
+		{
+			handle_context();
+		}
+		else if (request_name.compare("subscribe") == 0)
+		{
+			handle_subscribe();
+		}
+		else if (request_name.compare("unsubscribe") == 0)
+		{
+			handle_unsubscribe();
+		}
+		else if (request_name.compare("renew") == 0)
+		{
+			handle_renew();
+		}
+		else if (request_name.compare("ping") == 0)
+		{
+			// Health check, the reply proves a worker is responsive
+			io_.send_string("OK");
+		}
+		else if (request_name.compare("hello") == 0)
+		{
+			// Protocol negotiation, the client uses the highest binary
+			// protocol version both sides implement
+			uint8_t version(net::binary_version);
+
+			// Clients may also send their version, in which case the
+			// reply is the version both sides agree on
+			if (io_.recv_more())
+				version = std::min(io_.recv_data<uint8_t>(), version);
+
+			io_.send_string("OK", ZMQ_SNDMORE);
+			io_.send_data<uint8_t>(version);
+		}
+		else if (request_name.compare("attach_shm") == 0)
+		{
+			handle_attach_shm();
+		}
+		else if (request_name.compare("detach_shm") == 0)
+		{
+			handle_detach_shm();
+		}
+		else
+		{
+			log_->error("Unknown request name");
+			discard_pending();
+
+			io_.send_string("ERROR", ZMQ_SNDMORE);
+			io_.send_string("Unknown request name");
+		}
+	}
+
+	/**
+	 * Returns how long the worker may wait for requests before the next
+	 * stream frame is due, in milliseconds.
+	 */
+	int stream_timeout() const
+	{
+		auto timeout = std::chrono::milliseconds(100);
+		auto now(std::chrono::steady_clock::now());
+
+		for (const auto &pair : streams_)
+		{
+			auto due(std::chrono::duration_cast<std::chrono::milliseconds>(pair.second.next_frame - now));
+			timeout = std::min(timeout, std::max(due, std::chrono::milliseconds(0)));
+		}
+
+		return static_cast<int>(timeout.count());
+	}
+
+	/**
+	 * Pushes a stream frame to the front end. Frames are dropped instead of
+	 * queued when the front end or the subscribers do not keep up.
+	 *
+	 * @return true if the frame was queued
+	 */
+	bool publish_frame(const std::string &stream_id, stream &st, const core::image &img)
+	{
+		std::shared_ptr<std::vector<char>> payload;
+		if (st.codec != net::codec::none)
+		{
+			payload = std::make_shared<std::vector<char>>();
+			net::encode_frame(st.codec, *img.data, nullptr, *payload);
+		}
+
+		// Topics are NUL-terminated so stream ids are never prefixes of each other
+		zmq::message_t topic(stream_id.size() + 1);
+		memcpy(topic.data(), stream_id.c_str(), stream_id.size() + 1);
+
+		if (!stream_socket_.send(topic, ZMQ_SNDMORE | ZMQ_DONTWAIT))
+			return false;
+
+		// Once the first frame is queued, the whole message is
+		stream_io_.send_data(++st.sequence, ZMQ_SNDMORE);
+		stream_io_.send_data(img.frame_timing, ZMQ_SNDMORE);
+		stream_io_.send_data<uint8_t>(static_cast<uint8_t>(st.codec), ZMQ_SNDMORE);
+		stream_io_.send_data_noout(img.dims, ZMQ_SNDMORE);
+
+		if (payload)
+			stream_io_.send_shared_buf(payload);
+		else
+			stream_io_.send_shared_buf(img.data);
+
+		return true;
+	}
+
+	/// Renders the frames of the streams which are due
+	void render_streams()
+	{
+		auto now(std::chrono::steady_clock::now());
+
+		for (auto it = streams_.begin(); it != streams_.end();)
+		{
+			auto &st(it->second);
+
+			if (st.lease_end < now)
 			{
-				handle_render();
+				// The client went away without unsubscribing
+				log_->info("Stream {} expired after {} frames, {} dropped", it->first, st.sequence, st.dropped);
+				it = streams_.erase(it);
+				continue;
 			}
-			else if (request_name.compare("reset") == 0)
+
+			if (st.next_frame > now)
 			{
-				handle_reset();
+				++it;
+				continue;
 			}
-			else if (request_name.compare("create_local") == 0)
+
+			try
 			{
-				handle_create_local();
+				auto img(rendering_context_.render(st.context_id, boost::none, st.width, st.height, st.mouse, st.format));
+
+				if (!publish_frame(it->first, st, img))
+				{
+					st.dropped++;
+					log_->debug("Dropped frame of stream {} ({} so far)", it->first, st.dropped);
+				}
 			}
-			else if (request_name.compare("get_context") == 0)
+			catch (std::exception &ex)
 			{
-				handle_get_context();
+				log_->warn("Stopping stream {}: {}", it->first, ex.what());
+				it = streams_.erase(it);
+				continue;
 			}
-			else if (request_name.compare("context") == 0)
+
+			// Do not try to catch up on missed frames
+			st.next_frame = std::max(st.next_frame + st.interval, now);
+
+			if (st.frames_left > 0 && --st.frames_left == 0)
 			{
-				handle_context();
+				log_->info("Stream {} completed", it->first);
+				it = streams_.erase(it);
 			}
 			else
 			{
-				log_->error("Unknown request name");
-				io_.send_string("ERROR", ZMQ_SNDMORE);
-				io_.send_string("Unknown request name");
+				++it;
 			}
 		}
+	}
+
+	void run()
+	{
+		while (continue_)
+		{
+			// Recv request
+			if (io_.recv_wait(stream_timeout()))
+				handle_request();
+
+			render_streams();
+		}
+
+		// Hand the GL context back so the host can be destroyed by the main thread
+		rendering_context_.release();
+	}
+
+public:
+	host_worker(size_t index, zmq::context_t &context, std::shared_ptr<spdlog::logger> &log,
+				const std::string &publish_address, shm_registry &rings, blob_store &blobs,
+				std::chrono::milliseconds load_timeout, const std::string &export_dir,
+				std::chrono::milliseconds stream_lease, std::atomic<bool> &cont)
+		: index_(index),
+		socket_(context, ZMQ_PAIR),
+		rendering_context_(),
+		log_(log),
+		io_(log_, socket_),
+		delta_bases_(),
+		last_sequence_(net::first_sequence()),
+		stream_socket_(context, ZMQ_PUSH),
+		stream_io_(log_, stream_socket_),
+		publish_address_(publish_address),
+		rings_(rings),
+		blobs_(blobs),
+		export_dir_(export_dir),
+		stream_lease_(stream_lease),
+		attached_(),
+		missing_(),
+		streams_(),
+		stream_counter_(0),
+		continue_(cont),
+		thread_()
+	{
+		// Fail fast instead of blocking the other contexts of this worker
+		if (load_timeout.count() > 0)
+			rendering_context_.load_timeout(load_timeout);
+	}
+
+	/**
+	 * Allocates the rendering context. GLFW requires this to happen on the
+	 * main thread, the context is then released for the worker thread.
+	 */
+	void allocate()
+	{
+		rendering_context_.allocate();
+		rendering_context_.release();
+	}
+
+	void start(const std::string &endpoint, const std::string &stream_endpoint)
+	{
+		socket_.connect(endpoint);
+
+		// Frames which cannot be queued are dropped, see publish_frame
+		int hwm = stream_hwm;
+		stream_socket_.setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+		stream_socket_.connect(stream_endpoint);
+
+		thread_ = std::thread([this]() { run(); });
+	}
+
+	void join()
+	{
+		if (thread_.joinable())
+			thread_.join();
+	}
+
+	inline size_t index() const
+	{ return index_; }
+};
+
+class host_server_impl
+{
+	const std::string bind_address_;
+	const std::string publish_address_;
+	zmq::context_t context_;
+	zmq::socket_t socket_;
+
+	/// Stream frames pushed by the workers, and the socket they are published on
+	zmq::socket_t stream_socket_;
+	zmq::socket_t publish_socket_;
+
+	std::shared_ptr<spdlog::logger> log_;
+
+	/// Workers, and the front end sockets connected to them
+	std::vector<std::unique_ptr<host_worker>> workers_;
+	std::vector<std::unique_ptr<zmq::socket_t>> worker_sockets_;
+
+	/// Names of the requests being processed by each worker, in order
+	std::vector<std::deque<std::string>> inflight_;
+
+	/// Worker owning each local context. Remote contexts are placed by a
+	/// hash of their id, so they are not recorded.
+	std::map<std::string, size_t> affinity_;
+
+	/// Shared memory rings of local clients
+	shm_registry rings_;
+
+	/// Blobs uploaded by clients
+	blob_store blobs_;
+
+	/**
+	 * Picks the worker for a request. Requests on a known context go to the
+	 * worker which owns it, so the order of requests on a context is kept.
+	 */
+	size_t route(const std::string &request_name, const std::string &id)
+	{
+		if (request_name.compare("create_local") == 0 || request_name.compare("ping") == 0 ||
+			request_name.compare("hello") == 0 || request_name.compare("attach_shm") == 0 ||
+			request_name.compare("detach_shm") == 0)
+		{
+			// New local contexts and requests which are not about a context
+			// go to the least busy worker
+			size_t best = 0;
+			for (size_t i = 1; i < inflight_.size(); ++i)
+				if (inflight_[i].size() < inflight_[best].size())
+					best = i;
+			return best;
+		}
+
+		auto it = affinity_.find(id);
+		if (it != affinity_.end())
+			return it->second;
+
+		// Remote contexts are spread by id
+		return std::hash<std::string>()(id) % workers_.size();
+	}
+
+	void handle_client()
+	{
+		std::vector<zmq::message_t> parts;
+		if (!net::recv_multipart(socket_, parts))
+			return;
+
+		net::route_key key;
+		if (!net::parse_route_key(parts, key))
+		{
+			log_->error("Dropping malformed request");
+			return;
+		}
+
+		auto &request_name(key.request);
+		auto worker(route(request_name, key.id));
+		log_->debug("Dispatching '{}' to worker {}", request_name, worker);
+
+		inflight_[worker].push_back(request_name);
+		net::send_multipart(*worker_sockets_[worker], parts);
+	}
+
+	void handle_stream()
+	{
+		std::vector<zmq::message_t> parts;
+		if (!net::recv_multipart(stream_socket_, parts))
+			return;
+
+		// PUB sockets drop messages for subscribers which reached their HWM
+		net::send_multipart(publish_socket_, parts);
+	}
+
+	void handle_worker(size_t worker)
+	{
+		std::vector<zmq::message_t> parts;
+		if (!net::recv_multipart(*worker_sockets_[worker], parts))
+			return;
+
+		auto request_name(inflight_[worker].front());
+		inflight_[worker].pop_front();
+
+		if (request_name.compare("create_local") == 0)
+		{
+			// Remember which worker owns the new local context
+			std::string context_id;
+			if (net::parse_reply_status(parts, context_id) && !context_id.empty())
+				affinity_[context_id] = worker;
+		}
+
+		net::send_multipart(socket_, parts);
+	}
+
+	// Signal handling
+	std::atomic<bool> continue_;
+
+	static host_server_impl *current_server;
+
+	static void sigterm_handler(int)
+	{
+		if (current_server)
+		{
+			current_server->stop();
+		}
+	}
+
+	void stop()
+	{
+		continue_ = false;
+	}
+
+public:
+	host_server_impl(const host_server_options &options)
+		: bind_address_(options.bind_address),
+		publish_address_(options.publish_address),
+		context_(1),
+		socket_(context_, ZMQ_ROUTER),
+		stream_socket_(context_, ZMQ_PULL),
+		publish_socket_(context_, ZMQ_PUB),
+		log_(spdlog::stderr_color_mt("shadertoy-server")),
+		workers_(),
+		worker_sockets_(),
+		inflight_(options.workers),
+		affinity_(),
+		rings_(),
+		blobs_(options.blob_cache_size),
+		continue_(false)
+	{
+		for (size_t i = 0; i < options.workers; ++i)
+		{
+			workers_.emplace_back(std::make_unique<host_worker>(i, context_, log_, publish_address_, rings_, blobs_,
+																options.load_timeout, options.export_dir,
+																options.stream_lease, continue_));
+			worker_sockets_.emplace_back(std::make_unique<zmq::socket_t>(context_, ZMQ_PAIR));
+		}
+	}
+
+	void run()
+	{
+		// Set current server ptr
+		current_server = this;
+		continue_ = true;
+
+#ifndef _WIN32
+		struct sigaction previous_term_handler;
+		struct sigaction previous_int_handler;
+
+		struct sigaction new_handler;
+		new_handler.sa_handler = host_server_impl::sigterm_handler;
+		new_handler.sa_flags = 0;
+		sigemptyset(&new_handler.sa_mask);
+
+		sigaction(SIGINT, &new_handler, &previous_int_handler);
+		sigaction(SIGTERM, &new_handler, &previous_term_handler);
+#endif
+
+		log_->info("Creating {} OpenGL contexts", workers_.size());
+		for (auto &worker : workers_)
+			worker->allocate();
+
+		int hwm = stream_hwm;
+		stream_socket_.setsockopt(ZMQ_RCVHWM, &hwm, sizeof(hwm));
+		stream_socket_.bind("inproc://stc-streams");
+
+		for (auto &worker : workers_)
+		{
+			std::stringstream endpoint;
+			endpoint << "inproc://stc-worker-" << worker->index();
+
+			worker_sockets_[worker->index()]->bind(endpoint.str());
+			worker->start(endpoint.str(), "inproc://stc-streams");
+		}
+
+		// Several endpoints may be given, eg. tcp and ipc for local clients
+		std::stringstream bind_addresses(bind_address_);
+		std::string endpoint;
+		while (std::getline(bind_addresses, endpoint, ','))
+		{
+			log_->info("Binding to {}", endpoint);
+			socket_.bind(endpoint);
+		}
+
+		log_->info("Publishing streams on {}", publish_address_);
+		publish_socket_.setsockopt(ZMQ_SNDHWM, &hwm, sizeof(hwm));
+		publish_socket_.bind(publish_address_);
+
+		std::vector<zmq::pollitem_t> items;
+		items.push_back({ static_cast<void *>(socket_), 0, ZMQ_POLLIN, 0 });
+		for (auto &worker_socket : worker_sockets_)
+			items.push_back({ static_cast<void *>(*worker_socket), 0, ZMQ_POLLIN, 0 });
+		items.push_back({ static_cast<void *>(stream_socket_), 0, ZMQ_POLLIN, 0 });
+
+		while (continue_)
+		{
+			try
+			{
+				zmq::poll(items.data(), items.size(), 100);
+			}
+			catch (zmq::error_t &e)
+			{
+				log_->warn("zmq::poll: {}", e.what());
+				continue;
+			}
+
+			// Replies first, so workers are not starved by new requests
+			for (size_t i = 0; i < workers_.size(); ++i)
+				if (items[i + 1].revents & ZMQ_POLLIN)
+					handle_worker(i);
+
+			if (items[0].revents & ZMQ_POLLIN)
+				handle_client();
+
+			if (items.back().revents & ZMQ_POLLIN)
+				handle_stream();
+		}
 
 		log_->info("Terminating server");
 
+		for (auto &worker : workers_)
+			worker->join();
+
 #ifndef _WIN32
 		sigaction(SIGINT, &previous_int_handler, NULL);
 		sigaction(SIGTERM, &previous_term_handler, NULL);
@@ -370,8 +1885,8 @@ public:
 
 host_server_impl *host_server_impl::current_server = nullptr;
 
-host_server::host_server(const std::string &bind_address)
-	: impl_(new host_server_impl(bind_address))
+host_server::host_server(const host_server_options &options)
+	: impl_(new host_server_impl(options))
 {
 }
 
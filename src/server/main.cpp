@@ -1,4 +1,6 @@
+#include <algorithm>
 #include <iostream>
+#include <thread>
 
 #include "stc/server/host_server.hpp"
 
@@ -11,7 +13,10 @@ namespace po = boost::program_options;
 int main(int argc, char *argv[])
 {
 	bool debug_mode;
-	std::string bind_addr;
+	stc::server::host_server_options options;
+	size_t blob_cache;
+	size_t load_timeout;
+	size_t stream_lease;
 
 	try
 	{
@@ -19,7 +24,18 @@ int main(int argc, char *argv[])
 		desc.add_options()
 			("help,h", "Show this help message")
 			("debug,d", po::bool_switch(&debug_mode)->default_value(false), "Enable debug output")
-			("bind,b", po::value<std::string>(&bind_addr)->default_value("tcp://*:13710"), "Endpoint to bind to");
+			("bind,b", po::value<std::string>(&options.bind_address)->default_value("tcp://*:13710"), "Endpoints to bind to, separated by commas")
+			("publish,p", po::value<std::string>(&options.publish_address)->default_value("tcp://*:13711"), "Endpoint to publish streamed frames on")
+			("workers,w", po::value<size_t>(&options.workers)->default_value(std::max(1u, std::thread::hardware_concurrency())),
+			 "Number of rendering worker threads")
+			("blob-cache", po::value<size_t>(&blob_cache)->default_value(1024),
+			 "Size of the cache of sources and input images uploaded by clients, in MiB")
+			("load-timeout", po::value<size_t>(&load_timeout)->default_value(0),
+			 "Time a request waits for its context to be downloaded before failing, in ms (0: no limit)")
+			("export-dir", po::value<std::string>(&options.export_dir)->default_value(""),
+			 "Directory clients can export rendered frames to (default: exports are refused)")
+			("stream-lease", po::value<size_t>(&stream_lease)->default_value(10000),
+			 "Time after which a stream which was not renewed by its client is stopped, in ms (0: no limit)");
 
 		po::variables_map vm;
 		po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -32,7 +48,12 @@ int main(int argc, char *argv[])
 			if (debug_mode)
 				spdlog::set_level(spdlog::level::debug);
 
-			stc::server::host_server srv(bind_addr);
+			options.workers = std::max<size_t>(1, options.workers);
+			options.blob_cache_size = blob_cache << 20;
+			options.load_timeout = std::chrono::milliseconds(load_timeout);
+			options.stream_lease = std::chrono::milliseconds(stream_lease);
+
+			stc::server::host_server srv(options);
 			srv.run();
 		}
 	}
@@ -0,0 +1,74 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use File::Temp qw(tempdir);
+use POSIX qw(:sys_wait_h);
+use lib "$FindBin::Bin/../ext/omw/t/";
+use TestHelpers;
+use Test::More tests => 4;
+
+my $dir = tempdir(CLEANUP => 1);
+
+# Requests the servers which predate protocol negotiation read completely
+my %known = map { $_ => 1 } qw(render reset create_local get_context context);
+
+# Replies like those servers: requests they know about fail once read, others
+# are rejected before the rest of the message is read, which makes the REP
+# socket fail if the client sent more than one frame
+sub legacy_server {
+	my $context = ZMQ::FFI->new;
+	my $socket = $context->socket(ZMQ::FFI::Constants::ZMQ_REP());
+	$socket->bind("ipc://$dir/legacy");
+
+	while (1)
+	{
+		my $name = $socket->recv;
+		if ($known{$name})
+		{
+			$socket->recv while $socket->get(ZMQ::FFI::Constants::ZMQ_RCVMORE(), 'int');
+			$socket->send_multipart(['ERROR', 'Legacy test server']);
+		}
+		else
+		{
+			$socket->send_multipart(['ERROR', 'Unknown request name']);
+		}
+	}
+}
+
+SKIP: {
+	skip 'ZMQ::FFI is not installed', 4 unless eval { require ZMQ::FFI; require ZMQ::FFI::Constants; 1 };
+
+	my $pid = fork();
+	die "fork: $!" unless defined $pid;
+
+	if ($pid == 0)
+	{
+		eval { legacy_server() };
+		POSIX::_exit(1);
+	}
+
+	# Clients must negotiate without breaking the server, and report its
+	# errors instead of waiting for a reply forever
+	alarm 120;
+
+	for my $target ("ipc://$dir/legacy", "ipc://$dir/legacy?protocol=legacy")
+	{
+		octave_ok "Legacy server errors are reported, $target", <<OCTAVE_CODE;
+st_set_renderer("$target");
+try
+  st_render("stclegacy", 0, 1, 1);
+  exit(2);
+catch err
+  disp(err.message);
+  exit(ifelse(index(err.message, 'Legacy test server') > 0,0,2));
+end
+OCTAVE_CODE
+
+		is(waitpid($pid, WNOHANG), 0, "Legacy server still running, $target");
+	}
+
+	alarm 0;
+	kill 'TERM', $pid;
+	waitpid($pid, 0);
+}
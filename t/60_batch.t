@@ -0,0 +1,60 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use lib "$FindBin::Bin/../ext/omw/t/";
+use TestHelpers;
+use Test::More tests => 4;
+
+my $shader = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=texture(iChannel0, U / iResolution.xy);}
+GLSL
+$shader =~ s/\n//g;
+
+my $frame_shader = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=vec4(iFrame, iMouse.x, 0., 1.);}
+GLSL
+$frame_shader =~ s/\n//g;
+
+octave_ok 'Batched input and render test', <<OCTAVE_CODE;
+m = [0 1];
+ctxt = st_compile("$shader");
+imgl = st_batch(ctxt, "image.0", m, "filter:image.0", "linear", "render", [0 1 1]){1};
+imgn = st_batch(ctxt, "filter:image.0", "nearest", "render", [0 1 1]){1};
+disp("imgl")
+disp(imgl)
+disp("imgn")
+disp(imgn)
+exit(ifelse(imgn(1,1,1)==1 && imgl(1,1,1)==0.5,0,1));
+OCTAVE_CODE
+
+mathematica_ok 'Batched input and render test', <<MATHEMATICA_CODE;
+m = {{0, 1}};
+ctxt = CompileShadertoy["$shader"];
+imgl = First[BatchShadertoy[ctxt, "image.0" -> Image[m], "filter:image.0" -> "Linear", "render" -> { 0, 1, 1 }]];
+imgn = First[BatchShadertoy[ctxt, "filter:image.0" -> "Nearest", "render" -> { 0, 1, 1 }]];
+Print[MatrixForm[ImageData[imgl]]];
+Print[MatrixForm[ImageData[imgn]]];
+Assert[ImageData[imgn][[1, 1, 1]] == 1. && ImageData[imgl][[1, 1, 1]] == .5]
+MATHEMATICA_CODE
+
+# All the frames are returned, and errors tell which operation failed
+octave_ok 'Batched renders and errors', <<OCTAVE_CODE;
+ctxt = st_compile("$frame_shader");
+imgs = st_batch(ctxt, "render", [0 1 1], "render:rgb", [2 1 1 7]);
+ok = numel(imgs) == 2 && size(imgs{2}, 3) == 3 && imgs{1}(1,1,1) == 0 && imgs{2}(1,1,1) == 2 && imgs{2}(1,1,2) == 7;
+try
+  st_batch(ctxt, "render", [0 1 1], "missing.0", [0 1]);
+  ok = false;
+catch err
+  disp(err.message)
+  ok = ok && index(err.message, "Batch operation 2 failed") > 0;
+end
+exit(ifelse(ok,0,1));
+OCTAVE_CODE
+
+mathematica_ok 'Batched renders and errors', <<MATHEMATICA_CODE;
+ctxt = CompileShadertoy["$frame_shader"];
+imgs = BatchShadertoy[ctxt, "render" -> { 0, 1, 1 }, "render:RGB" -> { 2, 1, 1, 7 }];
+Assert[Length[imgs] == 2 && ImageData[imgs[[1]]][[1, 1, 1]] == 0. && ImageData[imgs[[2]]][[1, 1]] == {2., 7., 0.}]
+MATHEMATICA_CODE
@@ -0,0 +1,62 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use File::Path qw(make_path);
+use File::Temp qw(tempdir);
+use lib "$FindBin::Bin/../ext/omw/t/";
+use TestHelpers;
+use Test::More tests => 4;
+
+my $shader = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=texture(iChannel0, U / iResolution.xy);}
+GLSL
+$shader =~ s/\n//g;
+
+# Serve a "remote" context from the cache, so it can be reset without network access
+my $dir = tempdir(CLEANUP => 1);
+make_path("$dir/cache/shaders");
+open(my $fh, '>', "$dir/cache/shaders/stcbatchreset.json") or die $!;
+print $fh '{"validated":' . time() . ',"spec":{"Shader":{"renderpass":[{"type":"image","name":"Image","inputs":[],"code":"' . $shader . '"}]}}}';
+close($fh);
+
+$ENV{STC_CACHE_DIR} = "$dir/cache";
+$ENV{STC_OFFLINE} = 1;
+
+# Inputs set after a reset in the same batch apply to the new context
+my $octave_code = <<OCTAVE_CODE;
+st_batch("stcbatchreset", "image.0", [0 0], "render", [0 1 1]);
+img = st_batch("stcbatchreset", "reset", 0, "image.0", [1 1], "render", [0 1 1]){1};
+disp(img)
+exit(ifelse(img(1,1,1)==1,0,1));
+OCTAVE_CODE
+
+my $mathematica_code = <<MATHEMATICA_CODE;
+BatchShadertoy["stcbatchreset", "image.0" -> Image[{{0, 0}}], "render" -> { 0, 1, 1 }];
+img = First[BatchShadertoy["stcbatchreset", "reset" -> 0, "image.0" -> Image[{{1, 1}}], "render" -> { 0, 1, 1 }]];
+Print[MatrixForm[ImageData[img]]];
+Assert[ImageData[img][[1, 1, 1]] == 1.]
+MATHEMATICA_CODE
+
+octave_ok 'Batched reset then input, local', $octave_code;
+mathematica_ok 'Batched reset then input, local', $mathematica_code;
+
+SKIP: {
+	my $server = $ENV{STC_BUILD_DIR} ? "$ENV{STC_BUILD_DIR}/src/server/shadertoy_server" : undef;
+	skip 'shadertoy_server was not built', 2 unless $server && -x $server;
+
+	my $pid = fork();
+	die "fork: $!" unless defined $pid;
+
+	if ($pid == 0)
+	{
+		exec($server, '--workers', 1, '--bind', "ipc://$dir/server", '--publish', "ipc://$dir/publish")
+			or die "exec: $!";
+	}
+
+	octave_ok 'Batched reset then input, server', "st_set_renderer(\"ipc://$dir/server\");\n$octave_code";
+	mathematica_ok 'Batched reset then input, server', "SetShadertoyRenderer[\"ipc://$dir/server\"];\n$mathematica_code";
+
+	kill 'TERM', $pid;
+	waitpid($pid, 0);
+}
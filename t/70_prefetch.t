@@ -0,0 +1,48 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use File::Path qw(make_path);
+use File::Temp qw(tempdir);
+use lib "$FindBin::Bin/../ext/omw/t/";
+use TestHelpers;
+use Test::More tests => 2;
+
+my $shader = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=vec4(iFrame, iResolution.x, U.xy);}
+GLSL
+$shader =~ s/\n//g;
+
+# Serve a remote context from the offline cache. The cache file is removed
+# after prefetching, so rendering only succeeds if the prefetch loaded it.
+my $dir = tempdir(CLEANUP => 1);
+make_path("$dir/cache/shaders");
+
+sub cache_shader {
+	my $id = shift;
+	open(my $fh, '>', "$dir/cache/shaders/$id.json") or die $!;
+	print $fh '{"validated":' . time() . ',"spec":{"Shader":{"renderpass":[{"type":"image","name":"Image","inputs":[],"code":"' . $shader . '"}]}}}';
+	close($fh);
+	return "$dir/cache/shaders/$id.json";
+}
+
+$ENV{STC_CACHE_DIR} = "$dir/cache";
+$ENV{STC_OFFLINE} = 1;
+
+my $octave_file = cache_shader('stcprefetchoctave');
+octave_ok 'Prefetch then render', <<OCTAVE_CODE;
+st_prefetch("stcprefetchoctave");
+pause(1);
+delete("$octave_file");
+img = st_render("stcprefetchoctave", 0, 2, 2, 'rgba');
+exit(ifelse(all(diag(img(1,1,:)(:) == [0.0 2.0 0.5 1.5])),0,2))
+OCTAVE_CODE
+
+my $mathematica_file = cache_shader('stcprefetchmathematica');
+mathematica_ok 'Prefetch then render', <<MATHEMATICA_CODE;
+PrefetchShadertoy["stcprefetchmathematica"];
+Pause[1];
+DeleteFile["$mathematica_file"];
+img = ImageData[RenderShadertoy["stcprefetchmathematica", Frame -> 0, Size -> { 2, 2 }, Format -> "RGBA"]];
+Assert[img[[1, 1]] == {0.0, 2.0, 0.5, 1.5}]
+MATHEMATICA_CODE
@@ -0,0 +1,29 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use lib "$FindBin::Bin/../ext/omw/t/";
+use TestHelpers;
+use Test::More tests => 2;
+
+my $shader = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=vec4(0.0);}
+GLSL
+$shader =~ s/\n//g;
+
+my $sound = <<GLSL;
+vec2 mainSound(int samp, float time){return vec2(float(samp), time);}
+GLSL
+$sound =~ s/\n//g;
+
+octave_ok 'Render sound samples', <<OCTAVE_CODE;
+ctxt = st_compile("$shader", 'sound', "$sound");
+snd = st_render_sound(ctxt, 10, 600000, 1000);
+exit(ifelse(all(size(snd) == [600000 2]) && snd(1,1) == 10 && snd(600000,1) == 600009 && abs(snd(2,2) - 0.011) < 1e-6,0,2))
+OCTAVE_CODE
+
+mathematica_ok 'Render sound samples', <<MATHEMATICA_CODE;
+ctxt = CompileShadertoy["$shader", "sound" -> "$sound"];
+snd = Flatten /@ RenderShadertoySound[ctxt, Start -> 10, Samples -> 600000, SampleRate -> 1000];
+Assert[Length[snd] == 600000 && snd[[1, 1]] == 10 && snd[[600000, 1]] == 600009 && Abs[snd[[2, 2]] - 0.011] < 10^-6]
+MATHEMATICA_CODE
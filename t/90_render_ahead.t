@@ -0,0 +1,76 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use lib "$FindBin::Bin/../ext/omw/t/";
+use TestHelpers;
+use Test::More tests => 4;
+
+my $shader = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=vec4(iFrame, iResolution.x, U.xy);}
+GLSL
+$shader =~ s/\n//g;
+
+# Buffer a counts the frames it rendered, so frames depend on the previous ones
+my $counter = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=texelFetch(iChannel0, ivec2(U), 0) + vec4(1.);}
+GLSL
+
+my $image = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=texelFetch(iChannel0, ivec2(U), 0);}
+GLSL
+
+$_ =~ s/\n//g for ($counter, $image);
+
+octave_ok 'Render ahead', <<OCTAVE_CODE;
+ctxt = st_compile("$shader");
+st_set_render_ahead(ctxt, true);
+a = st_render(ctxt, 0, 2, 2, 'rgba');
+b = st_render(ctxt, 1, 2, 2, 'rgba');
+c = st_render(ctxt, 5, 3, 3, 'rgba');
+d = st_render(ctxt, -1, 3, 3, 'rgba');
+exit(ifelse(a(1,1,1) == 0 && b(1,1,1) == 1 && c(1,1,1) == 5 && c(1,1,2) == 3 && d(1,1,1) == 6,0,2))
+OCTAVE_CODE
+
+mathematica_ok 'Render ahead', <<MATHEMATICA_CODE;
+ctxt = CompileShadertoy["$shader"];
+SetShadertoyRenderAhead[ctxt, True];
+a = ImageData[RenderShadertoy[ctxt, Frame -> 0, Size -> { 2, 2 }, Format -> "RGBA"]];
+b = ImageData[RenderShadertoy[ctxt, Frame -> 1, Size -> { 2, 2 }, Format -> "RGBA"]];
+c = ImageData[RenderShadertoy[ctxt, Frame -> 5, Size -> { 3, 3 }, Format -> "RGBA"]];
+Assert[a[[1, 1, 1]] == 0.0 && b[[1, 1, 1]] == 1.0 && c[[1, 1, 1]] == 5.0 && c[[1, 1, 2]] == 3.0]
+MATHEMATICA_CODE
+
+# Frames of a stateful context are the same with and without render ahead,
+# including after a call which discards the frame rendered ahead
+octave_ok 'Render ahead with buffers', <<OCTAVE_CODE;
+v = zeros(2, 6);
+for ahead = 0:1
+  ctxt = st_compile("$image", "a", "$counter");
+  st_set_input(ctxt, "a.0", "a", "image.0", "a");
+  st_set_render_ahead(ctxt, ahead == 1);
+  for f = 0:5
+    img = st_render(ctxt, -1, 2, 2, 'rgba');
+    v(ahead + 1, f + 1) = img(1,1,1);
+    if f == 2
+      st_set_input(ctxt, "image.0", "a");
+    end
+  end
+end
+disp(v)
+exit(ifelse(isequal(v(1,:), v(2,:)),0,2))
+OCTAVE_CODE
+
+mathematica_ok 'Render ahead with buffers', <<MATHEMATICA_CODE;
+values = Table[
+  ctxt = CompileShadertoy["$image", "a" -> "$counter"];
+  SetShadertoyInput[ctxt, "a.0" -> "a", "image.0" -> "a"];
+  SetShadertoyRenderAhead[ctxt, ahead];
+  Table[
+    img = ImageData[RenderShadertoy[ctxt, Size -> { 2, 2 }, Format -> "RGBA"]][[1, 1, 1]];
+    If[f == 2, SetShadertoyInput[ctxt, "image.0" -> "a"]];
+    img, { f, 0, 5 }],
+  { ahead, { False, True } }];
+Print[values];
+Assert[values[[1]] == values[[2]]]
+MATHEMATICA_CODE
@@ -0,0 +1,37 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use lib "$FindBin::Bin/../ext/omw/t/";
+use TestHelpers;
+use Test::More tests => 3;
+
+my $shader = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=vec4(1.0,0.0,0.0,1.0);}
+GLSL
+$shader =~ s/\n//g;
+
+octave_ok 'Export raw frames', <<OCTAVE_CODE;
+ctxt = st_compile("$shader");
+path = [tempname() '.rgba'];
+[frames, bytes] = st_export(ctxt, [5 14], [16 8], path);
+fid = fopen(path, 'r'); data = fread(fid, Inf, 'uint8'); fclose(fid); delete(path);
+exit(ifelse(frames == 10 && bytes == 10*16*8*4 && numel(data) == bytes && all(data(1:4)' == [255 0 0 255]),0,2))
+OCTAVE_CODE
+
+octave_ok 'Export a memory-mapped array', <<OCTAVE_CODE;
+ctxt = st_compile("$shader");
+path = [tempname() '.npy'];
+[frames, bytes] = st_export(ctxt, 3, [16 8], path);
+fid = fopen(path, 'r'); magic = fread(fid, 6, 'uint8')'; fseek(fid, 8); header = fread(fid, 1, 'uint16');
+fseek(fid, 10 + header); data = fread(fid, Inf, 'single'); fclose(fid); delete(path);
+exit(ifelse(frames == 3 && magic(1) == 147 && numel(data) == 3*8*16*4 && bytes == 10 + header + 4*numel(data) && all(data(1:4)' == [1 0 0 1]),0,2))
+OCTAVE_CODE
+
+mathematica_ok 'Export a Y4M video', <<MATHEMATICA_CODE;
+ctxt = CompileShadertoy["$shader"];
+path = FileNameJoin[{\$TemporaryDirectory, "95_export.y4m"}];
+res = ExportShadertoy[ctxt, 10, { 16, 8 }, path];
+Assert[res[[1]] == 10 && res[[2]] == FileByteCount[path] && FileByteCount[path] == 36 + 10*(6 + 3*16*8)];
+DeleteFile[path]
+MATHEMATICA_CODE
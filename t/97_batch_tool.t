@@ -0,0 +1,140 @@
+#!/usr/bin/env perl
+use strict;
+use warnings;
+use FindBin;
+use File::Temp qw(tempdir);
+use POSIX qw(:sys_wait_h);
+use Time::HiRes qw(sleep);
+use Test::More tests => 9;
+
+my $batch = $ENV{STC_BUILD_DIR} ? "$ENV{STC_BUILD_DIR}/src/batch/shadertoy_batch" : undef;
+
+# Frames only depend on their number
+my $still = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=vec4(float(iFrame)/255.,0.,0.,1.);}
+GLSL
+
+# Buffer a counts the frames it rendered, so it depends on all the previous ones
+my $counter = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=texelFetch(iChannel0, ivec2(U), 0) + vec4(1.);}
+GLSL
+
+my $image = <<GLSL;
+void mainImage(out vec4 O, in vec2 U){O=texelFetch(iChannel0, ivec2(U), 0);}
+GLSL
+
+$_ =~ s/\n//g for ($still, $counter, $image);
+
+my $dir = tempdir(CLEANUP => 1);
+my $fh;
+
+# Size of the frames of the counter job
+my $counter_size;
+
+sub write_manifest {
+	($counter_size) = @_;
+
+	open(my $fh, '>', "$dir/manifest.json") or die $!;
+	print $fh <<JSON;
+{
+	"jobs": [
+		{ "name": "still", "image": "$still", "size": 2, "frames": 8, "output": "still/%02d.png" },
+		{ "name": "counter", "image": "$image", "buffers": { "a": "$counter" }, "inputs": { "a.0": "a", "image.0": "a" },
+		  "size": $counter_size, "frames": 8, "output": "counter.npy" }
+	]
+}
+JSON
+	close($fh);
+}
+
+write_manifest(1);
+
+my @command = ($batch, "$dir/manifest.json", '--output', "$dir/out", '--workers', 2, '--chunk', 2);
+
+sub run_batch {
+	my $pid = fork();
+	die "fork: $!" unless defined $pid;
+
+	if ($pid == 0)
+	{
+		open(STDERR, '>', "$dir/log") or die $!;
+		exec(@command) or die "exec: $!";
+	}
+
+	return $pid;
+}
+
+sub log_contents {
+	open(my $fh, '<', "$dir/log") or return '';
+	local $/;
+	return <$fh>;
+}
+
+# Values of the counter frames, which should be consecutive after any resume
+sub counter_values {
+	open(my $fh, '<:raw', "$dir/out/counter.npy") or return ();
+	local $/;
+	my $data = <$fh>;
+	my $header = unpack('v', substr($data, 8, 2));
+	my @floats = unpack('f<*', substr($data, 10 + $header));
+	return map { $floats[4 * $counter_size * $counter_size * $_] } 0 .. 7;
+}
+
+sub counter_ok {
+	my @values = counter_values();
+	return @values == 8 && $values[0] > 0 && !grep { $values[$_] != $values[0] + $_ } 0 .. 7;
+}
+
+sub stills_ok {
+	return !grep { !-s sprintf("$dir/out/still/%02d.png", $_) } 0 .. 7;
+}
+
+SKIP: {
+	skip 'shadertoy_batch was not built', 9 unless $batch && -x $batch;
+
+	# Interrupt the first run once it completed a chunk
+	my $pid = run_batch();
+	for (my $i = 0; $i < 300 && !-s "$dir/manifest.json.progress" && waitpid($pid, WNOHANG) == 0; ++$i)
+	{
+		sleep(0.1);
+	}
+	kill 'KILL', $pid;
+	waitpid($pid, 0);
+
+	skip 'PNG support is not enabled', 9 if log_contents() =~ /PNG support is not enabled/;
+
+	waitpid(run_batch(), 0);
+	is($?, 0, 'Resume an interrupted run');
+	ok(counter_ok(), 'Stateful job resumed with its buffers') or diag(join(' ', counter_values()));
+	ok(stills_ok(), 'Stateless job resumed');
+
+	# Remove a frame file and a chunk of the stateful job, which must both be
+	# rendered again
+	unlink("$dir/out/still/03.png");
+
+	open($fh, '<', "$dir/manifest.json.progress") or die $!;
+	my @chunks = grep { !/^counter\t4 / } <$fh>;
+	close($fh);
+	open($fh, '>', "$dir/manifest.json.progress") or die $!;
+	print $fh @chunks;
+	close($fh);
+
+	open($fh, '+<:raw', "$dir/out/counter.npy") or die $!;
+	seek($fh, -4 * 4 * 4, 2);
+	print $fh pack('f<*', (0) x 8);
+	close($fh);
+
+	waitpid(run_batch(), 0);
+	is($?, 0, 'Resume a run with missing frames');
+	like(log_contents(), qr/^2 chunks to render/m, 'Only missing chunks are rendered');
+	ok(counter_ok() && stills_ok(), 'Missing frames rendered again') or diag(join(' ', counter_values()));
+
+	# A job whose output changed shape is rendered again, as its file is
+	# replaced
+	write_manifest(2);
+
+	waitpid(run_batch(), 0);
+	is($?, 0, 'Resume a run with a resized job');
+	like(log_contents(), qr/^4 chunks to render/m, 'Chunks of the replaced output are rendered');
+	ok(counter_ok(), 'Resized job rendered again') or diag(join(' ', counter_values()));
+}